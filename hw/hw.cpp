@@ -29,6 +29,7 @@ SOFTWARE.
 #include <ota.hpp>
 #include <perf.hpp>
 #include <scale.hpp>
+#include <scheduler.hpp>
 #include <serialws.hpp>
 #include <temp_mgr.hpp>
 #include <utils.hpp>
@@ -41,10 +42,9 @@ Display myDisplay;
 Scale myScale;
 LevelDetection myLevelDetection;
 TempSensorManager myTemp;
+Scheduler myScheduler;
 
-const int loopInterval = 2000;
-int loopCounter = 0;
-uint32_t loopMillis = 0;
+void setupTasks();
 
 void setup() {
 #if defined(ESP8266)
@@ -87,6 +87,7 @@ void setup() {
 
   Log.notice(F("Main: Setup completed." CR));
   myTemp.read();
+  setupTasks();
 }
 
 void draw(UnitIndex idx, float temp, float scale1, float scale2, int32_t raw1, int32_t raw2) {
@@ -112,45 +113,47 @@ void draw(UnitIndex idx, float temp, float scale1, float scale2, int32_t raw1, i
 }
 
 
+// Try to reconnect to scales if they are missing (6 seconds)
+void scaleReconnectTask() {
+  if (!myScale.isConnected(UnitIndex::U1) ||
+      !myScale.isConnected(UnitIndex::U2)) {
+    myScale.setup();  // Try to reconnect to scale
+  }
+}
+
+// The temp sensor should not be read too often. Reading every 2 seconds.
+void tempReadTask() { myTemp.read(); }
+
+// Check if the temp sensor exist and try to reinitialize (6 seconds)
+void tempReconnectTask() {
+  if (!myTemp.hasSensor()) {
+    myTemp.reset();
+    myTemp.setup();
+  }
+}
+
+void drawTask() {
+  float t = myTemp.getLastTempC();
+  float s1 = myScale.read(UnitIndex::U1, true);
+  float s2 = myScale.read(UnitIndex::U2, true);
+  int32_t l1 = myScale.readLastRaw(UnitIndex::U1);
+  int32_t l2 = myScale.readLastRaw(UnitIndex::U2);
+
+  draw(UnitIndex::U1, t, s1, s2, l1, l2);
+  draw(UnitIndex::U2, t, s1, s2, l1, l2);
+}
+
+void setupTasks() {
+  myScheduler.add("draw", drawTask, 2000, 500);
+  myScheduler.add("temp-read", tempReadTask, 2000, 1000);
+  myScheduler.add("scale-reconnect", scaleReconnectTask, 6000, 2000);
+  myScheduler.add("temp-reconnect", tempReconnectTask, 6000, 2000);
+}
+
 void loop() {
   myScale.loop(UnitIndex::U1);
   myScale.loop(UnitIndex::U2);
-
-  if (abs((int32_t)(millis() - loopMillis)) >
-      loopInterval) {  // 2 seconds loop interval
-    loopMillis = millis();
-    loopCounter++;
-
-    // Try to reconnect to scales if they are missing (6 seconds)
-    if (!(loopCounter % 3)) {
-      if (!myScale.isConnected(UnitIndex::U1) ||
-          !myScale.isConnected(UnitIndex::U2)) {
-        myScale.setup();  // Try to reconnect to scale
-      }
-    }
-
-    // The temp sensor should not be read too often. Reading every 4 seconds.
-    if (!(loopCounter % 1)) {
-      myTemp.read();
-    }
-
-    // Check if the temp sensor exist and try to reinitialize
-    if (!(loopCounter % 3)) {
-      if (!myTemp.hasSensor()) {
-        myTemp.reset();
-        myTemp.setup();
-      }
-    }
-
-    float t = myTemp.getLastTempC();
-    float s1 = myScale.read(UnitIndex::U1, true);
-    float s2 = myScale.read(UnitIndex::U2, true);
-    int32_t l1 = myScale.readLastRaw(UnitIndex::U1);
-    int32_t l2 = myScale.readLastRaw(UnitIndex::U2);
-
-    draw(UnitIndex::U1, t, s1, s2, l1, l2);
-    draw(UnitIndex::U2, t, s1, s2, l1, l2);
-  }
+  myScheduler.loop();
 }
 
 // EOF
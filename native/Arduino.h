@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_ARDUINO_H_
+#define NATIVE_ARDUINO_H_
+
+// Minimal Arduino shim so that the level detection code can be compiled and
+// run on a Linux host (see the kegmon-native environments in platformio.ini).
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+class String : public std::string {
+ public:
+  String() {}
+  String(const char *s) : std::string(s ? s : "") {}  // NOLINT
+  String(const std::string &s) : std::string(s) {}    // NOLINT
+  explicit String(int i) : std::string(std::to_string(i)) {}
+  String(float f, int decimals) {
+    char buf[40];
+    snprintf(&buf[0], sizeof(buf), "%.*f", decimals, f);
+    assign(&buf[0]);
+  }
+
+  bool equals(const char *s) const { return compare(s) == 0; }
+  int compareTo(const char *s) const { return compare(s); }
+  float toFloat() const { return strtof(c_str(), nullptr); }
+  int toInt() const { return atoi(c_str()); }
+};
+
+// The host clock can be replaced by a simulated clock, this allows a replay
+// to run as fast as possible while the code still sees the recorded timeline.
+class NativeClock {
+ private:
+  static int64_t &offset() {
+    static int64_t o = 0;
+    return o;
+  }
+  static bool &simulated() {
+    static bool s = false;
+    return s;
+  }
+  static uint64_t &simulatedMicros() {
+    static uint64_t m = 0;
+    return m;
+  }
+
+ public:
+  static void useSimulated(bool b) { simulated() = b; }
+  static void setMicros(uint64_t us) { simulatedMicros() = us; }
+  static void advanceMicros(uint64_t us) { simulatedMicros() += us; }
+
+  static uint64_t now() {
+    if (simulated()) return simulatedMicros();
+    static auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+};
+
+inline uint32_t micros() { return static_cast<uint32_t>(NativeClock::now()); }
+inline uint32_t millis() {
+  return static_cast<uint32_t>(NativeClock::now() / 1000);
+}
+inline void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+inline void delayMicroseconds(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+inline void yield() {}
+
+inline int32_t random(int32_t min, int32_t max) {
+  if (max <= min) return min;
+  return min + (rand() % (max - min));  // NOLINT
+}
+inline void randomSeed(uint32_t seed) { srand(seed); }
+
+#endif  // NATIVE_ARDUINO_H_
+
+// EOF
@@ -0,0 +1,113 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_LITTLEFS_H_
+#define NATIVE_LITTLEFS_H_
+
+#include <Arduino.h>
+#include <sys/stat.h>
+
+#include <memory>
+
+// Host version of the LittleFS file system, all paths are mapped to a folder
+// on the host (default .littlefs in the current directory).
+class File {
+ private:
+  std::shared_ptr<FILE> _f;
+
+ public:
+  File() {}
+  explicit File(FILE *f) {
+    if (f) _f.reset(f, [](FILE *p) { fclose(p); });  // Failed open is empty
+  }
+
+  explicit operator bool() const { return _f != nullptr; }
+
+  size_t write(const uint8_t *buf, size_t len) {
+    return _f ? fwrite(buf, 1, len, _f.get()) : 0;
+  }
+  size_t write(const char *buf, size_t len) {
+    return write(reinterpret_cast<const uint8_t *>(buf), len);
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    return _f ? fread(buf, 1, len, _f.get()) : 0;
+  }
+  size_t readBytes(char *buf, size_t len) {
+    return read(reinterpret_cast<uint8_t *>(buf), len);
+  }
+  bool seek(uint32_t pos) {
+    return _f ? fseek(_f.get(), pos, SEEK_SET) == 0 : false;
+  }
+  size_t position() const { return _f ? ftell(_f.get()) : 0; }
+  size_t size() const {
+    if (!_f) return 0;
+    long p = ftell(_f.get());
+    fseek(_f.get(), 0, SEEK_END);
+    long s = ftell(_f.get());
+    fseek(_f.get(), p, SEEK_SET);
+    return s;
+  }
+  int available() const { return size() - position(); }
+  void flush() {
+    if (_f) fflush(_f.get());
+  }
+  void close() { _f.reset(); }
+};
+
+class LittleFSFS {
+ private:
+  std::string _root = ".littlefs";
+
+  std::string path(const char *p) const { return _root + p; }
+
+ public:
+  void setRoot(const char *root) { _root = root; }
+  const char *getRoot() const { return _root.c_str(); }
+
+  bool begin() {
+    mkdir(_root.c_str(), 0755);
+    return true;
+  }
+  void end() {}
+
+  File open(const char *p, const char *mode) {
+    begin();
+    std::string m = mode;
+    if (m.find('b') == std::string::npos) m += "b";
+    return File(fopen(path(p).c_str(), m.c_str()));
+  }
+  bool exists(const char *p) {
+    struct stat s;
+    return stat(path(p).c_str(), &s) == 0;
+  }
+  bool remove(const char *p) { return ::remove(path(p).c_str()) == 0; }
+  bool rename(const char *from, const char *to) {
+    return ::rename(path(from).c_str(), path(to).c_str()) == 0;
+  }
+};
+
+extern LittleFSFS LittleFS;
+
+#endif  // NATIVE_LITTLEFS_H_
+
+// EOF
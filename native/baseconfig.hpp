@@ -0,0 +1,62 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_BASECONFIG_HPP_
+#define NATIVE_BASECONFIG_HPP_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Host version of the espframework base configuration, only keeps the parts
+// that KegConfig depends on. Nothing is stored on the host.
+class BaseConfig {
+ protected:
+  String _id = "native";
+  String _mDNS;
+  String _fileName;
+  char _tempFormat = 'C';
+  bool _saveNeeded = false;
+
+ public:
+  BaseConfig(String baseMDNS, String fileName) {
+    _mDNS = baseMDNS;
+    _fileName = fileName;
+  }
+
+  const char *getID() const { return _id.c_str(); }
+  const char *getMDNS() const { return _mDNS.c_str(); }
+  char getTempFormat() const { return _tempFormat; }
+  bool isTempFormatC() const { return _tempFormat == 'C'; }
+  bool isTempFormatF() const { return _tempFormat == 'F'; }
+
+  bool saveFile() {
+    _saveNeeded = false;
+    return true;
+  }
+  bool loadFile() { return true; }
+  bool isSaveNeeded() const { return _saveNeeded; }
+};
+
+#endif  // NATIVE_BASECONFIG_HPP_
+
+// EOF
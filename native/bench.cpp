@@ -0,0 +1,105 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <Arduino.h>
+#include <tinyexpr.h>
+
+#include <chrono>
+#include <tempcompensation.hpp>
+#include <utils.hpp>
+
+// Host benchmark for the temperature compensation used in RawLevelDetection.
+// Compares the old approach (compile + eval + free for each sample) with the
+// cached compiled expression and the closed form fast path.
+//
+// Build with: pio run -e kegmon-bench
+// Run with: .pio/build/kegmon-bench/program
+
+constexpr auto BENCH_SAMPLES = 200000;
+
+float compileEachSample(const char *formula, float v, float temp) {
+  double weight = v;
+  double tempC = temp;
+  double tempF = convertCtoF(tempC);
+  int err;
+  te_variable vars[] = {
+      {"weight", &weight}, {"tempC", &tempC}, {"tempF", &tempF}};
+  te_expr *expr = te_compile(formula, vars, 3, &err);
+  float r = NAN;
+
+  if (expr) {
+    r = te_eval(expr);
+    te_free(expr);
+  }
+
+  return r;
+}
+
+template <typename T>
+double measure(T func) {
+  auto start = std::chrono::steady_clock::now();
+  volatile float sink = 0;
+
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    float v = 20.0 + (i % 100) * 0.001;
+    float t = 3.0 + (i % 50) * 0.01;
+    sink = sink + func(v, t);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         BENCH_SAMPLES;
+}
+
+void benchFormula(const char *formula) {
+  TempCompensation comp;
+  comp.compile(formula);
+
+  double before = measure([formula](float v, float t) {
+    return compileEachSample(formula, v, t);
+  });
+  double after = measure([&comp, formula](float v, float t) {
+    comp.compile(formula);  // Same call pattern as RawLevelDetection::add()
+    return comp.calculate(v, t);
+  });
+
+  printf("%-40s %s\n", formula, comp.isLinear() ? "(closed form)" : "(tinyexpr)");
+  printf("  compile per sample : %8.1f ns/sample\n", before);
+  printf("  cached             : %8.1f ns/sample (%.1fx)\n", after,
+         before / after);
+
+  float a = compileEachSample(formula, 20.153, 3.6);
+  float b = comp.calculate(20.153, 3.6);
+  printf("  check              : %f / %f\n", a, b);
+}
+
+int main(int argc, char **argv) {
+  printf("Temperature compensation benchmark, %d samples\n", BENCH_SAMPLES);
+  benchFormula("weight*(1.0-0.025*(tempC-3.0))");
+  benchFormula("weight * (1 + 0.004 * (tempC - 5))");
+  benchFormula("weight*(1+(0.004*(tempC-5)))");
+  benchFormula("weight-(1+0.004*(tempF-41))");
+  return 0;
+}
+
+// EOF
@@ -0,0 +1,128 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_LOG_HPP_
+#define NATIVE_LOG_HPP_
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Host version of the espframework logger, supports the same format
+// specifiers as ArduinoLog and writes to stderr.
+
+#define CR "\n"
+
+#define LOG_LEVEL_SILENT 0
+#define LOG_LEVEL_FATAL 1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_INFO 4
+#define LOG_LEVEL_NOTICE 4
+#define LOG_LEVEL_TRACE 5
+#define LOG_LEVEL_VERBOSE 6
+
+#if !defined(LOG_LEVEL)
+#define LOG_LEVEL LOG_LEVEL_NOTICE
+#endif
+
+class NativeLogging {
+ private:
+  int _level = LOG_LEVEL;
+
+  void print(int level, const char *fmt, va_list args) {
+    if (level > _level) return;
+
+    for (const char *p = fmt; *p; p++) {
+      if (*p != '%') {
+        fputc(*p, stderr);
+        continue;
+      }
+
+      switch (*++p) {
+        case 0:
+          return;
+        case 's':
+          fputs(va_arg(args, const char *), stderr);
+          break;
+        case 'c':
+          fputc(va_arg(args, int), stderr);
+          break;
+        case 'd':
+        case 'i':
+        case 'l':
+          fprintf(stderr, "%d", va_arg(args, int));
+          break;
+        case 'u':
+          fprintf(stderr, "%u", va_arg(args, unsigned));
+          break;
+        case 'x':
+          fprintf(stderr, "%x", va_arg(args, unsigned));
+          break;
+        case 'X':
+          fprintf(stderr, "%X", va_arg(args, unsigned));
+          break;
+        case 'F':
+        case 'D':
+          fprintf(stderr, "%f", va_arg(args, double));
+          break;
+        case 't':
+        case 'T':
+          fputs(va_arg(args, int) ? "true" : "false", stderr);
+          break;
+        case 'p':
+          fprintf(stderr, "%p", va_arg(args, void *));
+          break;
+        default:
+          fputc(*p, stderr);
+          break;
+      }
+    }
+  }
+
+ public:
+  void setLevel(int level) { _level = level; }
+  int getLevel() const { return _level; }
+
+#define NATIVE_LOG_METHOD(name, level) \
+  void name(const char *fmt, ...) {    \
+    va_list args;                      \
+    va_start(args, fmt);               \
+    print(level, fmt, args);           \
+    va_end(args);                      \
+  }
+
+  NATIVE_LOG_METHOD(fatal, LOG_LEVEL_FATAL)
+  NATIVE_LOG_METHOD(error, LOG_LEVEL_ERROR)
+  NATIVE_LOG_METHOD(warning, LOG_LEVEL_WARNING)
+  NATIVE_LOG_METHOD(notice, LOG_LEVEL_NOTICE)
+  NATIVE_LOG_METHOD(info, LOG_LEVEL_INFO)
+  NATIVE_LOG_METHOD(trace, LOG_LEVEL_TRACE)
+  NATIVE_LOG_METHOD(verbose, LOG_LEVEL_VERBOSE)
+#undef NATIVE_LOG_METHOD
+};
+
+extern NativeLogging Log;
+
+#endif  // NATIVE_LOG_HPP_
+
+// EOF
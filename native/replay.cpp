@@ -0,0 +1,156 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <getopt.h>
+
+#include <chrono>
+#include <replay.hpp>
+
+// Host replay of recorded scale data through the level detection. Prints the
+// stable/pour events as CSV on stdout and a summary on stderr.
+//
+// Build with: pio run -e kegmon-replay
+// Run with: .pio/build/kegmon-replay/program [options] [dataset]
+
+KegConfig myConfig(CFG_MDNSNAME, CFG_FILENAME);
+LevelDetection myLevelDetection;
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] [dataset.kds|dataset.csv]\n"
+          "  -t <tap>       Only run tap 1 or 2 (default both)\n"
+          "  -x             Swap scale1 and scale2 columns\n"
+          "  -i <ms>        Sample interval when the data has no time "
+          "(default 2000)\n"
+          "  -s <key=value> Override a configuration setting, for example\n"
+          "                 scale_deviation_decrease=0.1\n"
+          "  -o <file.kds>  Convert the input to a binary dataset and exit\n"
+          "  -v             Show level detection logging\n"
+          "Without a dataset the simulator data in raw/simulated.hpp is "
+          "used.\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  uint32_t interval = 2000;
+  int tap = 0;
+  bool swap = false;
+  const char *output = 0;
+  int opt;
+
+  Log.setLevel(LOG_LEVEL_WARNING);
+
+  while ((opt = getopt(argc, argv, "t:xi:s:o:vh")) != -1) {
+    switch (opt) {
+      case 't':
+        tap = atoi(optarg);
+        break;
+      case 'x':
+        swap = true;
+        break;
+      case 'i':
+        interval = atoi(optarg);
+        break;
+      case 's': {
+        String s = optarg;
+        size_t p = s.find('=');
+        if (p == std::string::npos ||
+            !applyReplaySetting(s.substr(0, p).c_str(),
+                                s.substr(p + 1).c_str())) {
+          fprintf(stderr, "Unknown setting %s\n", optarg);
+          return 1;
+        }
+      } break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'v':
+        Log.setLevel(LOG_LEVEL_VERBOSE);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  ReplayEngine engine;
+  engine.setTaps(tap != 2, tap != 1, swap);
+
+  DatasetReader reader;
+  std::vector<DatasetRecord> records;
+
+  if (optind < argc && isReplayDataset(argv[optind])) {
+    if (!reader.open(argv[optind])) return 1;
+  } else if (optind < argc) {
+    if (!loadReplayCsv(argv[optind], interval, records)) return 1;
+  } else {
+    loadReplayBuiltin(interval, records);
+  }
+
+  if (output) {
+    DatasetWriter writer;
+    DatasetRecord r;
+
+    if (!writer.open(output, interval)) return 1;
+    if (reader.isOpen()) {
+      while (reader.next(r)) writer.write(r);
+    } else {
+      for (const DatasetRecord &rec : records) writer.write(rec);
+    }
+    writer.close();
+    fprintf(stderr, "Created %s.\n", output);
+    return 0;
+  }
+
+  uint32_t last = 0;
+  auto start = std::chrono::steady_clock::now();
+  if (reader.isOpen()) {
+    DatasetRecord r;
+    while (reader.next(r)) {
+      engine.process(r);
+      last = r.time;
+    }
+  } else {
+    for (const DatasetRecord &r : records) {
+      engine.process(r);
+      last = r.time;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  printf("time,tap,event,stable,pour\n");
+  for (const ReplayEvent &e : engine.getEvents()) {
+    printf("%u,%d,%s,%.3f,%.3f\n", e.time, e.idx + 1,
+           e.type == ReplayEventType::ReplayPour ? "pour" : "stable", e.stable,
+           e.pour);
+  }
+
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+  fprintf(stderr,
+          "Replayed %u records (%.1f h of data) in %.1f ms, %zu events.\n",
+          engine.getRecords(), last / 3600000.0, ms,
+          engine.getEvents().size());
+  return 0;
+}
+
+// EOF
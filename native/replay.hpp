@@ -0,0 +1,117 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_REPLAY_HPP_
+#define NATIVE_REPLAY_HPP_
+
+#include <Arduino.h>
+
+#include <dataset.hpp>
+#include <kegconfig.hpp>
+#include <levels.hpp>
+#include <vector>
+
+enum ReplayEventType { ReplayStable = 0, ReplayPour = 1 };
+
+struct ReplayEvent {
+  uint32_t time;
+  UnitIndex idx;
+  ReplayEventType type;
+  float stable;
+  float pour;
+};
+
+// Feeds recorded samples through the level detection and collects the
+// stable/pour events. The host clock is driven by the recorded timestamps so
+// the replay runs as fast as the CPU allows.
+class ReplayEngine {
+ private:
+  bool _tap[2] = {true, true};
+  bool _swap = false;
+  uint32_t _records = 0;
+  std::vector<ReplayEvent> _events;
+
+  // Events are taken from the configured level detection
+  void check(UnitIndex idx, uint32_t time) {
+    if (myLevelDetection.hasNewStableWeight(idx))
+      _events.push_back({time, idx, ReplayEventType::ReplayStable,
+                         myLevelDetection.getTotalStableWeight(idx),
+                         myLevelDetection.getPourWeight(idx)});
+    if (myLevelDetection.hasNewPourWeight(idx))
+      _events.push_back({time, idx, ReplayEventType::ReplayPour,
+                         myLevelDetection.getTotalStableWeight(idx),
+                         myLevelDetection.getPourWeight(idx)});
+  }
+
+ public:
+  ReplayEngine() { NativeClock::useSimulated(true); }
+
+  // Select which taps to run, swap will feed scale2 into tap 1 and vice versa.
+  void setTaps(bool tap1, bool tap2, bool swap = false) {
+    _tap[0] = tap1;
+    _tap[1] = tap2;
+    _swap = swap;
+  }
+
+  void process(const DatasetRecord &r) {
+    NativeClock::setMicros(static_cast<uint64_t>(r.time) * 1000);
+    _records++;
+
+    float v[2] = {_swap ? r.scale2 : r.scale1, _swap ? r.scale1 : r.scale2};
+
+    for (int i = 0; i < 2; i++) {
+      if (!_tap[i]) continue;
+      UnitIndex idx = static_cast<UnitIndex>(i);
+      myLevelDetection.update(idx, v[i], r.temp);
+      check(idx, r.time);
+    }
+  }
+
+  uint32_t getRecords() const { return _records; }
+  const std::vector<ReplayEvent> &getEvents() const { return _events; }
+};
+
+// Sets one of the level detection parameters using the same names as in the
+// configuration file. Returns false if the key is not known.
+bool applyReplaySetting(const char *key, const char *value);
+
+// Returns true if the file is a binary dataset (.kds)
+bool isReplayDataset(const char *file);
+
+// Reads a CSV file with the columns time,scale1,scale2,temp (same format as
+// the output of raw/export.py). Time can be ISO 8601 or milliseconds, if it is
+// missing the interval is used. Files with one value per line are read as
+// scale 1 only.
+bool loadReplayCsv(const char *file, uint32_t interval,
+                   std::vector<DatasetRecord> &records);
+
+// Reads a binary dataset or a CSV file into memory.
+bool loadReplayFile(const char *file, uint32_t interval,
+                    std::vector<DatasetRecord> &records);
+
+// Uses the dataset that is compiled into the simulator (raw/simulated.hpp).
+void loadReplayBuiltin(uint32_t interval, std::vector<DatasetRecord> &records);
+
+#endif  // NATIVE_REPLAY_HPP_
+
+// EOF
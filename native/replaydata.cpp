@@ -0,0 +1,181 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <time.h>
+
+#include <replay.hpp>
+
+#include "../raw/simulated.hpp"
+
+bool applyReplaySetting(const char *key, const char *value) {
+  String k = key;
+  float f = atof(value);
+
+  if (k.equals(PARAM_SCALE_DEVIATION_INCREASE))
+    myConfig.setScaleDeviationIncreaseValue(f);
+  else if (k.equals(PARAM_SCALE_DEVIATION_DECREASE))
+    myConfig.setScaleDeviationDecreaseValue(f);
+  else if (k.equals(PARAM_SCALE_DEVIATION_KALMAN))
+    myConfig.setScaleKalmanDeviationValue(f);
+  else if (k.equals(PARAM_SCALE_STABLE_COUNT))
+    myConfig.setScaleStableCount(atoi(value));
+  else if (k.equals(PARAM_SCALE_RAW_WINDOW))
+    myConfig.setScaleRawWindow(atoi(value));
+  else if (k.equals(PARAM_SCALE_OUTLIER_LIMIT))
+    myConfig.setScaleOutlierLimit(f);
+  else if (k.equals(PARAM_LEVEL_DETECTION))
+    myConfig.setLevelDetection(atoi(value));
+  else if (k.equals(PARAM_KALMAN_MEASUREMENT))
+    myConfig.setKalmanMeasurement(f);
+  else if (k.equals(PARAM_KALMAN_ESTIMATION))
+    myConfig.setKalmanEstimation(f);
+  else if (k.equals(PARAM_KALMAN_NOISE))
+    myConfig.setKalmanNoise(f);
+  else if (k.equals(PARAM_KALMAN_ACTIVE))
+    myConfig.setKalmanActive(f != 0);
+  else if (k.equals(PARAM_KALMAN_ADAPTIVE))
+    myConfig.setKalmanAdaptive(f != 0);
+  else if (k.equals(PARAM_SCALE_TEMP_FORMULA1))
+    myConfig.setScaleTempCompensationFormula(UnitIndex::U1, value);
+  else if (k.equals(PARAM_SCALE_TEMP_FORMULA2))
+    myConfig.setScaleTempCompensationFormula(UnitIndex::U2, value);
+  else if (k.equals(PARAM_KEG_WEIGHT1))
+    myConfig.setKegWeight(UnitIndex::U1, f);
+  else if (k.equals(PARAM_KEG_WEIGHT2))
+    myConfig.setKegWeight(UnitIndex::U2, f);
+  else
+    return false;
+
+  return true;
+}
+
+bool isReplayDataset(const char *file) {
+  FILE *f = fopen(file, "rb");
+  char magic[4] = {0};
+
+  if (!f) return false;
+  size_t n = fread(&magic[0], 1, sizeof(magic), f);
+  fclose(f);
+  return n == sizeof(magic) && !strncmp(&magic[0], DATASET_MAGIC, 4);
+}
+
+static bool parseTime(const char *s, double &t) {
+  int y, mo, d, h, mi;
+  double sec;
+
+  if (sscanf(s, "%d-%d-%d%*c%d:%d:%lf", &y, &mo, &d, &h, &mi, &sec) == 6) {
+    struct tm tm = {};
+    tm.tm_year = y - 1900;
+    tm.tm_mon = mo - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = h;
+    tm.tm_min = mi;
+    t = static_cast<double>(timegm(&tm)) * 1000.0 + sec * 1000.0;
+    return true;
+  }
+
+  char *end;
+  t = strtod(s, &end);
+  return end != s;
+}
+
+bool loadReplayCsv(const char *file, uint32_t interval,
+                   std::vector<DatasetRecord> &records) {
+  FILE *f = fopen(file, "r");
+
+  if (!f) {
+    fprintf(stderr, "Failed to open %s\n", file);
+    return false;
+  }
+
+  char line[200];
+  double first = NAN;
+  uint32_t n = 0;
+
+  while (fgets(&line[0], sizeof(line), f)) {
+    char *fields[4];
+    int cnt = 0;
+
+    for (char *p = strtok(&line[0], ",\r\n"); p && cnt < 4;
+         p = strtok(nullptr, ",\r\n"))
+      fields[cnt++] = p;
+
+    char *end;
+    DatasetRecord r;
+
+    // One value per line is a single scale without time or temperature, this
+    // is the format of the captures in raw/run1 and raw/run2.
+    if (cnt == 1) {
+      r.scale1 = strtof(fields[0], &end);
+      if (end == fields[0]) continue;
+      r.scale2 = NAN;
+      r.temp = NAN;
+      r.time = n++ * interval;
+      records.push_back(r);
+      continue;
+    }
+
+    if (cnt < 4) continue;
+
+    r.scale1 = strtof(fields[1], &end);
+    if (end == fields[1]) continue;  // Header line
+    r.scale2 = strtof(fields[2], nullptr);
+    r.temp = strtof(fields[3], nullptr);
+
+    double t;
+    if (parseTime(fields[0], t)) {
+      if (isnan(first)) first = t;
+      r.time = static_cast<uint32_t>(t - first);
+    } else {
+      r.time = n * interval;
+    }
+
+    records.push_back(r);
+    n++;
+  }
+
+  fclose(f);
+  return true;
+}
+
+bool loadReplayFile(const char *file, uint32_t interval,
+                    std::vector<DatasetRecord> &records) {
+  if (!isReplayDataset(file)) return loadReplayCsv(file, interval, records);
+
+  DatasetReader reader;
+  DatasetRecord r;
+
+  if (!reader.open(file)) return false;
+  records.reserve(records.size() + reader.count());
+  while (reader.next(r)) records.push_back(r);
+  return true;
+}
+
+void loadReplayBuiltin(uint32_t interval, std::vector<DatasetRecord> &records) {
+  for (uint32_t i = 0; simulatedData[i].scale1 > 0.0; i++) {
+    records.push_back({i * interval, simulatedData[i].scale1,
+                       simulatedData[i].scale2, simulatedData[i].temp});
+  }
+}
+
+// EOF
@@ -0,0 +1,528 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <replay.hpp>
+
+// Parameter sweep for the level detection. Every combination of settings is
+// replayed over the recorded datasets and scored against labeled pours, the
+// Pareto-best settings are printed as CSV on stdout.
+//
+// The configuration and level detection are global objects so each run
+// (settings x dataset) is done in a forked process, this gives every run a
+// clean state and uses all cores. Results are returned in shared memory.
+//
+// Build with: pio run -e kegmon-tune
+// Run with: .pio/build/kegmon-tune/program [options] dataset...
+
+KegConfig myConfig(CFG_MDNSNAME, CFG_FILENAME);
+LevelDetection myLevelDetection;
+
+struct TuneParam {
+  String key;
+  float min = 0;
+  float max = 0;
+  float step = 0;
+  std::vector<float> values;
+};
+
+struct TuneLabel {
+  uint32_t time;
+  UnitIndex idx;
+  float pour;
+};
+
+struct TuneDataset {
+  String file;
+  std::vector<DatasetRecord> records;
+  std::vector<TuneLabel> labels;
+};
+
+// Written by the child process, one per settings x dataset.
+struct TuneResult {
+  uint32_t done;
+  uint32_t matched;
+  uint32_t missed;
+  uint32_t falsePour;
+  double timeToStable;  // Sum of seconds from labeled pour to stable value
+  double pourError;     // Sum of absolute pour weight error (kg)
+};
+
+// Totals for one set of settings over all datasets.
+struct TuneScore {
+  size_t config;
+  uint32_t matched = 0;
+  uint32_t missed = 0;
+  uint32_t falsePour = 0;
+  double timeToStable = 0;
+  double pourError = 0;
+
+  uint32_t errors() const { return missed + falsePour; }
+  double averageTimeToStable() const {
+    return (matched + missed) ? timeToStable / (matched + missed) : 0;
+  }
+  double averagePourError() const { return matched ? pourError / matched : 0; }
+
+  // Objectives are detection errors and time to stable, the pour weight error
+  // is only used to choose between settings with the same objectives.
+  bool dominates(const TuneScore &o) const {
+    return errors() <= o.errors() &&
+           averageTimeToStable() <= o.averageTimeToStable();
+  }
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] dataset...\n"
+          "  -p <key=min:max:step> Parameter to sweep, can be repeated\n"
+          "  -p <key=min:max>      Continuous range (random search only)\n"
+          "  -p <key=v1,v2,..>     Parameter with a list of values\n"
+          "  -n <count>            Random search with count samples instead "
+          "of a grid\n"
+          "  -S <seed>             Seed for the random search (default 1)\n"
+          "  -j <jobs>             Parallel processes (default all cores)\n"
+          "  -w <seconds>          Max time between labeled and detected pour "
+          "(default 120)\n"
+          "  -t <tap>              Only run tap 1 or 2 (default both)\n"
+          "  -x                    Swap scale1 and scale2 columns\n"
+          "  -i <ms>               Sample interval when the data has no time "
+          "(default 2000)\n"
+          "  -s <key=value>        Fixed configuration setting\n"
+          "  -o <file.csv>         Write the score of every run to a file\n"
+          "Datasets are .kds or .csv files, the labeled pours are read from "
+          "<dataset>.labels.csv\n"
+          "in the same format as the output of the replay tool (only pour "
+          "rows are used).\n",
+          name);
+}
+
+static bool parseParam(const char *arg, TuneParam &param) {
+  String s = arg;
+  size_t p = s.find('=');
+
+  if (p == std::string::npos) return false;
+
+  param.key = s.substr(0, p).c_str();
+  String v = s.substr(p + 1).c_str();
+
+  if (v.find(':') != std::string::npos) {
+    int n = sscanf(v.c_str(), "%f:%f:%f", &param.min, &param.max, &param.step);
+
+    if (n < 2 || param.step < 0 || param.max < param.min) return false;
+
+    // Without a step the range is only usable for a random search.
+    for (int i = 0; param.step > 0; i++) {
+      float f = param.min + i * param.step;
+      if (f > param.max + param.step * 0.001) break;
+      param.values.push_back(f);
+    }
+  } else {
+    for (char *t = strtok(&v[0], ","); t; t = strtok(nullptr, ","))
+      param.values.push_back(atof(t));
+
+    if (param.values.empty()) return false;
+    param.min = *std::min_element(param.values.begin(), param.values.end());
+    param.max = *std::max_element(param.values.begin(), param.values.end());
+  }
+
+  // Also validates the key, all parameters are set again for every run.
+  char buf[30];
+  snprintf(&buf[0], sizeof(buf), "%g", param.min);
+  return applyReplaySetting(param.key.c_str(), &buf[0]);
+}
+
+static bool loadLabels(TuneDataset &ds) {
+  String file = ds.file;
+  size_t p = file.rfind('.');
+
+  if (p != std::string::npos && file.find('/', p) == std::string::npos)
+    file = file.substr(0, p).c_str();
+  file += ".labels.csv";
+
+  FILE *f = fopen(file.c_str(), "r");
+
+  if (!f) {
+    fprintf(stderr, "Failed to open %s\n", file.c_str());
+    return false;
+  }
+
+  char line[200];
+
+  while (fgets(&line[0], sizeof(line), f)) {
+    unsigned time;
+    int tap;
+    char event[20];
+    float stable, pour;
+
+    if (sscanf(&line[0], "%u,%d,%19[^,],%f,%f", &time, &tap, &event[0],
+               &stable, &pour) != 5)
+      continue;  // Header line
+    if (strcmp(&event[0], "pour") || tap < 1 || tap > 2) continue;
+
+    ds.labels.push_back({time, static_cast<UnitIndex>(tap - 1), pour});
+  }
+
+  fclose(f);
+  return true;
+}
+
+static void generateGrid(const std::vector<TuneParam> &params,
+                         std::vector<std::vector<float>> &configs) {
+  std::vector<size_t> pos(params.size(), 0);
+
+  while (true) {
+    std::vector<float> c;
+    for (size_t i = 0; i < params.size(); i++)
+      c.push_back(params[i].values[pos[i]]);
+    configs.push_back(c);
+
+    size_t i = 0;
+    for (; i < params.size(); i++) {
+      if (++pos[i] < params[i].values.size()) break;
+      pos[i] = 0;
+    }
+    if (i == params.size()) break;
+  }
+}
+
+static void generateRandom(const std::vector<TuneParam> &params, int count,
+                           unsigned seed,
+                           std::vector<std::vector<float>> &configs) {
+  std::mt19937 rng(seed);
+
+  for (int n = 0; n < count; n++) {
+    std::vector<float> c;
+
+    for (const TuneParam &p : params) {
+      if (p.values.empty()) {
+        std::uniform_real_distribution<float> dist(p.min, p.max);
+        c.push_back(dist(rng));
+      } else if (p.step > 0) {
+        std::uniform_real_distribution<float> dist(p.min, p.max);
+        float f = p.min + roundf((dist(rng) - p.min) / p.step) * p.step;
+        c.push_back(std::min(f, p.max));
+      } else {
+        std::uniform_int_distribution<size_t> dist(0, p.values.size() - 1);
+        c.push_back(p.values[dist(rng)]);
+      }
+    }
+
+    configs.push_back(c);
+  }
+}
+
+// Runs in the forked process.
+static void runJob(const std::vector<TuneParam> &params,
+                   const std::vector<float> &config, const TuneDataset &ds,
+                   bool tap1, bool tap2, bool swap, uint32_t window,
+                   TuneResult *res) {
+  char buf[30];
+
+  for (size_t i = 0; i < params.size(); i++) {
+    snprintf(&buf[0], sizeof(buf), "%g", config[i]);
+    applyReplaySetting(params[i].key.c_str(), &buf[0]);
+  }
+
+  ReplayEngine engine;
+  engine.setTaps(tap1, tap2, swap);
+  for (const DatasetRecord &r : ds.records) engine.process(r);
+
+  const std::vector<ReplayEvent> &events = engine.getEvents();
+  std::vector<bool> used(events.size(), false);
+  uint32_t end = ds.records.size() ? ds.records.back().time : 0;
+
+  for (const TuneLabel &l : ds.labels) {
+    int best = -1;
+    uint32_t bestDiff = window + 1;
+
+    for (size_t i = 0; i < events.size(); i++) {
+      const ReplayEvent &e = events[i];
+      if (e.type != ReplayEventType::ReplayPour || e.idx != l.idx || used[i])
+        continue;
+
+      uint32_t diff = e.time > l.time ? e.time - l.time : l.time - e.time;
+      if (diff < bestDiff) {
+        best = i;
+        bestDiff = diff;
+      }
+    }
+
+    if (best >= 0) {
+      used[best] = true;
+      res->matched++;
+      res->pourError += fabs(events[best].pour - l.pour);
+    } else {
+      res->missed++;
+    }
+
+    // A label without a following stable value gets the rest of the dataset.
+    uint32_t stable = end;
+    for (const ReplayEvent &e : events) {
+      if (e.type == ReplayEventType::ReplayStable && e.idx == l.idx &&
+          e.time >= l.time) {
+        stable = e.time;
+        break;
+      }
+    }
+    res->timeToStable += (stable - l.time) / 1000.0;
+  }
+
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].type == ReplayEventType::ReplayPour && !used[i])
+      res->falsePour++;
+  }
+
+  res->done = 1;
+}
+
+static void writeScore(FILE *f, const std::vector<TuneParam> &params,
+                       const std::vector<float> &config, const TuneScore &s) {
+  for (size_t i = 0; i < params.size(); i++) fprintf(f, "%g,", config[i]);
+  fprintf(f, "%u,%u,%u,%.1f,%.3f\n", s.matched, s.missed, s.falsePour,
+          s.averageTimeToStable(), s.averagePourError());
+}
+
+static void writeHeader(FILE *f, const std::vector<TuneParam> &params) {
+  for (const TuneParam &p : params) fprintf(f, "%s,", p.key.c_str());
+  fprintf(f, "matched,missed,false,time_to_stable,pour_error\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t interval = 2000;
+  uint32_t window = 120;
+  int tap = 0;
+  bool swap = false;
+  int count = 0;
+  unsigned seed = 1;
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *output = 0;
+  std::vector<TuneParam> params;
+  int opt;
+
+  Log.setLevel(LOG_LEVEL_WARNING);
+
+  while ((opt = getopt(argc, argv, "p:n:S:j:w:t:xi:s:o:h")) != -1) {
+    switch (opt) {
+      case 'p': {
+        TuneParam p;
+        if (!parseParam(optarg, p)) {
+          fprintf(stderr, "Invalid parameter %s\n", optarg);
+          return 1;
+        }
+        params.push_back(p);
+      } break;
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case 'S':
+        seed = atoi(optarg);
+        break;
+      case 'j':
+        workers = atoi(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 't':
+        tap = atoi(optarg);
+        break;
+      case 'x':
+        swap = true;
+        break;
+      case 'i':
+        interval = atoi(optarg);
+        break;
+      case 's': {
+        String s = optarg;
+        size_t p = s.find('=');
+        if (p == std::string::npos ||
+            !applyReplaySetting(s.substr(0, p).c_str(),
+                                s.substr(p + 1).c_str())) {
+          fprintf(stderr, "Unknown setting %s\n", optarg);
+          return 1;
+        }
+      } break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (params.empty() || optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<TuneDataset> datasets(argc - optind);
+  size_t samples = 0;
+
+  for (size_t i = 0; i < datasets.size(); i++) {
+    datasets[i].file = argv[optind + i];
+    if (!loadReplayFile(datasets[i].file.c_str(), interval,
+                        datasets[i].records) ||
+        !loadLabels(datasets[i]))
+      return 1;
+    samples += datasets[i].records.size();
+  }
+
+  std::vector<std::vector<float>> configs;
+
+  if (count > 0) {
+    generateRandom(params, count, seed, configs);
+  } else {
+    for (const TuneParam &p : params) {
+      if (p.values.empty()) {
+        fprintf(stderr, "Parameter %s needs a step for a grid search\n",
+                p.key.c_str());
+        return 1;
+      }
+    }
+    generateGrid(params, configs);
+  }
+
+  size_t jobs = configs.size() * datasets.size();
+  TuneResult *results = static_cast<TuneResult *>(
+      mmap(nullptr, sizeof(TuneResult) * jobs, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+  if (results == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  fprintf(stderr,
+          "Running %zu settings over %zu datasets using %d processes.\n",
+          configs.size(), datasets.size(), workers);
+  fflush(stdout);
+
+  auto start = std::chrono::steady_clock::now();
+  size_t next = 0, finished = 0;
+  int running = 0;
+
+  while (finished < jobs) {
+    if (next < jobs && running < workers) {
+      pid_t pid = fork();
+
+      if (pid == 0) {
+        runJob(params, configs[next / datasets.size()],
+               datasets[next % datasets.size()], tap != 2, tap != 1, swap,
+               window * 1000, &results[next]);
+        _exit(0);
+      } else if (pid > 0) {
+        running++;
+        next++;
+        continue;
+      }
+
+      perror("fork");
+      if (!running) return 1;
+    }
+
+    if (wait(nullptr) > 0) {
+      running--;
+      finished++;
+      if (finished % 100 == 0 || finished == jobs)
+        fprintf(stderr, "%zu/%zu\r", finished, jobs);
+    }
+  }
+
+  fprintf(stderr, "\n");
+  auto end = std::chrono::steady_clock::now();
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::vector<TuneScore> scores(configs.size());
+  size_t failed = 0;
+
+  for (size_t i = 0; i < jobs; i++) {
+    TuneScore &s = scores[i / datasets.size()];
+    const TuneResult &r = results[i];
+
+    s.config = i / datasets.size();
+    if (!r.done) failed++;
+    s.matched += r.matched;
+    s.missed += r.missed;
+    s.falsePour += r.falsePour;
+    s.timeToStable += r.timeToStable;
+    s.pourError += r.pourError;
+  }
+
+  munmap(results, sizeof(TuneResult) * jobs);
+
+  if (output) {
+    FILE *f = fopen(output, "w");
+    if (f) {
+      writeHeader(f, params);
+      for (const TuneScore &s : scores)
+        writeScore(f, params, configs[s.config], s);
+      fclose(f);
+    } else {
+      fprintf(stderr, "Failed to create %s\n", output);
+    }
+  }
+
+  // After sorting a setting can only be dominated by one that comes before it,
+  // so it is enough to compare against the current front. Settings with the
+  // same objectives as one on the front are left out.
+  std::sort(scores.begin(), scores.end(),
+            [](const TuneScore &a, const TuneScore &b) {
+              if (a.errors() != b.errors()) return a.errors() < b.errors();
+              if (a.averageTimeToStable() != b.averageTimeToStable())
+                return a.averageTimeToStable() < b.averageTimeToStable();
+              return a.averagePourError() < b.averagePourError();
+            });
+
+  std::vector<TuneScore> front;
+
+  for (const TuneScore &s : scores) {
+    bool dominated = false;
+    for (const TuneScore &f : front) {
+      if (f.dominates(s)) {
+        dominated = true;
+        break;
+      }
+    }
+    if (!dominated) front.push_back(s);
+  }
+
+  writeHeader(stdout, params);
+  for (const TuneScore &s : front)
+    writeScore(stdout, params, configs[s.config], s);
+
+  fprintf(stderr,
+          "Completed %zu runs (%.0f M samples) in %.1f s, %zu failed, %zu "
+          "settings on the Pareto front.\n",
+          jobs, static_cast<double>(samples) * configs.size() / 1e6, sec,
+          failed, front.size());
+  return failed ? 1 : 0;
+}
+
+// EOF
@@ -0,0 +1,42 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef NATIVE_UTILS_HPP_
+#define NATIVE_UTILS_HPP_
+
+// Host replacement for the conversion helpers in espframework utils.hpp.
+
+inline float convertCtoF(float c) { return (c * 1.8) + 32.0; }
+inline float convertFtoC(float f) { return (f - 32.0) / 1.8; }
+inline float convertKGtoLBS(float kg) { return kg * 2.20462; }
+inline float convertLBStoKG(float lbs) { return lbs / 2.20462; }
+inline float convertCLtoUSOZ(float cl) { return cl * 0.33814; }
+inline float convertCLtoUKOZ(float cl) { return cl * 0.35195; }
+inline float convertUSOZtoCL(float usoz) { return usoz / 0.33814; }
+inline float convertUKOZtoCL(float ukoz) { return ukoz / 0.35195; }
+
+inline void printHeap(const char *) {}
+
+#endif  // NATIVE_UTILS_HPP_
+
+// EOF
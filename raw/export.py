@@ -1,6 +1,7 @@
 # Install influx client library for python
 # pip install influxdb-client
 
+import struct
 import influxdb_client
 from influxdb_client.client.write_api import SYNCHRONOUS
 
@@ -10,6 +11,8 @@ token = ""
 url=""
 cppOutName = "simulated.hpp"
 csvOutName = "simulated.csv"
+kdsOutName = "simulated.kds" # Binary dataset, upload to the device filesystem
+kdsInterval = 2000 # Sample interval (ms) stored in the dataset
 interval = 0 # Will skip this amount of values, needed if the data is too much for the arduino
 
 if __name__ == "__main__":
@@ -26,6 +29,12 @@ if __name__ == "__main__":
     csvOut = open( csvOutName, "w")
     csvOut.write("time,level-raw1,level-raw2,tempC\n")
 
+    # Header is magic, version, record size, interval and count (patched at the end)
+    kdsOut = open( kdsOutName, "wb")
+    kdsOut.write(struct.pack("<4sHHII", b"KGDS", 1, 16, kdsInterval, 0))
+    kdsCount = 0
+    kdsStart = None
+
     # change the query to include your device id and time-frame
     query = 'from(bucket: "keezer")\
         |> range(start: -3h)\
@@ -45,6 +54,11 @@ if __name__ == "__main__":
             if record.values.get("tempC") != None: # Ignore values without temp data
                 if cnt >= interval:
                     cppOut.write("{ " + str(record.values.get("level-raw1")) + ", " + str(record.values.get("level-raw2")) + ", " + str(record.values.get("tempC")) + " },\n")
+                    if kdsStart == None:
+                        kdsStart = record.get_time()
+                    ms = int((record.get_time() - kdsStart).total_seconds() * 1000)
+                    kdsOut.write(struct.pack("<Ifff", ms, record.values.get("level-raw1"), record.values.get("level-raw2"), record.values.get("tempC")))
+                    kdsCount += 1
                     csvOut.write(record.get_time().isoformat() + "," + str(record.values.get("level-raw1")) + "," + str(record.values.get("level-raw2")) + "," + str(record.values.get("tempC")) + "\n")
                     cnt = 0
                     print(".", end="\r")
@@ -59,3 +73,7 @@ if __name__ == "__main__":
     cppOut.close()
 
     csvOut.close()
+
+    kdsOut.seek(12)
+    kdsOut.write(struct.pack("<I", kdsCount))
+    kdsOut.close()
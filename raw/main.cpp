@@ -21,16 +21,17 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
+#include <dataset.hpp>
 #include <display.hpp>
 #include <kegconfig.hpp>
 #include <kegpush.hpp>
 #include <main.hpp>
 #include <ota.hpp>
 #include <scale.hpp>
+#include <scheduler.hpp>
 #include <temp_mgr.hpp>
 #include <utils.hpp>
 #include <wificonnection.hpp>
-#include "simulated.hpp"
 
 SerialDebug mySerial(115200L);
 KegConfig myConfig(CFG_MDNSNAME, CFG_FILENAME);
@@ -40,6 +41,14 @@ KegPushHandler myPush(&myConfig);
 Display myDisplay;
 TempSensorManager myTemp;
 LevelDetection myLevelDetection;
+DatasetReader myDataset;
+Scheduler myScheduler;
+
+// Recorded data is streamed from the filesystem, create the file with the
+// replay tool (-o simulated.kds) or export.py and upload it to the device.
+constexpr auto SIMULATED_FILE = "/simulated.kds";
+
+void setupTasks();
 
 void setup() {
   Log.notice(F("Level detection simulator" CR));
@@ -88,24 +97,27 @@ void setup() {
   // Change setting for the simulation
   Log.notice(F("SETUP: Max deviation increase %F" CR), myConfig.getScaleDeviationIncreaseValue());
   Log.notice(F("SETUP: Max deviation decrease %F" CR), myConfig.getScaleDeviationDecreaseValue());
+
+  if (!myDataset.open(SIMULATED_FILE))
+    Log.error(F("SETUP: Unable to open dataset %s." CR), SIMULATED_FILE);
+
+  setupTasks();
 }
 
-int simulatedIndex = 0;
 // int simulatedDelay = 1000;
 // int simulatedDelay = 500;
 // int simulatedDelay = 200;
 int simulatedDelay = 100;
 // int simulatedDelay = 50;
 
-void loop() {
-  if (!myWifi.isConnected()) myWifi.connect();
-
-  myWifi.loop();
+void simulateTask() {
+  static bool done = false;
+  DatasetRecord r;
 
-  if (simulatedData[simulatedIndex].scale1 > 0.0) {
-    float t = simulatedData[simulatedIndex].temp; 
-    // float v = simulatedData[simulatedIndex].scale1; 
-    float v = simulatedData[simulatedIndex].scale2; 
+  if (myDataset.next(r)) {
+    float t = r.temp;
+    // float v = r.scale1;
+    float v = r.scale2;
 
     myLevelDetection.update(UnitIndex::U1, v, t);
 
@@ -114,7 +126,7 @@ void loop() {
           ",pour1=%F [%d]" CR), v,
         myLevelDetection.getRawDetection(UnitIndex::U1)->getRawValue(),
         myLevelDetection.getStatsDetection(UnitIndex::U1)->getStableValue(),
-        myLevelDetection.getStatsDetection(UnitIndex::U1)->getPourValue(), simulatedIndex);
+        myLevelDetection.getStatsDetection(UnitIndex::U1)->getPourValue(), myDataset.index());
     Serial.print(".");
 
 #if defined(ENABLE_INFLUX_DEBUG)
@@ -192,16 +204,28 @@ void loop() {
                          PUSH_INFLUX_BUCKET, PUSH_INFLUX_TOKEN);
     Log.setLevel(LOG_LEVEL);
 #endif  // ENABLE_INFLUX_DEBUG
-
-    simulatedIndex++;
-    delay(simulatedDelay);
-  } else {
+  } else if (!done) {
+    done = true;
     myDisplay.clear(UnitIndex::U1);
     myDisplay.setFont(UnitIndex::U1, FontSize::FONT_10);
     myDisplay.printLineCentered(UnitIndex::U1, 0, "Done");
     myDisplay.show(UnitIndex::U1);
-    delay(1000);
+    myScheduler.logStatistics();
   }
 }
 
+// One record is fed to the level detection for each period, the wifi is
+// handled in between instead of blocking in delay().
+void setupTasks() {
+  myScheduler.add("simulate", simulateTask, simulatedDelay, simulatedDelay, 0);
+}
+
+void loop() {
+  if (!myWifi.isConnected()) myWifi.connect();
+
+  myWifi.loop();
+  myPush.loop();
+  myScheduler.loop();
+}
+
 // EOF
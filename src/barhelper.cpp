@@ -165,6 +165,10 @@ void Barhelper::sendKegInformation(UnitIndex idx, float kegVol) {
 void Barhelper::updateStatus(String& response) {
   _lastTimestamp = millis();
   _lastStatus = _push->wasLastSuccessful();
+  if (_lastStatus)
+    _delivered++;
+  else
+    _failed++;
   _lastHttpError = _push->getLastResponseCode();
   _lastResponse = response;
   _hasRun = true;
@@ -92,6 +92,10 @@ void BrewLogger::sendKegInformation(UnitIndex idx, float kegVol) {
 void BrewLogger::updateStatus(String& response) {
   _lastTimestamp = millis();
   _lastStatus = _push->wasLastSuccessful();
+  if (_lastStatus)
+    _delivered++;
+  else
+    _failed++;
   _lastHttpError = _push->getLastResponseCode();
   _lastResponse = response;
   _hasRun = true;
@@ -32,6 +32,8 @@ class BrewLogger {
   BasePush *_push;
 
   bool _hasRun = false;
+  uint32_t _delivered = 0;
+  uint32_t _failed = 0;
   uint32_t _lastTimestamp = 0;
   bool _lastStatus = false;
   int _lastHttpError = 0;
@@ -46,6 +48,8 @@ class BrewLogger {
   void sendKegInformation(UnitIndex idx, float kegVol);
 
   bool hasRun() { return _hasRun; }
+  uint32_t getDelivered() { return _delivered; }
+  uint32_t getFailed() { return _failed; }
   uint32_t getLastTimeStamp() { return _lastTimestamp; }
   bool getLastStatus() { return _lastStatus; }
   int getLastError() { return _lastHttpError; }
@@ -183,6 +183,10 @@ void Brewspy::getTapInformation(JsonObject& obj, const String token) {
 void Brewspy::updateStatus(String& response) {
   _lastTimestamp = millis();
   _lastStatus = _push->wasLastSuccessful();
+  if (_lastStatus)
+    _delivered++;
+  else
+    _failed++;
   _lastHttpError = _push->getLastResponseCode();
   _lastResponse = response;
   _hasRun = true;
@@ -0,0 +1,176 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CALIBRATION_HPP_
+#define SRC_CALIBRATION_HPP_
+
+#include <Arduino.h>
+
+constexpr auto CALIBRATION_TIMEOUT = 2000;  // ms without a conversion
+constexpr auto CALIBRATION_POINTS_MAX = 8;  // Points per scale
+
+enum CalibrationState {
+  CALIBRATION_IDLE = 0,
+  CALIBRATION_TARE = 1,    // Collecting conversions for the offset
+  CALIBRATION_FACTOR = 2,  // Collecting conversions for the factor
+  CALIBRATION_DONE = 3,
+  CALIBRATION_FAILED = 4,
+  CALIBRATION_POINT = 5,  // Collecting conversions for a calibration point
+  CALIBRATION_CLEAR = 6   // Request to remove the calibration points
+};
+
+// Known weight and the conversion above the offset (tare) for that weight
+struct CalibrationPoint {
+  float counts;
+  float weight;
+};
+
+// Piecewise linear conversion from counts above the offset to kg. The tare is
+// always the first point (0, 0) so a single point gives the same result as a
+// scale factor. The segments are sorted and the slopes calculated when the
+// points are set, a conversion is a binary search and one multiplication.
+class CalibrationTable {
+ private:
+  float _counts[CALIBRATION_POINTS_MAX + 1];
+  float _weight[CALIBRATION_POINTS_MAX + 1];
+  float _slope[CALIBRATION_POINTS_MAX];
+  int _size = 0;  // Including the tare point
+
+ public:
+  void clear() { _size = 0; }
+
+  void set(const CalibrationPoint* points, int count) {
+    _counts[0] = 0;
+    _weight[0] = 0;
+    _size = 1;
+
+    for (int i = 0; i < count && i < CALIBRATION_POINTS_MAX; i++) {
+      float c = points[i].counts, w = points[i].weight;
+      int j = _size;
+
+      if (isnan(c) || isnan(w)) continue;
+
+      // Insertion sort on counts, points with the same counts are skipped
+      while (j > 0 && _counts[j - 1] > c) {
+        _counts[j] = _counts[j - 1];
+        _weight[j] = _weight[j - 1];
+        j--;
+      }
+      if (j > 0 && _counts[j - 1] == c) {
+        for (; j < _size; j++) {
+          _counts[j] = _counts[j + 1];
+          _weight[j] = _weight[j + 1];
+        }
+        continue;
+      }
+      _counts[j] = c;
+      _weight[j] = w;
+      _size++;
+    }
+
+    for (int i = 0; i < _size - 1; i++)
+      _slope[i] = (_weight[i + 1] - _weight[i]) / (_counts[i + 1] - _counts[i]);
+
+    if (_size < 2) _size = 0;
+  }
+
+  // Number of segments, 0 when the table is not used
+  int size() const { return _size ? _size - 1 : 0; }
+
+  // Values outside the points use the slope of the first or last segment
+  float convert(float counts) const {
+    if (!_size) return NAN;
+
+    int lo = 0, hi = _size - 2;
+
+    while (lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+      if (_counts[mid] <= counts)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+
+    return _weight[lo] + (counts - _counts[lo]) * _slope[lo];
+  }
+};
+
+// Tare and factor calibration that sums the conversions delivered by the
+// driver over many loop iterations, so nothing waits for the ADC.
+class ScaleCalibration {
+ private:
+  CalibrationState _state = CalibrationState::CALIBRATION_IDLE;
+  float _weight = 0;
+  int64_t _sum = 0;
+  int _count = 0;
+  int _target = 0;
+  uint32_t _last = 0;  // Time of the last conversion
+
+ public:
+  // Only called from the task that reads the scale (Scale::loop), requests
+  // from the web are handed over by Scale.
+  void start(CalibrationState state, int target, float weight, uint32_t now) {
+    _weight = weight;
+    _sum = 0;
+    _count = 0;
+    _target = target < 1 ? 1 : target;
+    _last = now;
+    _state = state;
+  }
+
+  void add(int32_t raw, uint32_t now) {
+    if (!isRunning() || isComplete()) return;
+
+    _sum += raw;
+    _count++;
+    _last = now;
+  }
+
+  void finish(bool success) {
+    _state = success ? CalibrationState::CALIBRATION_DONE
+                     : CalibrationState::CALIBRATION_FAILED;
+  }
+
+  static bool isRunning(int state) {
+    return state == CalibrationState::CALIBRATION_TARE ||
+           state == CalibrationState::CALIBRATION_FACTOR ||
+           state == CalibrationState::CALIBRATION_POINT;
+  }
+  bool isRunning() const { return isRunning(_state); }
+  bool isComplete() const { return _count >= _target; }
+  bool isTimeout(uint32_t now) const {
+    return now - _last > CALIBRATION_TIMEOUT;
+  }
+
+  CalibrationState getState() const { return _state; }
+  float getWeight() const { return _weight; }
+  int32_t average() const { return _count ? _sum / _count : 0; }
+  int progress() const {
+    if (_state == CalibrationState::CALIBRATION_DONE) return 100;
+    return _target ? _count * 100 / _target : 0;
+  }
+};
+
+#endif  // SRC_CALIBRATION_HPP_
+
+// EOF
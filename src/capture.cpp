@@ -0,0 +1,103 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <capture.hpp>
+#include <log.hpp>
+
+void RawCapture::setup() {
+  if (_buf) return;
+
+#if !defined(ESP8266) && !defined(KEGMON_NATIVE)
+  if (psramFound()) {
+    _buf = static_cast<CaptureRecord*>(
+        ps_malloc(CAPTURE_RECORDS_PSRAM * sizeof(CaptureRecord)));
+    if (_buf) _capacity = CAPTURE_RECORDS_PSRAM;
+  }
+#endif
+
+  if (!_buf) {
+    _buf = static_cast<CaptureRecord*>(
+        malloc(CAPTURE_RECORDS * sizeof(CaptureRecord)));
+    if (_buf) _capacity = CAPTURE_RECORDS;
+  }
+
+  if (!_buf) {
+    Log.error(F("CAPT: Unable to allocate capture buffer." CR));
+    return;
+  }
+
+  Log.notice(F("CAPT: Capture buffer for %d conversions." CR), _capacity);
+}
+
+bool RawCapture::start(uint32_t seconds) {
+  if (!_buf || !seconds || seconds > CAPTURE_SECONDS_MAX || isReading())
+    return false;
+
+  Log.notice(F("CAPT: Capturing conversions for %d seconds." CR), seconds);
+  stop();
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+  _duration = seconds * 1000000;
+  _start = micros();
+  _running.store(true, std::memory_order_release);  // Published last
+  return true;
+}
+
+size_t RawCapture::read(uint8_t* buffer, size_t maxLen, size_t index) const {
+  uint32_t head = _head.load(std::memory_order_acquire);
+  CaptureHeader header = {{'K', 'G', 'R', 'C'},
+                          CAPTURE_VERSION,
+                          sizeof(CaptureRecord),
+                          count(),
+                          dropped()};
+  uint32_t first =
+      _capacity ? (head + _capacity - header.count) % _capacity : 0;  // Oldest
+  size_t total = size(), len = 0;
+
+  while (len < maxLen && index < total) {
+    const uint8_t* src;
+    size_t pos, avail;
+
+    if (index < sizeof(CaptureHeader)) {
+      src = reinterpret_cast<const uint8_t*>(&header);
+      pos = index;
+      avail = sizeof(CaptureHeader) - pos;
+    } else {
+      size_t r = (index - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+      src = reinterpret_cast<const uint8_t*>(&_buf[(first + r) % _capacity]);
+      pos = (index - sizeof(CaptureHeader)) % sizeof(CaptureRecord);
+      avail = sizeof(CaptureRecord) - pos;
+    }
+
+    if (avail > maxLen - len) avail = maxLen - len;
+
+    memcpy(buffer + len, src + pos, avail);
+    len += avail;
+    index += avail;
+  }
+
+  return len;
+}
+
+// EOF
@@ -0,0 +1,136 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CAPTURE_HPP_
+#define SRC_CAPTURE_HPP_
+
+#include <Arduino.h>
+
+#include <main.hpp>
+
+#include <atomic>
+
+// Binary format of a capture (little endian, as on the device):
+// Header (16 bytes): magic "KGRC", version, record size, count, dropped.
+// Record (8 bytes): time (us since start, bit 31 is the scale), counts.
+constexpr auto CAPTURE_MAGIC = "KGRC";
+constexpr auto CAPTURE_VERSION = 1;
+constexpr uint32_t CAPTURE_SCALE_BIT = 0x80000000;
+constexpr auto CAPTURE_SECONDS_MAX = 600;  // Keeps the time below bit 31
+
+#if defined(ESP8266)
+constexpr auto CAPTURE_RECORDS = 512;  // 4 kB
+#else
+constexpr auto CAPTURE_RECORDS = 4096;            // 32 kB
+constexpr auto CAPTURE_RECORDS_PSRAM = 262144;  // 2 MB
+#endif
+
+struct CaptureHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t count;
+  uint32_t dropped;  // Oldest records overwritten when the buffer was full
+};
+
+struct CaptureRecord {
+  uint32_t time;
+  int32_t counts;
+};
+
+static_assert(sizeof(CaptureHeader) == 16, "Capture header must be 16 bytes");
+static_assert(sizeof(CaptureRecord) == 8, "Capture record must be 8 bytes");
+
+// Records every conversion from the scale driver for a number of seconds in a
+// ring buffer that is allocated once, so a capture never allocates memory and
+// only costs a copy per conversion. Conversions are added by the scale task
+// and the capture is started and downloaded from the web server.
+class RawCapture {
+ private:
+  CaptureRecord* _buf = 0;
+  uint32_t _capacity = 0;
+  std::atomic<uint32_t> _head{0};  // Next position to write, stored last
+  std::atomic<uint32_t> _count{0};
+  std::atomic<uint32_t> _dropped{0};
+  uint32_t _start = 0;     // us
+  uint32_t _duration = 0;  // us
+  std::atomic<bool> _running{false};
+  std::atomic<int> _readers{0};  // Downloads in progress
+
+  RawCapture(const RawCapture&) = delete;
+  void operator=(const RawCapture&) = delete;
+
+ public:
+  RawCapture() {}
+
+  void setup();
+  bool start(uint32_t seconds);
+  void stop() { _running.store(false, std::memory_order_release); }
+
+  void add(UnitIndex idx, int32_t counts) {
+    if (!_running.load(std::memory_order_acquire)) return;
+
+    uint32_t t = micros() - _start;
+
+    if (t >= _duration) {
+      stop();
+      return;
+    }
+
+    uint32_t head = _head.load(std::memory_order_relaxed);
+
+    _buf[head].time = idx == UnitIndex::U2 ? t | CAPTURE_SCALE_BIT : t;
+    _buf[head].counts = counts;
+
+    if (_count.load(std::memory_order_relaxed) < _capacity)
+      _count.fetch_add(1, std::memory_order_relaxed);
+    else
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+
+    _head.store((head + 1) % _capacity, std::memory_order_release);
+  }
+
+  bool isRunning() const {
+    return _running.load(std::memory_order_acquire) &&
+           micros() - _start < _duration;
+  }
+  uint32_t count() const { return _count.load(); }
+  uint32_t dropped() const { return _dropped.load(); }
+  uint32_t capacity() const { return _capacity; }
+
+  // A download is sized from the current capture, so a new capture can't be
+  // started until all downloads have ended.
+  void beginRead() { _readers++; }
+  void endRead() { _readers--; }
+  bool isReading() const { return _readers.load() > 0; }
+
+  // Size of the binary capture and a part of it starting at index
+  size_t size() const {
+    return sizeof(CaptureHeader) + count() * sizeof(CaptureRecord);
+  }
+  size_t read(uint8_t* buffer, size_t maxLen, size_t index) const;
+};
+
+#endif  // SRC_CAPTURE_HPP_
+
+// EOF
@@ -0,0 +1,210 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <dataset.hpp>
+#include <log.hpp>
+
+#if defined(KEGMON_NATIVE)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool DatasetReader::validateHeader(size_t fileSize) {
+  if (strncmp(&_header.magic[0], DATASET_MAGIC, 4) ||
+      _header.version != DATASET_VERSION ||
+      _header.recordSize != sizeof(DatasetRecord)) {
+    Log.error(F("DATA: Not a valid dataset file, version %d." CR),
+              _header.version);
+    return false;
+  }
+
+  // The file size is used so that captures that was not closed can be read,
+  // a file that is shorter than the header says is read to the last record.
+  uint32_t records = (fileSize - sizeof(DatasetHeader)) / sizeof(DatasetRecord);
+  _count = _header.count;
+
+  if (!_count || _count > records) {
+    if (_count)
+      Log.warning(F("DATA: Dataset has %d of %d records." CR), records, _count);
+    _count = records;
+  }
+
+  _index = 0;
+  Log.notice(F("DATA: Opened dataset with %d records." CR), _count);
+  return true;
+}
+
+#if defined(KEGMON_NATIVE)
+
+bool DatasetReader::open(const char *path) {
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    Log.error(F("DATA: Failed to open dataset %s." CR), path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(_header))) {
+    ::close(fd);
+    Log.error(F("DATA: Dataset %s is too small." CR), path);
+    return false;
+  }
+
+  void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    Log.error(F("DATA: Failed to map dataset %s." CR), path);
+    return false;
+  }
+
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+  _map = static_cast<const uint8_t *>(p);
+  _mapSize = st.st_size;
+  memcpy(&_header, _map, sizeof(_header));
+
+  if (!validateHeader(_mapSize)) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool DatasetReader::next(DatasetRecord &r) {
+  if (!_map || _index >= _count) return false;
+
+  memcpy(&r, _map + sizeof(DatasetHeader) + _index * sizeof(DatasetRecord),
+         sizeof(DatasetRecord));
+  _index++;
+  return true;
+}
+
+void DatasetReader::rewind() { _index = 0; }
+
+void DatasetReader::close() {
+  if (_map) munmap(const_cast<uint8_t *>(_map), _mapSize);
+  _map = 0;
+  _mapSize = 0;
+  _count = 0;
+  _index = 0;
+}
+
+bool DatasetReader::isOpen() const { return _map != 0; }
+
+bool DatasetWriter::open(const char *path, uint32_t interval) {
+  close();
+  _file = fopen(path, "wb");
+
+  if (!_file) {
+    Log.error(F("DATA: Failed to create dataset %s." CR), path);
+    return false;
+  }
+
+  memcpy(&_header.magic[0], DATASET_MAGIC, 4);
+  _header.version = DATASET_VERSION;
+  _header.recordSize = sizeof(DatasetRecord);
+  _header.interval = interval;
+  _header.count = 0;
+  return fwrite(&_header, sizeof(_header), 1, _file) == 1;
+}
+
+bool DatasetWriter::write(const DatasetRecord &r) {
+  if (!_file || fwrite(&r, sizeof(r), 1, _file) != 1) return false;
+  _header.count++;
+  return true;
+}
+
+void DatasetWriter::close() {
+  if (!_file) return;
+
+  // Update the header with the final number of records
+  fseek(_file, 0, SEEK_SET);
+  fwrite(&_header, sizeof(_header), 1, _file);
+  fclose(_file);
+  _file = 0;
+}
+
+#else
+
+bool DatasetReader::open(const char *path) {
+  close();
+  _file = LittleFS.open(path, "r");
+
+  if (!_file) {
+    Log.error(F("DATA: Failed to open dataset %s." CR), path);
+    return false;
+  }
+
+  if (_file.read(reinterpret_cast<uint8_t *>(&_header), sizeof(_header)) !=
+          sizeof(_header) ||
+      !validateHeader(_file.size())) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool DatasetReader::next(DatasetRecord &r) {
+  if (!_file || _index >= _count) return false;
+
+  if (_blockPos >= _blockLen) {
+    size_t n = _file.read(reinterpret_cast<uint8_t *>(&_block[0]),
+                          sizeof(_block)) /
+               sizeof(DatasetRecord);
+    _blockPos = 0;
+    _blockLen = n;
+    if (!n) return false;
+  }
+
+  r = _block[_blockPos++];
+  _index++;
+  return true;
+}
+
+void DatasetReader::rewind() {
+  if (!_file) return;
+
+  _file.seek(sizeof(DatasetHeader));
+  _index = 0;
+  _blockPos = 0;
+  _blockLen = 0;
+}
+
+void DatasetReader::close() {
+  if (_file) _file.close();
+  _count = 0;
+  _index = 0;
+  _blockPos = 0;
+  _blockLen = 0;
+}
+
+bool DatasetReader::isOpen() const { return _file ? true : false; }
+
+#endif
+
+// EOF
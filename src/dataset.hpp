@@ -0,0 +1,119 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_DATASET_HPP_
+#define SRC_DATASET_HPP_
+
+#include <Arduino.h>
+#if !defined(KEGMON_NATIVE)
+#include <LittleFS.h>
+#endif
+
+// Binary format for recorded scale data (.kds), all values are little endian.
+//
+// Header (16 bytes): magic "KGDS", version, record size, interval (ms) and
+// the number of records (0 if unknown, the file size is used by the reader and
+// also limits the count).
+// Record (16 bytes): time (ms since start of capture), scale1, scale2, temp.
+constexpr auto DATASET_MAGIC = "KGDS";
+constexpr auto DATASET_VERSION = 1;
+constexpr auto DATASET_BLOCK = 32;  // Records read per block on the device
+
+struct DatasetHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t interval;
+  uint32_t count;
+};
+
+struct DatasetRecord {
+  uint32_t time;
+  float scale1;
+  float scale2;
+  float temp;
+};
+
+static_assert(sizeof(DatasetHeader) == 16, "Dataset header must be 16 bytes");
+static_assert(sizeof(DatasetRecord) == 16, "Dataset record must be 16 bytes");
+
+// Streams records from a dataset file. On the device the file is read from
+// LittleFS in small blocks, on the host the file is memory mapped.
+class DatasetReader {
+ private:
+  DatasetHeader _header = {};
+  uint32_t _count = 0;
+  uint32_t _index = 0;
+#if defined(KEGMON_NATIVE)
+  const uint8_t *_map = 0;
+  size_t _mapSize = 0;
+#else
+  File _file;
+  DatasetRecord _block[DATASET_BLOCK];
+  int _blockPos = 0;
+  int _blockLen = 0;
+#endif
+
+  DatasetReader(const DatasetReader &) = delete;
+  void operator=(const DatasetReader &) = delete;
+
+  bool validateHeader(size_t fileSize);
+
+ public:
+  DatasetReader() {}
+  ~DatasetReader() { close(); }
+
+  bool open(const char *path);
+  bool next(DatasetRecord &r);
+  void rewind();
+  void close();
+
+  bool isOpen() const;
+  uint32_t count() const { return _count; }
+  uint32_t index() const { return _index; }
+  uint32_t interval() const { return _header.interval; }
+};
+
+#if defined(KEGMON_NATIVE)
+// Creates dataset files on the host, used for converting captures.
+class DatasetWriter {
+ private:
+  FILE *_file = 0;
+  DatasetHeader _header = {};
+
+  DatasetWriter(const DatasetWriter &) = delete;
+  void operator=(const DatasetWriter &) = delete;
+
+ public:
+  DatasetWriter() {}
+  ~DatasetWriter() { close(); }
+
+  bool open(const char *path, uint32_t interval);
+  bool write(const DatasetRecord &r);
+  void close();
+};
+#endif
+
+#endif  // SRC_DATASET_HPP_
+
+// EOF
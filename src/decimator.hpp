@@ -0,0 +1,99 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_DECIMATOR_HPP_
+#define SRC_DECIMATOR_HPP_
+
+#include <Arduino.h>
+
+// Cascaded integrator comb filter that reduces the sample rate by a factor.
+// Each stage is a moving average over factor samples, the integrators run at
+// the input rate and the combs at the output rate so a value costs ORDER
+// additions. Unsigned arithmetic is used since the integrators are allowed to
+// wrap around, the output is correct as long as it fits in 64 bits.
+template <int ORDER>
+class CicDecimator {
+ private:
+  uint64_t _integrator[ORDER];
+  uint64_t _comb[ORDER];
+  int _factor = 1;
+  int _phase = 0;
+  int _warmup = ORDER;  // Outputs until the combs are filled
+  float _output = NAN;
+  uint32_t _outputs = 0;
+
+ public:
+  CicDecimator() { clear(); }
+
+  void clear() {
+    for (int i = 0; i < ORDER; i++) _integrator[i] = _comb[i] = 0;
+    _phase = 0;
+    _warmup = ORDER;
+    _output = NAN;
+    _outputs = 0;
+  }
+
+  int factor() const { return _factor; }
+  void setFactor(int factor) {
+    if (factor < 1) factor = 1;
+    if (factor == _factor) return;
+    _factor = factor;
+    clear();
+  }
+
+  // Returns true when a new output is available
+  bool add(int32_t v) {
+    _integrator[0] += static_cast<uint64_t>(static_cast<int64_t>(v));
+    for (int i = 1; i < ORDER; i++) _integrator[i] += _integrator[i - 1];
+
+    if (++_phase < _factor) return false;
+    _phase = 0;
+
+    uint64_t y = _integrator[ORDER - 1];
+    for (int i = 0; i < ORDER; i++) {
+      uint64_t t = y;
+      y -= _comb[i];
+      _comb[i] = t;
+    }
+
+    if (_warmup) {
+      _warmup--;
+      return false;
+    }
+
+    double gain = 1;
+    for (int i = 0; i < ORDER; i++) gain *= _factor;
+
+    _output = static_cast<int64_t>(y) / gain;
+    _outputs++;
+    return true;
+  }
+
+  bool hasOutput() const { return !isnan(_output); }
+  float output() const { return _output; }
+  uint32_t outputs() const { return _outputs; }
+};
+
+#endif  // SRC_DECIMATOR_HPP_
+
+// EOF
@@ -25,6 +25,7 @@ SOFTWARE.
 #include <display.hpp>
 #include <displayout.hpp>
 #include <levels.hpp>
+#include <leveltask.hpp>
 
 constexpr auto DISPLAY_ITER_TIME = 4000;
 
@@ -274,22 +275,24 @@ void DisplayLayout::showHardwareStats(UnitIndex idx, bool isScaleConnected) {
   myDisplay.setFont(idx, FontSize::FONT_10);
 
   if (isScaleConnected) {
+    LevelSnapshot levels;
+    myLevelTask.getSnapshot(levels);
+
     snprintf(&_buf[0], sizeof(_buf), "Last wgt: %.3f",
-             myLevelDetection.getTotalWeight(idx));
+             levels.getTotalWeight(idx));
     myDisplay.printLine(idx, 0, &_buf[0]);
     snprintf(&_buf[0], sizeof(_buf), "Stab wgt: %.3f",
-             myLevelDetection.getTotalStableWeight(idx));
+             levels.getTotalStableWeight(idx));
     myDisplay.printLine(idx, 1, &_buf[0]);
     snprintf(&_buf[0], sizeof(_buf), "Ave  wgt: %.3f",
-             myLevelDetection.getStatsDetection(idx)->ave());
+             levels.getStatsAverage(idx));
     myDisplay.printLine(idx, 2, &_buf[0]);
     snprintf(&_buf[0], sizeof(_buf), "Min/Max: %.3f/%.3f",
-             myLevelDetection.getStatsDetection(idx)->min(),
-             myLevelDetection.getStatsDetection(idx)->max());
+             levels.getStatsMin(idx), levels.getStatsMax(idx));
     myDisplay.printLine(idx, 3, &_buf[0]);
 
     snprintf(&_buf[0], sizeof(_buf), "Raw  wgt: %.3f",
-             myLevelDetection.getTotalRawWeight(idx));
+             levels.getTotalRawWeight(idx));
     myDisplay.printLine(idx, 4, &_buf[0]);
   }
 
@@ -0,0 +1,119 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_HAMPEL_HPP_
+#define SRC_HAMPEL_HPP_
+
+#include <Arduino.h>
+
+constexpr auto HAMPEL_SIGMA = 3.0;     // Allowed deviation in std deviations
+constexpr auto HAMPEL_MAD = 1.4826;    // MAD to std deviation (normal data)
+constexpr auto HAMPEL_MIN_VALUES = 3;  // Values needed before checking
+
+// Outlier detection based on the median of the last values (Hampel filter).
+// A value is an outlier if it deviates more from the median than both the
+// limit and three times the MAD based std deviation. Outliers are replaced
+// with the median, but they are kept in the window so a real level change is
+// accepted once it is the majority (after SIZE/2 values). The window is small
+// and fixed so the cost per value is constant.
+template <int SIZE>
+class HampelFilter {
+ private:
+  float _buf[SIZE];     // Values in arrival order
+  float _sorted[SIZE];  // Same values sorted
+  int _head = 0;
+  int _count = 0;
+
+  void insertSorted(float v) {
+    int i = _count;
+    while (i > 0 && _sorted[i - 1] > v) {
+      _sorted[i] = _sorted[i - 1];
+      i--;
+    }
+    _sorted[i] = v;
+  }
+
+  void removeSorted(float v) {
+    int i = 0;
+    while (i < _count && _sorted[i] != v) i++;
+    for (; i < _count - 1; i++) _sorted[i] = _sorted[i + 1];
+  }
+
+  float mad(float m) const {
+    float d[SIZE];
+
+    for (int i = 0; i < _count; i++) {
+      float v = fabs(_sorted[i] - m);
+      int j = i;
+      while (j > 0 && d[j - 1] > v) {
+        d[j] = d[j - 1];
+        j--;
+      }
+      d[j] = v;
+    }
+
+    return (_count % 2) ? d[_count / 2]
+                        : (d[_count / 2 - 1] + d[_count / 2]) / 2;
+  }
+
+ public:
+  void clear() {
+    _head = 0;
+    _count = 0;
+  }
+
+  int count() const { return _count; }
+  float median() const {
+    if (!_count) return NAN;
+    return (_count % 2) ? _sorted[_count / 2]
+                        : (_sorted[_count / 2 - 1] + _sorted[_count / 2]) / 2;
+  }
+
+  // Returns the value to use, sets outlier if the value was replaced.
+  float filter(float v, float limit, bool &outlier) {
+    if (_count == SIZE) {
+      removeSorted(_buf[_head]);
+      _count--;
+    }
+    insertSorted(v);
+    _count++;
+    _buf[_head] = v;
+    _head = (_head + 1) % SIZE;
+
+    outlier = false;
+    if (_count < HAMPEL_MIN_VALUES) return v;
+
+    float m = median();
+    float t = HAMPEL_SIGMA * HAMPEL_MAD * mad(m);
+
+    if (fabs(v - m) > fmax(t, limit)) {
+      outlier = true;
+      return m;
+    }
+    return v;
+  }
+};
+
+#endif  // SRC_HAMPEL_HPP_
+
+// EOF
@@ -176,6 +176,10 @@ void HomeAssist::sendPourInformation(UnitIndex idx, float pourVol) {
 void HomeAssist::updateStatus() {
   _lastTimestamp = millis();
   _lastStatus = _push->wasLastSuccessful();
+  if (_lastStatus)
+    _delivered++;
+  else
+    _failed++;
   _lastMqttError = _push->getLastResponseCode();
   _hasRun = true;
 }
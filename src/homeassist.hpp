@@ -32,6 +32,8 @@ class HomeAssist {
   BasePush *_push;
 
   bool _hasRun = false;
+  uint32_t _delivered = 0;
+  uint32_t _failed = 0;
   uint32_t _lastTimestamp = 0;
   bool _lastStatus = 0;
   int _lastMqttError = 0;
@@ -46,6 +48,8 @@ class HomeAssist {
   void sendPourInformation(UnitIndex idx, float pourVol);
 
   bool hasRun() { return _hasRun; }
+  uint32_t getDelivered() { return _delivered; }
+  uint32_t getFailed() { return _failed; }
   uint32_t getLastTimeStamp() { return _lastTimestamp; }
   bool getLastStatus() { return _lastStatus; }
   int getLastError() { return _lastMqttError; }
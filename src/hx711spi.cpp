@@ -0,0 +1,46 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <hx711spi.hpp>
+
+#if defined(ENABLE_HX711_SPI)
+
+void HX711Spi::begin(uint8_t data, uint8_t clock) {
+  // No SCK pin is needed, MOSI is connected to PD_SCK and MISO to DOUT
+  _spi.begin(-1, data, clock, -1);
+}
+
+int32_t HX711Spi::read() {
+  uint8_t tx[HX711_SPI_BYTES];
+  uint8_t rx[HX711_SPI_BYTES];
+
+  hx711SpiClock(tx);
+  _spi.beginTransaction(SPISettings(HX711_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  _spi.transferBytes(&tx[0], &rx[0], sizeof(tx));
+  _spi.endTransaction();
+  return hx711SpiDecode(rx);
+}
+
+#endif
+
+// EOF
@@ -0,0 +1,90 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_HX711SPI_HPP_
+#define SRC_HX711SPI_HPP_
+
+#include <Arduino.h>
+
+#include <cstring>
+
+constexpr auto HX711_DATA_BITS = 24;
+constexpr auto HX711_GAIN_PULSES = 1;  // Channel A, gain 128 (library default)
+constexpr auto HX711_PULSES = HX711_DATA_BITS + HX711_GAIN_PULSES;
+constexpr auto HX711_SPI_BYTES = (HX711_PULSES * 2 + 7) / 8;
+constexpr auto HX711_SPI_CLOCK = 1000000;  // 1 us high and 1 us low on PD_SCK
+
+// The conversion is a 24 bit two's complement value
+inline int32_t hx711SignExtend(uint32_t v) {
+  return static_cast<int32_t>(v << 8) >> 8;
+}
+
+// PD_SCK is driven by MOSI, every pulse is two SPI bits (high, low) and the
+// bits after the last pulse are low so the chip is not powered down.
+inline void hx711SpiClock(uint8_t (&tx)[HX711_SPI_BYTES]) {
+  memset(&tx[0], 0, sizeof(tx));
+
+  for (int i = 0; i < HX711_PULSES; i++) {
+    int bit = i * 2;
+    tx[bit / 8] |= 0x80 >> (bit % 8);
+  }
+}
+
+// DOUT is read on MISO, a data bit is taken from the low half of its pulse
+// where the chip has already shifted it out.
+inline int32_t hx711SpiDecode(const uint8_t (&rx)[HX711_SPI_BYTES]) {
+  uint32_t v = 0;
+
+  for (int i = 0; i < HX711_DATA_BITS; i++) {
+    int bit = i * 2 + 1;
+    v = (v << 1) | ((rx[bit / 8] >> (7 - bit % 8)) & 1);
+  }
+
+  return hx711SignExtend(v);
+}
+
+#if defined(ESP32S2) || defined(ESP32S3)
+#define ENABLE_HX711_SPI
+
+#include <SPI.h>
+
+// HX711 read through a SPI peripheral. The clock pulses are generated by the
+// hardware so interrupts stay enabled while the conversion is shifted out.
+class HX711Spi {
+ private:
+  SPIClass _spi;
+
+  HX711Spi(const HX711Spi&) = delete;
+  void operator=(const HX711Spi&) = delete;
+
+ public:
+  explicit HX711Spi(uint8_t bus) : _spi(bus) {}
+
+  void begin(uint8_t data, uint8_t clock);
+  int32_t read();
+};
+#endif
+
+#endif  // SRC_HX711SPI_HPP_
+
+// EOF
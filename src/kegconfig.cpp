@@ -46,7 +46,7 @@ void KegConfig::createJson(JsonObject& doc) const {
   doc[PARAM_TEMP_SENSOR] = getTempSensorTypeAsInt();
   doc[PARAM_SCALE_SENSOR] = getScaleSensorTypeAsInt();
   doc[PARAM_DISPLAY_DRIVER] = getDisplayDriverTypeAsInt();
-  // doc[PARAM_LEVEL_DETECTION] = getLevelDetectionAsInt();
+  doc[PARAM_LEVEL_DETECTION] = getLevelDetectionAsInt();
 
   doc[PARAM_BREWFATHER_APIKEY] = getBrewfatherApiKey();
   doc[PARAM_BREWFATHER_USERKEY] = getBrewfatherUserKey();
@@ -68,6 +68,7 @@ void KegConfig::createJson(JsonObject& doc) const {
   doc[PARAM_SCALE_FACTOR1] =
       serialized(String(getScaleFactor(UnitIndex::U1), 5));
   doc[PARAM_SCALE_OFFSET1] = getScaleOffset(UnitIndex::U1);
+  createJsonPoints(doc, PARAM_SCALE_POINTS1, UnitIndex::U1);
   doc[PARAM_KEG_WEIGHT1] =
       serialized(String(convertOutgoingWeight(getKegWeight(UnitIndex::U1)),
                         getWeightPrecision()));
@@ -89,6 +90,7 @@ void KegConfig::createJson(JsonObject& doc) const {
   doc[PARAM_SCALE_FACTOR2] =
       serialized(String(getScaleFactor(UnitIndex::U2), 5));
   doc[PARAM_SCALE_OFFSET2] = getScaleOffset(UnitIndex::U2);
+  createJsonPoints(doc, PARAM_SCALE_POINTS2, UnitIndex::U2);
   doc[PARAM_KEG_WEIGHT2] =
       serialized(String(convertOutgoingWeight(getKegWeight(UnitIndex::U2)),
                         getWeightPrecision()));
@@ -114,6 +116,10 @@ void KegConfig::createJson(JsonObject& doc) const {
   doc[PARAM_SCALE_READ_COUNT] = getScaleReadCount();
   doc[PARAM_SCALE_READ_COUNT_CALIBRATION] = getScaleReadCountCalibration();
   doc[PARAM_SCALE_STABLE_COUNT] = getScaleStableCount();
+  doc[PARAM_SCALE_RAW_WINDOW] = getScaleRawWindow();
+  doc[PARAM_SCALE_OUTLIER_LIMIT] =
+      serialized(String(getScaleOutlierLimit(), 2));
+  doc[PARAM_SCALE_DECIMATION] = getScaleDecimation();
 
   doc[PARAM_PIN_DISPLAY_DATA] = getPinDisplayData();
   doc[PARAM_PIN_DISPLAY_CLOCK] = getPinDisplayClock();
@@ -134,12 +140,11 @@ void KegConfig::createJson(JsonObject& doc) const {
 #error "Unsupported target"
 #endif
 
-  /*
   doc[PARAM_KALMAN_ACTIVE] = isKalmanActive();
+  doc[PARAM_KALMAN_ADAPTIVE] = isKalmanAdaptive();
   doc[PARAM_KALMAN_MEASUREMENT] = getKalmanMeasurement();
   doc[PARAM_KALMAN_ESTIMATION] = getKalmanEstimation();
   doc[PARAM_KALMAN_NOISE] = getKalmanNoise();
-  */
 }
 
 void KegConfig::parseJson(JsonObject& doc) {
@@ -187,8 +192,8 @@ void KegConfig::parseJson(JsonObject& doc) {
   if (!doc[PARAM_DISPLAY_DRIVER].isNull())
     setDisplayDriverType(doc[PARAM_DISPLAY_DRIVER].as<int>());
 
-  /*if (!doc[PARAM_LEVEL_DETECTION].isNull())
-    setLevelDetection(doc[PARAM_LEVEL_DETECTION].as<int>());*/
+  if (!doc[PARAM_LEVEL_DETECTION].isNull())
+    setLevelDetection(doc[PARAM_LEVEL_DETECTION].as<int>());
 
   if (!doc[PARAM_SCALE_TEMP_FORMULA1].isNull())
     setScaleTempCompensationFormula(UnitIndex::U1,
@@ -197,6 +202,8 @@ void KegConfig::parseJson(JsonObject& doc) {
     setScaleFactor(UnitIndex::U1, doc[PARAM_SCALE_FACTOR1].as<float>());
   if (!doc[PARAM_SCALE_OFFSET1].isNull())
     setScaleOffset(UnitIndex::U1, doc[PARAM_SCALE_OFFSET1].as<float>());
+  if (!doc[PARAM_SCALE_POINTS1].isNull())
+    parseJsonPoints(doc, PARAM_SCALE_POINTS1, UnitIndex::U1);
   if (!doc[PARAM_KEG_WEIGHT1].isNull())
     setKegWeight(UnitIndex::U1,
                  convertIncomingWeight(doc[PARAM_KEG_WEIGHT1].as<float>()));
@@ -230,6 +237,8 @@ void KegConfig::parseJson(JsonObject& doc) {
     setScaleFactor(UnitIndex::U2, doc[PARAM_SCALE_FACTOR2].as<float>());
   if (!doc[PARAM_SCALE_OFFSET2].isNull())
     setScaleOffset(UnitIndex::U2, doc[PARAM_SCALE_OFFSET2].as<float>());
+  if (!doc[PARAM_SCALE_POINTS2].isNull())
+    parseJsonPoints(doc, PARAM_SCALE_POINTS2, UnitIndex::U2);
   if (!doc[PARAM_KEG_WEIGHT2].isNull())
     setKegWeight(UnitIndex::U2,
                  convertIncomingWeight(doc[PARAM_KEG_WEIGHT2].as<float>()));
@@ -268,6 +277,12 @@ void KegConfig::parseJson(JsonObject& doc) {
     setScaleReadCountCalibration(doc[PARAM_SCALE_READ_COUNT_CALIBRATION]);
   if (!doc[PARAM_SCALE_STABLE_COUNT].isNull())
     setScaleStableCount(doc[PARAM_SCALE_STABLE_COUNT]);
+  if (!doc[PARAM_SCALE_RAW_WINDOW].isNull())
+    setScaleRawWindow(doc[PARAM_SCALE_RAW_WINDOW].as<int>());
+  if (!doc[PARAM_SCALE_OUTLIER_LIMIT].isNull())
+    setScaleOutlierLimit(doc[PARAM_SCALE_OUTLIER_LIMIT].as<float>());
+  if (!doc[PARAM_SCALE_DECIMATION].isNull())
+    setScaleDecimation(doc[PARAM_SCALE_DECIMATION].as<int>());
 
   if (!doc[PARAM_PIN_DISPLAY_DATA].isNull())
     setPinDisplayData(doc[PARAM_PIN_DISPLAY_DATA]);
@@ -286,17 +301,63 @@ void KegConfig::parseJson(JsonObject& doc) {
   if (!doc[PARAM_PIN_TEMP_POWER].isNull())
     setPinTempPower(doc[PARAM_PIN_TEMP_POWER]);
 
-  /*
   if (!doc[PARAM_KALMAN_ESTIMATION].isNull())
     setKalmanEstimation(doc[PARAM_KALMAN_ESTIMATION].as<float>());
   if (!doc[PARAM_KALMAN_MEASUREMENT].isNull())
     setKalmanMeasurement(doc[PARAM_KALMAN_MEASUREMENT].as<float>());
   if (!doc[PARAM_KALMAN_NOISE].isNull())
     setKalmanNoise(doc[PARAM_KALMAN_NOISE].as<float>());
-  if (!doc[PARAM_KALMAN_ACTIVE].isNull()) {
-    String s = doc[PARAM_KALMAN_ACTIVE];
-    setKalmanActive(s.equals("yes") ? true : false);
-  }*/
+  if (!doc[PARAM_KALMAN_ACTIVE].isNull())
+    setKalmanActive(doc[PARAM_KALMAN_ACTIVE].as<bool>());
+  if (!doc[PARAM_KALMAN_ADAPTIVE].isNull())
+    setKalmanAdaptive(doc[PARAM_KALMAN_ADAPTIVE].as<bool>());
+}
+
+// The points are stored in kg and counts above the offset
+void KegConfig::createJsonPoints(JsonObject& doc, const char* key,
+                                 UnitIndex idx) const {
+  JsonArray points = doc[key].to<JsonArray>();
+
+  for (int i = 0; i < _scalePointCount[idx]; i++) {
+    JsonObject p = points.add<JsonObject>();
+    p[PARAM_POINT_COUNTS] = _scalePoints[idx][i].counts;
+    p[PARAM_POINT_WEIGHT] = _scalePoints[idx][i].weight;
+  }
+}
+
+void KegConfig::parseJsonPoints(JsonObject& doc, const char* key,
+                                UnitIndex idx) {
+  JsonArray points = doc[key].as<JsonArray>();
+
+  clearScalePoints(idx);
+
+  for (JsonObject p : points) {
+    addScalePoint(idx, p[PARAM_POINT_COUNTS].as<float>(),
+                  p[PARAM_POINT_WEIGHT].as<float>());
+  }
+}
+
+bool KegConfig::addScalePoint(UnitIndex idx, float counts, float weight) {
+  int i;
+
+  if (isnan(counts) || isnan(weight)) return false;
+
+  // A new calibration with the same weight replaces the old point
+  for (i = 0; i < _scalePointCount[idx]; i++) {
+    if (fabs(_scalePoints[idx][i].weight - weight) < 0.001) break;
+  }
+
+  if (i == CALIBRATION_POINTS_MAX) {
+    Log.error(F("CFG : Max %d calibration points per scale [%d]." CR),
+              CALIBRATION_POINTS_MAX, idx);
+    return false;
+  }
+
+  _scalePoints[idx][i] = {counts, weight};
+  if (i == _scalePointCount[idx]) _scalePointCount[idx]++;
+  _scalePointChanges++;
+  _saveNeeded = true;
+  return true;
 }
 
 float convertIncomingWeight(float w) {
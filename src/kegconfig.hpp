@@ -25,6 +25,7 @@ SOFTWARE.
 #define SRC_KEGCONFIG_HPP_
 
 #include <baseconfig.hpp>
+#include <calibration.hpp>
 #include <main.hpp>
 
 constexpr auto PARAM_BREWLOGGER_URL = "brewlogger_url";
@@ -65,6 +66,10 @@ constexpr auto PARAM_SCALE_FACTOR1 = "scale_factor1";
 constexpr auto PARAM_SCALE_FACTOR2 = "scale_factor2";
 constexpr auto PARAM_SCALE_OFFSET1 = "scale_offset1";
 constexpr auto PARAM_SCALE_OFFSET2 = "scale_offset2";
+constexpr auto PARAM_SCALE_POINTS1 = "scale_points1";
+constexpr auto PARAM_SCALE_POINTS2 = "scale_points2";
+constexpr auto PARAM_POINT_COUNTS = "counts";
+constexpr auto PARAM_POINT_WEIGHT = "weight";
 constexpr auto PARAM_SCALE_TEMP_FORMULA1 = "scale_temp_formula1";
 constexpr auto PARAM_SCALE_TEMP_FORMULA2 = "scale_temp_formula2";
 constexpr auto PARAM_SCALE_DEVIATION_INCREASE = "scale_deviation_increase";
@@ -74,11 +79,15 @@ constexpr auto PARAM_SCALE_READ_COUNT = "scale_read_count";
 constexpr auto PARAM_SCALE_READ_COUNT_CALIBRATION =
     "scale_read_count_calibration";
 constexpr auto PARAM_SCALE_STABLE_COUNT = "scale_stable_count";
+constexpr auto PARAM_SCALE_RAW_WINDOW = "scale_raw_window";
+constexpr auto PARAM_SCALE_OUTLIER_LIMIT = "scale_outlier_limit";
+constexpr auto PARAM_SCALE_DECIMATION = "scale_decimation";
 constexpr auto PARAM_LEVEL_DETECTION = "level_detection";
 constexpr auto PARAM_KALMAN_NOISE = "kalman_noise";
 constexpr auto PARAM_KALMAN_MEASUREMENT = "kalman_measurement";
 constexpr auto PARAM_KALMAN_ESTIMATION = "kalman_estimation";
 constexpr auto PARAM_KALMAN_ACTIVE = "kalman_active";
+constexpr auto PARAM_KALMAN_ADAPTIVE = "kalman_adaptive";
 
 struct BeerInfo {
   String _name = "";
@@ -117,6 +126,15 @@ struct HardwareInfo {
   int _scale2Clock = A9;
   int _tempData = A10;
   int _tempPower = A12;
+#elif defined(KEGMON_NATIVE)
+  int _displayData = 0;
+  int _displayClock = 0;
+  int _scale1Data = 0;
+  int _scale1Clock = 0;
+  int _scale2Data = 0;
+  int _scale2Clock = 0;
+  int _tempData = 0;
+  int _tempPower = 0;
 #else
 #error "Not a supported target"
 #endif
@@ -151,9 +169,11 @@ enum TempSensorType {
   SensorBrewPI = 3,
   SensorChamberCtrl = 4
 };
-enum ScaleSensorType { ScaleHX711 = 0, ScaleNAU7802 = 1 };
+enum ScaleSensorType { ScaleHX711 = 0, ScaleNAU7802 = 1, ScaleReplay = 2 };
 enum DisplayDriverType { OLED_1306 = 0, LCD = 1 };
 
+constexpr auto RAW_WINDOW_MAX = 120;  // Size of the raw history buffer
+
 float convertIncomingWeight(float w);
 float convertIncomingVolume(float v);
 float convertOutgoingWeight(float w);
@@ -185,6 +205,9 @@ class KegConfig : public BaseConfig {
 
   float _scaleFactor[2] = {0, 0};
   int32_t _scaleOffset[2] = {0, 0};
+  CalibrationPoint _scalePoints[2][CALIBRATION_POINTS_MAX];
+  int _scalePointCount[2] = {0, 0};
+  uint32_t _scalePointChanges = 0;
   float _kegWeight[2] = {4, 4};          // Weight in kg
   float _kegVolume[2] = {19, 19};        // Weight in liters
   float _glassVolume[2] = {0.40, 0.40};  // Volume in liters
@@ -194,6 +217,9 @@ class KegConfig : public BaseConfig {
   float _scaleDeviationDecreaseValue = 0.1;  // kg
   float _scaleKalmanDeviation = 0.05;
   uint32_t _scaleStableCount = 8;
+  int _scaleRawWindow = 10;
+  float _scaleOutlierLimit = 1.0;  // kg
+  int _scaleDecimation = 320;      // NAU7802 conversions per value
   int _scaleReadCount = 3;
   int _scaleReadCountCalibration = 30;
   String _scaleTempCompensationFormula[2] = {"", ""};
@@ -201,12 +227,14 @@ class KegConfig : public BaseConfig {
   LevelDetectionType _levelDetection = LevelDetectionType::STATS;
   HardwareInfo _pins;
 
-  /*
   bool _kalmanActive = true;
-  float _kalmanMeasurement = 0.3;
-  float _kalmanEstimation = 2;
-  float _kalmanNoise = 0.01;
-  */
+  bool _kalmanAdaptive = false;
+  float _kalmanMeasurement = 0.001;
+  float _kalmanEstimation = 0.001;
+  float _kalmanNoise = 0.001;
+
+  void createJsonPoints(JsonObject& doc, const char* key, UnitIndex idx) const;
+  void parseJsonPoints(JsonObject& doc, const char* key, UnitIndex idx);
 
  public:
   KegConfig(String baseMDNS, String fileName);
@@ -352,6 +380,19 @@ class KegConfig : public BaseConfig {
     _saveNeeded = true;
   }
 
+  // Multi point calibration, used instead of the factor when there are points
+  int getScalePointCount(UnitIndex idx) const { return _scalePointCount[idx]; }
+  const CalibrationPoint* getScalePoints(UnitIndex idx) const {
+    return _scalePoints[idx];
+  }
+  uint32_t getScalePointChanges() const { return _scalePointChanges; }
+  bool addScalePoint(UnitIndex idx, float counts, float weight);
+  void clearScalePoints(UnitIndex idx) {
+    _scalePointCount[idx] = 0;
+    _scalePointChanges++;
+    _saveNeeded = true;
+  }
+
   DisplayLayoutType getDisplayLayoutType() const { return _displayLayout; }
   int getDisplayLayoutTypeAsInt() const { return _displayLayout; }
   void setDisplayLayoutType(DisplayLayoutType d) {
@@ -429,6 +470,29 @@ class KegConfig : public BaseConfig {
     _saveNeeded = true;
   }
 
+  // This is the number of raw values used for the average and slope values.
+  int getScaleRawWindow() const { return _scaleRawWindow; }
+  void setScaleRawWindow(int i) {
+    _scaleRawWindow = i < 2 ? 2 : (i > RAW_WINDOW_MAX ? RAW_WINDOW_MAX : i);
+    _saveNeeded = true;
+  }
+
+  // Values that differ more than this from the median of the last values are
+  // treated as faulty readings (if they also exceed the normal noise).
+  float getScaleOutlierLimit() const { return _scaleOutlierLimit; }
+  void setScaleOutlierLimit(float f) {
+    _scaleOutlierLimit = f;
+    _saveNeeded = true;
+  }
+
+  // Number of NAU7802 conversions (320 per second) that are filtered into one
+  // weight value.
+  int getScaleDecimation() const { return _scaleDecimation; }
+  void setScaleDecimation(int i) {
+    _scaleDecimation = i < 1 ? 1 : i;
+    _saveNeeded = true;
+  }
+
   int getScaleReadCount() const { return _scaleReadCount; }
   void setScaleReadCount(uint32_t i) {
     _scaleReadCount = i;
@@ -445,37 +509,45 @@ class KegConfig : public BaseConfig {
 
   LevelDetectionType getLevelDetection() const { return _levelDetection; }
   int getLevelDetectionAsInt() const { return _levelDetection; }
-  /*void setLevelDetection(LevelDetectionType l) {
+  void setLevelDetection(LevelDetectionType l) {
     _levelDetection = l;
     _saveNeeded = true;
   }
   void setLevelDetection(int l) {
+    // An unknown type would index past the detectors, keep the current one
+    if (l < LevelDetectionType::RAW || l > LevelDetectionType::CUSUM) return;
     _levelDetection = (LevelDetectionType)l;
     _saveNeeded = true;
-  }*/
+  }
 
-  /*
-  float getKalmanEstimation() { return _kalmanEstimation; }
+  // Parameters for the kalman filter, changes are applied to the running
+  // filter. In adaptive mode the measurement error is taken from the noise
+  // measured on the scale instead.
+  float getKalmanEstimation() const { return _kalmanEstimation; }
   void setKalmanEstimation(float f) {
     _kalmanEstimation = f;
     _saveNeeded = true;
   }
-  float getKalmanMeasurement() { return _kalmanMeasurement; }
+  float getKalmanMeasurement() const { return _kalmanMeasurement; }
   void setKalmanMeasurement(float f) {
     _kalmanMeasurement = f;
     _saveNeeded = true;
   }
-  float getKalmanNoise() { return _kalmanNoise; }
+  float getKalmanNoise() const { return _kalmanNoise; }
   void setKalmanNoise(float f) {
     _kalmanNoise = f;
     _saveNeeded = true;
   }
-  bool isKalmanActive() { return _kalmanActive; }
+  bool isKalmanActive() const { return _kalmanActive; }
   void setKalmanActive(bool b) {
     _kalmanActive = b;
     _saveNeeded = true;
   }
-  */
+  bool isKalmanAdaptive() const { return _kalmanAdaptive; }
+  void setKalmanAdaptive(bool b) {
+    _kalmanAdaptive = b;
+    _saveNeeded = true;
+  }
 
   const char* getScaleTempCompensationFormula(UnitIndex idx) const {
     return _scaleTempCompensationFormula[idx].c_str();
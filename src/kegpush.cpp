@@ -32,24 +32,172 @@ void KegPushHandler::pushTempInformation(float tempC, bool isLoop) {
   _ha->sendTempInformation(tempC);
 }
 
-void KegPushHandler::pushPourInformation(UnitIndex idx, float stableVol,
-                                         float pourVol, bool isLoop) {
-  if (!isLoop)  // Limit calls to brewspy
-    _brewspy->sendPourInformation(idx, pourVol);
+bool KegPushHandler::queueEvent(const PushEvent& event) {
+  if (_queue.push(event)) return true;
 
-  _ha->sendPourInformation(idx, pourVol);
-  _brewLogger->sendPourInformation(idx, pourVol, stableVol);
+  _dropped++;
+  Log.warning(F("PUSH: Queue is full, dropping event %d [%d]." CR),
+              event.type, event.idx);
+  return false;
 }
 
-void KegPushHandler::pushKegInformation(UnitIndex idx, float stableVol,
-                                        float pourVol, float glasses,
-                                        bool isLoop) {
-  if (!isLoop)  // Limit calls to brewspy
-    _brewspy->sendTapInformation(idx, stableVol, pourVol);
+bool KegPushHandler::loop() {
+  PushEvent e;
+  bool work = false;
 
-  _ha->sendTapInformation(idx, stableVol, glasses);
-  _barhelper->sendKegInformation(idx, stableVol);
-  _brewLogger->sendKegInformation(idx, stableVol);
+  // The file system is mounted after the push handler is created
+  if (!_outbox.isOpen()) _outbox.begin();
+
+  uint32_t now = millis();
+
+  while (_queue.pop(e)) {
+    work = true;
+
+    // Only the latest keg level matters, pours are all needed
+    if (e.type == PushEventType::PUSH_EVENT_KEG) {
+      for (int i = 0; i < OUTBOX_TARGETS; i++)
+        _coalescer[i].update({e.idx, e.stableVol, e.pourVol, e.glasses}, now);
+      continue;
+    }
+
+    float glasses = isnan(e.glasses) ? 0 : e.glasses * 10;
+    OutboxRecord r = {static_cast<uint32_t>(time(nullptr)),
+                      static_cast<uint8_t>(e.type), static_cast<uint8_t>(e.idx),
+                      static_cast<uint16_t>(glasses > 65535 ? 65535 : glasses),
+                      e.stableVol, e.pourVol};
+    _outbox.append(r);
+  }
+
+  // Everything that was stored while offline is sent directly on reconnect
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected && !_connected) _outbox.retry();
+  _connected = connected;
+
+  if (!connected) return work;
+
+  for (int i = 0; i < OUTBOX_TARGETS; i++) {
+    int target = (_target + i) % OUTBOX_TARGETS;
+    KegUpdate update;
+
+    if (!_outbox.isDue(target, now)) continue;
+
+    // Pours are sent before the level so the target ends up with the latest
+    if (_outbox.pending(target)) {
+      _target = (target + 1) % OUTBOX_TARGETS;
+      deliverBatch(target, now);
+      return true;
+    }
+
+    if (_coalescer[target].next(now, update)) {
+      _target = (target + 1) % OUTBOX_TARGETS;
+      deliverKeg(target, update, now);
+      return true;
+    }
+  }
+
+  return work;
+}
+
+void KegPushHandler::deliverBatch(int target, uint32_t now) {
+  OutboxRecord r[OUTBOX_BATCH];
+  int n = _outbox.read(target, &r[0], OUTBOX_BATCH);
+  int i = 0;
+
+  for (; i < n; i++) {
+    if (r[i].time > 0 && time(nullptr) - r[i].time > 60)
+      Log.notice(F("PUSH: Sending event from %d minutes ago [%d]." CR),
+                 static_cast<int>((time(nullptr) - r[i].time) / 60), r[i].idx);
+
+    PushEvent e = {static_cast<PushEventType>(r[i].type),
+                   static_cast<UnitIndex>(r[i].idx), r[i].stableVol,
+                   r[i].pourVol, static_cast<float>(r[i].glasses / 10.0)};
+
+    if (deliver(target, e) == PushResult::PUSH_RESULT_FAILED) break;
+  }
+
+  _outbox.advance(target, i);
+
+  if (i < n)
+    _outbox.failed(target, now);
+  else
+    _outbox.succeeded(target);
+}
+
+void KegPushHandler::deliverKeg(int target, const KegUpdate& update,
+                                uint32_t now) {
+  PushEvent e = {PushEventType::PUSH_EVENT_KEG, update.idx, update.stableVol,
+                 update.pourVol, update.glasses};
+
+  switch (deliver(target, e)) {
+    case PushResult::PUSH_RESULT_DELIVERED:
+      _coalescer[target].delivered(update.idx, now);
+      _outbox.succeeded(target);
+      break;
+
+    case PushResult::PUSH_RESULT_SKIPPED:
+      _coalescer[target].skipped(update.idx, now);
+      break;
+
+    case PushResult::PUSH_RESULT_FAILED:  // Kept until the target is back
+      _outbox.failed(target, now);
+      break;
+  }
+}
+
+namespace {
+// The targets count their requests, no change means that the target is not
+// configured and the event is skipped.
+template <typename T, typename F>
+PushResult sendTo(T* target, F send) {
+  uint32_t delivered = target->getDelivered();
+  uint32_t failed = target->getFailed();
+
+  send();
+
+  if (target->getFailed() != failed) return PushResult::PUSH_RESULT_FAILED;
+  if (target->getDelivered() != delivered)
+    return PushResult::PUSH_RESULT_DELIVERED;
+  return PushResult::PUSH_RESULT_SKIPPED;
+}
+}  // namespace
+
+PushResult KegPushHandler::deliver(int target, const PushEvent& r) {
+  UnitIndex idx = r.idx;
+  bool pour = r.type == PushEventType::PUSH_EVENT_POUR;
+
+  switch (target) {
+    case PushTarget::PUSH_TARGET_BREWSPY:
+      return sendTo(_brewspy, [&]() {
+        if (pour)
+          _brewspy->sendPourInformation(idx, r.pourVol);
+        else
+          _brewspy->sendTapInformation(idx, r.stableVol, r.pourVol);
+      });
+
+    case PushTarget::PUSH_TARGET_HOMEASSIST:
+      return sendTo(_ha, [&]() {
+        if (pour)
+          _ha->sendPourInformation(idx, r.pourVol);
+        else
+          _ha->sendTapInformation(idx, r.stableVol, r.glasses);
+      });
+
+    case PushTarget::PUSH_TARGET_BARHELPER:
+      if (pour) break;
+      return sendTo(_barhelper, [&]() {
+        _barhelper->sendKegInformation(idx, r.stableVol);
+      });
+
+    case PushTarget::PUSH_TARGET_BREWLOGGER:
+      return sendTo(_brewLogger, [&]() {
+        if (pour)
+          _brewLogger->sendPourInformation(idx, r.pourVol, r.stableVol);
+        else
+          _brewLogger->sendKegInformation(idx, r.stableVol);
+      });
+  }
+
+  return PushResult::PUSH_RESULT_SKIPPED;
 }
 
 // EOF
@@ -30,6 +30,45 @@ SOFTWARE.
 #include <brewspy.hpp>
 #include <homeassist.hpp>
 #include <kegconfig.hpp>
+#include <outbox.hpp>
+#include <pushpolicy.hpp>
+#include <spscqueue.hpp>
+
+#include <atomic>
+
+constexpr auto PUSH_QUEUE_SIZE = 8;
+
+enum PushEventType { PUSH_EVENT_POUR = 0, PUSH_EVENT_KEG = 1 };
+
+enum PushTarget {
+  PUSH_TARGET_BREWSPY = 0,
+  PUSH_TARGET_HOMEASSIST = 1,
+  PUSH_TARGET_BARHELPER = 2,
+  PUSH_TARGET_BREWLOGGER = 3
+};
+
+enum PushResult {
+  PUSH_RESULT_SKIPPED = 0,  // Target is not configured for the event
+  PUSH_RESULT_DELIVERED = 1,
+  PUSH_RESULT_FAILED = 2
+};
+
+// Keg levels are sent when they have been stable for the delay, at most once
+// per interval and only if they changed enough. Brewspy is rate limited so the
+// level is only sent on changes, the others get it again every 10 minutes.
+constexpr PushPolicy PUSH_POLICIES[OUTBOX_TARGETS] = {
+    {15 * 1000, 60 * 1000, 0.05, 0},           // Brewspy
+    {5 * 1000, 10 * 1000, 0.01, 600 * 1000},   // Home Assistant
+    {15 * 1000, 60 * 1000, 0.05, 600 * 1000},  // Barhelper
+    {15 * 1000, 30 * 1000, 0.01, 600 * 1000}};  // Brewlogger
+
+struct PushEvent {
+  PushEventType type;
+  UnitIndex idx;
+  float stableVol;
+  float pourVol;
+  float glasses;
+};
 
 class KegPushHandler : public BasePush {
  private:
@@ -38,12 +77,30 @@ class KegPushHandler : public BasePush {
   Barhelper* _barhelper = NULL;
   BrewLogger* _brewLogger = NULL;
 
+  // Events from the level detection. Pours are stored in the outbox from
+  // loop() and keg levels are coalesced per target, both are delivered to each
+  // target when it's reachable.
+  SpscQueue<PushEvent, PUSH_QUEUE_SIZE> _queue;
+  std::atomic<uint32_t> _dropped{0};
+  PushOutbox _outbox;
+  PushCoalescer _coalescer[OUTBOX_TARGETS];
+  int _target = 0;  // Next target to deliver to
+  bool _connected = false;
+
+  bool queueEvent(const PushEvent& event);
+  void deliverBatch(int target, uint32_t now);
+  void deliverKeg(int target, const KegUpdate& update, uint32_t now);
+  PushResult deliver(int target, const PushEvent& event);
+
  public:
   explicit KegPushHandler(KegConfig* config) : BasePush(config) {
     _brewspy = new Brewspy(this);
     _ha = new HomeAssist(this);
     _barhelper = new Barhelper(this);
     _brewLogger = new BrewLogger(this);
+
+    for (int i = 0; i < OUTBOX_TARGETS; i++)
+      _coalescer[i].setPolicy(PUSH_POLICIES[i]);
   }
 
   void requestTapInfoFromBrewspy(JsonObject& obj, String token) {
@@ -51,10 +108,26 @@ class KegPushHandler : public BasePush {
   }
 
   void pushTempInformation(float tempC, bool isLoop = false);
-  void pushPourInformation(UnitIndex idx, float stableVol, float pourVol,
-                           bool isLoop = false);
-  void pushKegInformation(UnitIndex idx, float stableVol, float pourVol,
-                          float glasses, bool isLoop = false);
+
+  // Used by the level detection, only queues the event so the caller is not
+  // blocked by the targets. Returns false if the queue is full.
+  bool queuePourInformation(UnitIndex idx, float stableVol, float pourVol) {
+    return queueEvent({PUSH_EVENT_POUR, idx, stableVol, pourVol, NAN});
+  }
+  bool queueKegInformation(UnitIndex idx, float stableVol, float pourVol,
+                           float glasses) {
+    return queueEvent({PUSH_EVENT_KEG, idx, stableVol, pourVol, glasses});
+  }
+
+  // Moves queued events to the outbox or the coalescers and delivers one batch
+  // or keg level to one target, call from the Arduino loop.
+  bool loop();
+  size_t getQueued() const { return _queue.size(); }
+  uint32_t getDropped() const { return _dropped.load(); }
+  const PushOutbox* getOutbox() const { return &_outbox; }
+  const PushCoalescer* getCoalescer(PushTarget target) const {
+    return &_coalescer[target];
+  }
 
   Brewspy* getBrewspy() { return _brewspy; }
   HomeAssist* getHomeAssist() { return _ha; }
@@ -26,8 +26,10 @@ SOFTWARE.
 #include <kegpush.hpp>
 #include <kegwebhandler.hpp>
 #include <levels.hpp>
+#include <leveltask.hpp>
 #include <main.hpp>
 #include <scale.hpp>
+#include <scheduler.hpp>
 #include <temp_mgr.hpp>
 #include <uptime.hpp>
 #include <utils.hpp>
@@ -46,6 +48,10 @@ constexpr auto PARAM_SCALE = "scale_index";
 
 // Additional scale values
 constexpr auto PARAM_SCALE_BUSY = "scale_busy";
+constexpr auto PARAM_SCALE_CALIBRATION1 = "scale_calibration1";
+constexpr auto PARAM_SCALE_CALIBRATION2 = "scale_calibration2";
+constexpr auto PARAM_SCALE_PROGRESS1 = "scale_progress1";
+constexpr auto PARAM_SCALE_PROGRESS2 = "scale_progress2";
 constexpr auto PARAM_SCALE_WEIGHT1 = "scale_weight1";
 constexpr auto PARAM_SCALE_WEIGHT2 = "scale_weight2";
 constexpr auto PARAM_BEER_WEIGHT1 = "beer_weight1";
@@ -56,6 +62,8 @@ constexpr auto PARAM_SCALE_RAW1 = "scale_raw1";
 constexpr auto PARAM_SCALE_RAW2 = "scale_raw2";
 constexpr auto PARAM_GLASS1 = "glass1";
 constexpr auto PARAM_GLASS2 = "glass2";
+constexpr auto PARAM_POURING1 = "pouring1";
+constexpr auto PARAM_POURING2 = "pouring2";
 constexpr auto PARAM_SCALE_STABLE_WEIGHT1 = "scale_stable_weight1";
 constexpr auto PARAM_SCALE_STABLE_WEIGHT2 = "scale_stable_weight2";
 constexpr auto PARAM_LAST_POUR_WEIGHT1 = "last_pour_weight1";
@@ -65,6 +73,25 @@ constexpr auto PARAM_LAST_POUR_VOLUME2 = "last_pour_volume2";
 constexpr auto PARAM_SCALE_CONNECTED1 = "scale_connected1";
 constexpr auto PARAM_SCALE_CONNECTED2 = "scale_connected2";
 
+// Raw capture
+constexpr auto PARAM_CAPTURE_SECONDS = "seconds";
+constexpr auto PARAM_CAPTURE_RUNNING = "running";
+constexpr auto PARAM_CAPTURE_COUNT = "count";
+constexpr auto PARAM_CAPTURE_DROPPED = "dropped";
+constexpr auto PARAM_CAPTURE_CAPACITY = "capacity";
+
+// Scheduler statistics
+constexpr auto PARAM_TASKS = "tasks";
+constexpr auto PARAM_TASK_NAME = "name";
+constexpr auto PARAM_TASK_PERIOD = "period";
+constexpr auto PARAM_TASK_JITTER = "jitter";
+constexpr auto PARAM_TASK_RUNS = "runs";
+constexpr auto PARAM_TASK_LATE = "late";
+constexpr auto PARAM_TASK_SKIPPED = "skipped";
+constexpr auto PARAM_TASK_MAX_LATE = "max_late";
+constexpr auto PARAM_TASK_AVERAGE_TIME = "average_time";
+constexpr auto PARAM_TASK_MAX_TIME = "max_time";
+
 // Other values
 constexpr auto PARAM_TOTAL_HEAP = "total_heap";
 constexpr auto PARAM_FREE_HEAP = "free_heap";
@@ -99,6 +126,14 @@ constexpr auto PARAM_PUSH_AGE = "push_age";
 constexpr auto PARAM_PUSH_STATUS = "push_status";
 constexpr auto PARAM_PUSH_CODE = "push_code";
 constexpr auto PARAM_PUSH_RESPONSE = "push_response";
+constexpr auto PARAM_PUSH_DELIVERED = "push_delivered";
+constexpr auto PARAM_PUSH_FAILED = "push_failed";
+constexpr auto PARAM_PUSH_QUEUED = "push_queued";
+constexpr auto PARAM_PUSH_DROPPED = "push_dropped";
+constexpr auto PARAM_PUSH_PENDING = "push_pending";
+constexpr auto PARAM_PUSH_OUTBOX = "push_outbox";
+constexpr auto PARAM_PUSH_LOST = "push_lost";
+constexpr auto PARAM_PUSH_COALESCED = "push_coalesced";
 
 KegWebHandler::KegWebHandler(KegConfig *config) : BaseWebServer(config) {
   _config = config;
@@ -127,9 +162,31 @@ void KegWebHandler::setupWebHandlers() {
       std::bind(&KegWebHandler::webScaleFactor, this, std::placeholders::_1,
                 std::placeholders::_2));
   _server->addHandler(handler);
+  handler = new AsyncCallbackJsonWebHandler(
+      "/api/scale/point",
+      std::bind(&KegWebHandler::webScalePoint, this, std::placeholders::_1,
+                std::placeholders::_2));
+  _server->addHandler(handler);
   _server->on("/api/scale", HTTP_GET, [this](AsyncWebServerRequest *request) {
     this->webScale(request);
   });
+  handler = new AsyncCallbackJsonWebHandler(
+      "/api/capture/start",
+      std::bind(&KegWebHandler::webCaptureStart, this, std::placeholders::_1,
+                std::placeholders::_2));
+  _server->addHandler(handler);
+  _server->on("/api/capture/status", HTTP_GET,
+              [this](AsyncWebServerRequest *request) {
+                this->webCaptureStatus(request);
+              });
+  _server->on("/api/capture", HTTP_GET,
+              [this](AsyncWebServerRequest *request) {
+                this->webCaptureDownload(request);
+              });
+  _server->on("/api/scheduler", HTTP_GET,
+              [this](AsyncWebServerRequest *request) {
+                this->webScheduler(request);
+              });
   _server->on("/api/config", HTTP_GET, [this](AsyncWebServerRequest *request) {
     this->webConfigGet(request);
   });
@@ -335,9 +392,162 @@ void KegWebHandler::webScaleFactor(AsyncWebServerRequest *request,
   request->send(response);
 }
 
+void KegWebHandler::webScalePoint(AsyncWebServerRequest *request,
+                                  JsonVariant &json) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  JsonObject obj = json.as<JsonObject>();
+  UnitIndex idx;
+  float weight = convertIncomingWeight(obj[PARAM_WEIGHT].as<float>());
+
+  // Request will contain 1 or 2, but we need 0 or 1 for indexing.
+  if (obj[PARAM_SCALE].as<int>() == 1)
+    idx = UnitIndex::U1;
+  else
+    idx = UnitIndex::U2;
+
+  Log.notice(
+      F("WEB : webServer callback /api/scale/point, weight=%Fkg [%d]." CR),
+      weight, idx);
+
+  AsyncJsonResponse *response = new AsyncJsonResponse(false);
+  JsonObject obj2 = response->getRoot().as<JsonObject>();
+  obj2[PARAM_SUCCESS] = true;
+
+  // No weight removes the points and the scale factor is used again
+  if (weight > 0) {
+    myScale.scheduleAddPoint(idx, weight);
+    obj2[PARAM_MESSAGE] = "Scale calibration point is scheduled";
+  } else {
+    myScale.scheduleClearPoints(idx);
+    obj2[PARAM_MESSAGE] = "Scale calibration points removal is scheduled";
+  }
+
+  response->setLength();
+  request->send(response);
+}
+
+void KegWebHandler::webCaptureStart(AsyncWebServerRequest *request,
+                                    JsonVariant &json) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  JsonObject obj = json.as<JsonObject>();
+  uint32_t seconds = obj[PARAM_CAPTURE_SECONDS].as<uint32_t>();
+
+  Log.notice(F("WEB : webServer callback /api/capture/start, %d s." CR),
+             seconds);
+
+  RawCapture *capture = myScale.getCapture();
+  bool success = capture->start(seconds);
+
+  AsyncJsonResponse *response = new AsyncJsonResponse(false);
+  JsonObject obj2 = response->getRoot().as<JsonObject>();
+  obj2[PARAM_SUCCESS] = success;
+  if (success)
+    obj2[PARAM_MESSAGE] = "Capture started";
+  else if (capture->isReading())
+    obj2[PARAM_MESSAGE] = "Capture is being downloaded";
+  else
+    obj2[PARAM_MESSAGE] = "Capture not available or invalid time";
+  response->setLength();
+  request->send(response);
+}
+
+void KegWebHandler::webCaptureStatus(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  Log.notice(F("WEB : webServer callback /api/capture/status." CR));
+
+  const RawCapture *capture = myScale.getCapture();
+  AsyncJsonResponse *response = new AsyncJsonResponse(false);
+  JsonObject obj = response->getRoot().as<JsonObject>();
+  obj[PARAM_CAPTURE_RUNNING] = capture->isRunning();
+  obj[PARAM_CAPTURE_COUNT] = capture->count();
+  obj[PARAM_CAPTURE_DROPPED] = capture->dropped();
+  obj[PARAM_CAPTURE_CAPACITY] = capture->capacity();
+  response->setLength();
+  request->send(response);
+}
+
+void KegWebHandler::webScheduler(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  Log.notice(F("WEB : webServer callback /api/scheduler." CR));
+
+  AsyncJsonResponse *response = new AsyncJsonResponse(false);
+  JsonObject obj = response->getRoot().as<JsonObject>();
+  JsonArray tasks = obj[PARAM_TASKS].to<JsonArray>();
+
+  for (int i = 0; i < myScheduler.size(); i++) {
+    const SchedulerTask *t = myScheduler.getTask(i);
+    JsonObject task = tasks.add<JsonObject>();
+    task[PARAM_TASK_NAME] = t->name;
+    task[PARAM_TASK_PERIOD] = t->period;
+    task[PARAM_TASK_JITTER] = t->jitter;
+    task[PARAM_TASK_RUNS] = t->runs;
+    task[PARAM_TASK_LATE] = t->late;
+    task[PARAM_TASK_SKIPPED] = t->skipped;
+    task[PARAM_TASK_MAX_LATE] = t->maxLate;
+    task[PARAM_TASK_AVERAGE_TIME] = t->averageTime();
+    task[PARAM_TASK_MAX_TIME] = t->maxTime;
+  }
+
+  response->setLength();
+  request->send(response);
+}
+
+void KegWebHandler::webCaptureDownload(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  Log.notice(F("WEB : webServer callback /api/capture." CR));
+
+  RawCapture *capture = myScale.getCapture();
+
+  if (capture->isRunning()) {
+    request->send(409, "application/json",
+                  "{\"success\":false,\"message\":\"Capture is running\"}");
+    return;
+  }
+
+  // The records are copied from the ring buffer while the response is sent,
+  // no new capture can be started until the client is gone
+  capture->beginRead();
+  request->onDisconnect([capture]() { capture->endRead(); });
+
+  AsyncWebServerResponse *response = request->beginResponse(
+      "application/octet-stream", capture->size(),
+      [capture](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return capture->read(buffer, maxLen, index);
+      });
+  response->addHeader("Content-Disposition",
+                      "attachment; filename=\"capture.kgrc\"");
+  request->send(response);
+}
+
 void KegWebHandler::populateScaleJson(JsonObject &doc) {
+  LevelSnapshot levels;
+  myLevelTask.getSnapshot(levels);
+
   // This will return the raw weight so that that we get the actual values.
   doc[PARAM_SCALE_BUSY] = myScale.isScheduleRunning();
+  doc[PARAM_SCALE_CALIBRATION1] =
+      static_cast<int>(myScale.getCalibrationState(UnitIndex::U1));
+  doc[PARAM_SCALE_CALIBRATION2] =
+      static_cast<int>(myScale.getCalibrationState(UnitIndex::U2));
+  doc[PARAM_SCALE_PROGRESS1] = myScale.getCalibrationProgress(UnitIndex::U1);
+  doc[PARAM_SCALE_PROGRESS2] = myScale.getCalibrationProgress(UnitIndex::U2);
+  doc[PARAM_SCALE_POINTS1] = myConfig.getScalePointCount(UnitIndex::U1);
+  doc[PARAM_SCALE_POINTS2] = myConfig.getScalePointCount(UnitIndex::U2);
 
   doc[PARAM_SCALE_CONNECTED1] = myScale.isConnected(UnitIndex::U1);
   doc[PARAM_SCALE_CONNECTED2] = myScale.isConnected(UnitIndex::U2);
@@ -345,7 +555,7 @@ void KegWebHandler::populateScaleJson(JsonObject &doc) {
   doc[PARAM_SCALE_FACTOR1] = myConfig.getScaleFactor(UnitIndex::U1);
   doc[PARAM_SCALE_FACTOR2] = myConfig.getScaleFactor(UnitIndex::U2);
   if (myScale.isConnected(UnitIndex::U1)) {
-    float w = myLevelDetection.getTotalRawWeight(UnitIndex::U1);
+    float w = levels.getTotalRawWeight(UnitIndex::U1);
     if (!isnan(w)) {
       doc[PARAM_SCALE_WEIGHT1] = serialized(
           String(convertOutgoingWeight(w), myConfig.getWeightPrecision()));
@@ -353,18 +563,18 @@ void KegWebHandler::populateScaleJson(JsonObject &doc) {
     doc[PARAM_SCALE_RAW1] = myScale.readLastRaw(UnitIndex::U1);
     doc[PARAM_SCALE_OFFSET1] = myConfig.getScaleOffset(UnitIndex::U1);
 
-    w = myLevelDetection.getBeerWeight(UnitIndex::U1);
+    w = levels.getBeerWeight(UnitIndex::U1);
     if (!isnan(w)) {
       doc[PARAM_BEER_WEIGHT1] = serialized(
           String(convertOutgoingWeight(w), myConfig.getWeightPrecision()));
     }
     doc[PARAM_BEER_VOLUME1] = serialized(String(
-        convertOutgoingVolume(myLevelDetection.getBeerVolume(UnitIndex::U1)),
+        convertOutgoingVolume(levels.getBeerVolume(UnitIndex::U1)),
         myConfig.getVolumePrecision()));
   }
 
   if (myScale.isConnected(UnitIndex::U2)) {
-    float w = myLevelDetection.getTotalRawWeight(UnitIndex::U2);
+    float w = levels.getTotalRawWeight(UnitIndex::U2);
     if (!isnan(w)) {
       doc[PARAM_SCALE_WEIGHT2] = serialized(
           String(convertOutgoingWeight(w), myConfig.getWeightPrecision()));
@@ -372,45 +582,45 @@ void KegWebHandler::populateScaleJson(JsonObject &doc) {
     doc[PARAM_SCALE_RAW2] = myScale.readLastRaw(UnitIndex::U2);
     doc[PARAM_SCALE_OFFSET2] = myConfig.getScaleOffset(UnitIndex::U2);
 
-    w = myLevelDetection.getBeerWeight(UnitIndex::U2);
+    w = levels.getBeerWeight(UnitIndex::U2);
     if (!isnan(w)) {
       doc[PARAM_BEER_WEIGHT2] = serialized(
           String(convertOutgoingWeight(w), myConfig.getWeightPrecision()));
     }
     doc[PARAM_BEER_VOLUME2] = serialized(String(
-        convertOutgoingVolume(myLevelDetection.getBeerVolume(UnitIndex::U2)),
+        convertOutgoingVolume(levels.getBeerVolume(UnitIndex::U2)),
         myConfig.getVolumePrecision()));
   }
 
-  if (myLevelDetection.hasStableWeight(UnitIndex::U1)) {
+  if (levels.hasStableWeight(UnitIndex::U1)) {
     doc[PARAM_SCALE_STABLE_WEIGHT1] = serialized(
         String(convertOutgoingWeight(
-                   myLevelDetection.getTotalStableWeight(UnitIndex::U1)),
+                   levels.getTotalStableWeight(UnitIndex::U1)),
                myConfig.getWeightPrecision()));
   }
 
-  if (myLevelDetection.hasStableWeight(UnitIndex::U2)) {
+  if (levels.hasStableWeight(UnitIndex::U2)) {
     doc[PARAM_SCALE_STABLE_WEIGHT2] = serialized(
         String(convertOutgoingWeight(
-                   myLevelDetection.getTotalStableWeight(UnitIndex::U2)),
+                   levels.getTotalStableWeight(UnitIndex::U2)),
                myConfig.getWeightPrecision()));
   }
 
-  if (myLevelDetection.hasPourWeight(UnitIndex::U1)) {
+  if (levels.hasPourWeight(UnitIndex::U1)) {
     doc[PARAM_LAST_POUR_WEIGHT1] = serialized(String(
-        convertOutgoingWeight(myLevelDetection.getPourWeight(UnitIndex::U1)),
+        convertOutgoingWeight(levels.getPourWeight(UnitIndex::U1)),
         myConfig.getWeightPrecision()));
     doc[PARAM_LAST_POUR_VOLUME1] = serialized(String(
-        convertOutgoingVolume(myLevelDetection.getPourVolume(UnitIndex::U1)),
+        convertOutgoingVolume(levels.getPourVolume(UnitIndex::U1)),
         myConfig.getVolumePrecision()));
   }
 
-  if (myLevelDetection.hasPourWeight(UnitIndex::U2)) {
+  if (levels.hasPourWeight(UnitIndex::U2)) {
     doc[PARAM_LAST_POUR_WEIGHT2] = serialized(String(
-        convertOutgoingWeight(myLevelDetection.getPourWeight(UnitIndex::U2)),
+        convertOutgoingWeight(levels.getPourWeight(UnitIndex::U2)),
         myConfig.getWeightPrecision()));
     doc[PARAM_LAST_POUR_VOLUME2] = serialized(String(
-        convertOutgoingVolume(myLevelDetection.getPourVolume(UnitIndex::U2)),
+        convertOutgoingVolume(levels.getPourVolume(UnitIndex::U2)),
         myConfig.getVolumePrecision()));
   }
 
@@ -452,15 +662,21 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
 
   // For this we use the last value read from the scale to avoid having to much
   // communication. The value will be updated regulary second in the main loop.
-  if (myLevelDetection.hasStableWeight(UnitIndex::U1)) {
-    obj[PARAM_GLASS1] = serialized(
-        String(myLevelDetection.getNoStableGlasses(UnitIndex::U1), 1));
+  LevelSnapshot levels;
+  myLevelTask.getSnapshot(levels);
+
+  if (levels.hasStableWeight(UnitIndex::U1)) {
+    obj[PARAM_GLASS1] =
+        serialized(String(levels.getNoStableGlasses(UnitIndex::U1), 1));
   }
-  if (myLevelDetection.hasStableWeight(UnitIndex::U2)) {
-    obj[PARAM_GLASS2] = serialized(
-        String(myLevelDetection.getNoStableGlasses(UnitIndex::U2), 1));
+  if (levels.hasStableWeight(UnitIndex::U2)) {
+    obj[PARAM_GLASS2] =
+        serialized(String(levels.getNoStableGlasses(UnitIndex::U2), 1));
   }
 
+  obj[PARAM_POURING1] = levels.isPouring(UnitIndex::U1);
+  obj[PARAM_POURING2] = levels.isPouring(UnitIndex::U2);
+
   obj[PARAM_KEG_VOLUME1] =
       convertOutgoingVolume(myConfig.getKegVolume(UnitIndex::U1));
   obj[PARAM_KEG_VOLUME2] =
@@ -495,6 +711,11 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
 #endif
   obj[PARAM_WIFI_SETUP] = (runMode == RunMode::wifiSetupMode) ? true : false;
 
+  obj[PARAM_PUSH_QUEUED] = myPush.getQueued();
+  obj[PARAM_PUSH_DROPPED] = myPush.getDropped();
+  obj[PARAM_PUSH_OUTBOX] = myPush.getOutbox()->count();
+  obj[PARAM_PUSH_LOST] = myPush.getOutbox()->lost();
+
   // Home Assistant
   if (myConfig.hasTargetMqtt()) {
     JsonObject o = obj[PARAM_HOMEASSISTANT].to<JsonObject>();
@@ -505,6 +726,12 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
     o[PARAM_PUSH_CODE] = ha->getLastError();
     o[PARAM_PUSH_RESPONSE] = "";
     o[PARAM_PUSH_USED] = ha->hasRun();
+    o[PARAM_PUSH_DELIVERED] = ha->getDelivered();
+    o[PARAM_PUSH_FAILED] = ha->getFailed();
+    o[PARAM_PUSH_PENDING] =
+        myPush.getOutbox()->pending(PushTarget::PUSH_TARGET_HOMEASSIST);
+    o[PARAM_PUSH_COALESCED] =
+        myPush.getCoalescer(PushTarget::PUSH_TARGET_HOMEASSIST)->getCoalesced();
   }
 
   // Bar helper
@@ -517,6 +744,12 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
     o[PARAM_PUSH_CODE] = bar->getLastError();
     o[PARAM_PUSH_RESPONSE] = bar->getLastResponse();
     o[PARAM_PUSH_USED] = bar->hasRun();
+    o[PARAM_PUSH_DELIVERED] = bar->getDelivered();
+    o[PARAM_PUSH_FAILED] = bar->getFailed();
+    o[PARAM_PUSH_PENDING] =
+        myPush.getOutbox()->pending(PushTarget::PUSH_TARGET_BARHELPER);
+    o[PARAM_PUSH_COALESCED] =
+        myPush.getCoalescer(PushTarget::PUSH_TARGET_BARHELPER)->getCoalesced();
   }
 
   // Brewlogger helper
@@ -529,6 +762,12 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
     o[PARAM_PUSH_CODE] = blog->getLastError();
     o[PARAM_PUSH_RESPONSE] = blog->getLastResponse();
     o[PARAM_PUSH_USED] = blog->hasRun();
+    o[PARAM_PUSH_DELIVERED] = blog->getDelivered();
+    o[PARAM_PUSH_FAILED] = blog->getFailed();
+    o[PARAM_PUSH_PENDING] =
+        myPush.getOutbox()->pending(PushTarget::PUSH_TARGET_BREWLOGGER);
+    o[PARAM_PUSH_COALESCED] =
+        myPush.getCoalescer(PushTarget::PUSH_TARGET_BREWLOGGER)->getCoalesced();
   }
 
   // Brewspy
@@ -542,6 +781,12 @@ void KegWebHandler::webStatus(AsyncWebServerRequest *request) {
     o[PARAM_PUSH_CODE] = brew->getLastError();
     o[PARAM_PUSH_RESPONSE] = brew->getLastResponse();
     o[PARAM_PUSH_USED] = brew->hasRun();
+    o[PARAM_PUSH_DELIVERED] = brew->getDelivered();
+    o[PARAM_PUSH_FAILED] = brew->getFailed();
+    o[PARAM_PUSH_PENDING] =
+        myPush.getOutbox()->pending(PushTarget::PUSH_TARGET_BREWSPY);
+    o[PARAM_PUSH_COALESCED] =
+        myPush.getCoalescer(PushTarget::PUSH_TARGET_BREWSPY)->getCoalesced();
   }
 
   response->setLength();
@@ -571,39 +816,99 @@ void KegWebHandler::webStability(AsyncWebServerRequest *request) {
   constexpr auto PARAM_STABILITY_POPDEV2 = "stability_popdev2";
   constexpr auto PARAM_STABILITY_UBIASDEV1 = "stability_ubiasdev1";
   constexpr auto PARAM_STABILITY_UBIASDEV2 = "stability_ubiasdev2";
+  constexpr auto PARAM_STABILITY_REJECTED1 = "stability_rejected1";
+  constexpr auto PARAM_STABILITY_REJECTED2 = "stability_rejected2";
+  constexpr auto PARAM_STABILITY_TOTAL1 = "stability_total1";
+  constexpr auto PARAM_STABILITY_TOTAL2 = "stability_total2";
+  constexpr auto PARAM_STABILITY_VAR_1M1 = "stability_var_1m1";
+  constexpr auto PARAM_STABILITY_VAR_1M2 = "stability_var_1m2";
+  constexpr auto PARAM_STABILITY_VAR_1H1 = "stability_var_1h1";
+  constexpr auto PARAM_STABILITY_VAR_1H2 = "stability_var_1h2";
+  constexpr auto PARAM_STABILITY_VAR_24H1 = "stability_var_24h1";
+  constexpr auto PARAM_STABILITY_VAR_24H2 = "stability_var_24h2";
 
   AsyncJsonResponse *response = new AsyncJsonResponse(false);
   JsonObject obj = response->getRoot().as<JsonObject>();
 
-  Stability *stability1 = myLevelDetection.getStability(UnitIndex::U1);
-  Stability *stability2 = myLevelDetection.getStability(UnitIndex::U2);
+  LevelSnapshot levels;
+  myLevelTask.getSnapshot(levels);
+
+  const StabilitySnapshot &stability1 = levels.getStability(UnitIndex::U1);
+  const StabilitySnapshot &stability2 = levels.getStability(UnitIndex::U2);
 
   obj[PARAM_WEIGHT_UNIT] = myConfig.getWeightUnit();
 
   // TODO: Fix formatting of the stability values
 
-  if (stability1->count() > 1) {
-    obj[PARAM_STABILITY_COUNT1] = stability1->count();
-    obj[PARAM_STABILITY_SUM1] = stability1->sum();
-    obj[PARAM_STABILITY_MIN1] = stability1->min();
-    obj[PARAM_STABILITY_MAX1] = stability1->max();
-    obj[PARAM_STABILITY_AVE1] = stability1->average();
-    obj[PARAM_STABILITY_VAR1] = stability1->variance();
-    obj[PARAM_STABILITY_POPDEV1] = stability1->popStdev();
-    obj[PARAM_STABILITY_UBIASDEV1] = stability1->unbiasedStdev();
+  if (stability1.count > 1) {
+    obj[PARAM_STABILITY_COUNT1] = stability1.count;
+    obj[PARAM_STABILITY_SUM1] = stability1.sum;
+    obj[PARAM_STABILITY_MIN1] = stability1.min;
+    obj[PARAM_STABILITY_MAX1] = stability1.max;
+    obj[PARAM_STABILITY_AVE1] = stability1.average;
+    obj[PARAM_STABILITY_VAR1] = stability1.variance;
+    obj[PARAM_STABILITY_POPDEV1] = stability1.popStdev;
+    obj[PARAM_STABILITY_UBIASDEV1] = stability1.unbiasedStdev;
+    obj[PARAM_STABILITY_TOTAL1] = stability1.total;
+    obj[PARAM_STABILITY_VAR_1M1] =
+        stability1.periodVariance[StabilityPeriod::PERIOD_MINUTE];
+    obj[PARAM_STABILITY_VAR_1H1] =
+        stability1.periodVariance[StabilityPeriod::PERIOD_HOUR];
+    obj[PARAM_STABILITY_VAR_24H1] =
+        stability1.periodVariance[StabilityPeriod::PERIOD_DAY];
   }
 
-  if (stability2->count() > 1) {
-    obj[PARAM_STABILITY_COUNT2] = stability2->count();
-    obj[PARAM_STABILITY_SUM2] = stability2->sum();
-    obj[PARAM_STABILITY_MIN2] = stability2->min();
-    obj[PARAM_STABILITY_MAX2] = stability2->max();
-    obj[PARAM_STABILITY_AVE2] = stability2->average();
-    obj[PARAM_STABILITY_VAR2] = stability2->variance();
-    obj[PARAM_STABILITY_POPDEV2] = stability2->popStdev();
-    obj[PARAM_STABILITY_UBIASDEV2] = stability2->unbiasedStdev();
+  if (stability2.count > 1) {
+    obj[PARAM_STABILITY_COUNT2] = stability2.count;
+    obj[PARAM_STABILITY_SUM2] = stability2.sum;
+    obj[PARAM_STABILITY_MIN2] = stability2.min;
+    obj[PARAM_STABILITY_MAX2] = stability2.max;
+    obj[PARAM_STABILITY_AVE2] = stability2.average;
+    obj[PARAM_STABILITY_VAR2] = stability2.variance;
+    obj[PARAM_STABILITY_POPDEV2] = stability2.popStdev;
+    obj[PARAM_STABILITY_UBIASDEV2] = stability2.unbiasedStdev;
+    obj[PARAM_STABILITY_TOTAL2] = stability2.total;
+    obj[PARAM_STABILITY_VAR_1M2] =
+        stability2.periodVariance[StabilityPeriod::PERIOD_MINUTE];
+    obj[PARAM_STABILITY_VAR_1H2] =
+        stability2.periodVariance[StabilityPeriod::PERIOD_HOUR];
+    obj[PARAM_STABILITY_VAR_24H2] =
+        stability2.periodVariance[StabilityPeriod::PERIOD_DAY];
   }
 
+  obj[PARAM_STABILITY_REJECTED1] = levels.getRejectedCount(UnitIndex::U1);
+  obj[PARAM_STABILITY_REJECTED2] = levels.getRejectedCount(UnitIndex::U2);
+
+  constexpr auto PARAM_SAMPLER_MODE1 = "sampler_mode1";
+  constexpr auto PARAM_SAMPLER_MODE2 = "sampler_mode2";
+  constexpr auto PARAM_SAMPLER_COUNT1 = "sampler_count1";
+  constexpr auto PARAM_SAMPLER_COUNT2 = "sampler_count2";
+  constexpr auto PARAM_SAMPLER_INTERVAL1 = "sampler_interval1";
+  constexpr auto PARAM_SAMPLER_INTERVAL2 = "sampler_interval2";
+  constexpr auto PARAM_SAMPLER_RATE1 = "sampler_rate1";
+  constexpr auto PARAM_SAMPLER_RATE2 = "sampler_rate2";
+  constexpr auto PARAM_SAMPLER_NOISE1 = "sampler_noise1";
+  constexpr auto PARAM_SAMPLER_NOISE2 = "sampler_noise2";
+
+  const AdaptiveSampler *sampler1 = myScale.getSampler(UnitIndex::U1);
+  const AdaptiveSampler *sampler2 = myScale.getSampler(UnitIndex::U2);
+
+  obj[PARAM_SAMPLER_MODE1] = static_cast<int>(sampler1->getMode());
+  obj[PARAM_SAMPLER_COUNT1] = sampler1->getCount();
+  obj[PARAM_SAMPLER_INTERVAL1] = sampler1->getInterval();
+  if (!isnan(sampler1->getRate()))
+    obj[PARAM_SAMPLER_RATE1] = sampler1->getRate();
+  if (!isnan(sampler1->getNoise()))
+    obj[PARAM_SAMPLER_NOISE1] = sampler1->getNoise();
+
+  obj[PARAM_SAMPLER_MODE2] = static_cast<int>(sampler2->getMode());
+  obj[PARAM_SAMPLER_COUNT2] = sampler2->getCount();
+  obj[PARAM_SAMPLER_INTERVAL2] = sampler2->getInterval();
+  if (!isnan(sampler2->getRate()))
+    obj[PARAM_SAMPLER_RATE2] = sampler2->getRate();
+  if (!isnan(sampler2->getNoise()))
+    obj[PARAM_SAMPLER_NOISE2] = sampler2->getNoise();
+
   constexpr auto PARAM_LEVEL_RAW1 = "level_raw1";
   constexpr auto PARAM_LEVEL_RAW2 = "level_raw2";
   constexpr auto PARAM_LEVEL_KALMAN1 = "level_kalman1";
@@ -611,25 +916,19 @@ void KegWebHandler::webStability(AsyncWebServerRequest *request) {
   constexpr auto PARAM_LEVEL_STATISTIC1 = "level_stable1";
   constexpr auto PARAM_LEVEL_STATISTIC2 = "level_stable2";
 
-  if (myLevelDetection.getRawDetection(UnitIndex::U1)->hasRawValue())
-    obj[PARAM_LEVEL_RAW1] =
-        myLevelDetection.getRawDetection(UnitIndex::U1)->getRawValue();
-  if (myLevelDetection.getRawDetection(UnitIndex::U1)->hasKalmanValue())
-    obj[PARAM_LEVEL_KALMAN1] =
-        myLevelDetection.getRawDetection(UnitIndex::U1)->getKalmanValue();
-  if (myLevelDetection.getStatsDetection(UnitIndex::U1)->hasStableValue())
-    obj[PARAM_LEVEL_STATISTIC1] =
-        myLevelDetection.getStatsDetection(UnitIndex::U1)->getStableValue();
-
-  if (myLevelDetection.getRawDetection(UnitIndex::U2)->hasRawValue())
-    obj[PARAM_LEVEL_RAW2] =
-        myLevelDetection.getRawDetection(UnitIndex::U2)->getRawValue();
-  if (myLevelDetection.getRawDetection(UnitIndex::U2)->hasKalmanValue())
-    obj[PARAM_LEVEL_KALMAN2] =
-        myLevelDetection.getRawDetection(UnitIndex::U2)->getKalmanValue();
-  if (myLevelDetection.getStatsDetection(UnitIndex::U2)->hasStableValue())
-    obj[PARAM_LEVEL_STATISTIC2] =
-        myLevelDetection.getStatsDetection(UnitIndex::U2)->getStableValue();
+  if (!isnan(levels.getRawValue(UnitIndex::U1)))
+    obj[PARAM_LEVEL_RAW1] = levels.getRawValue(UnitIndex::U1);
+  if (!isnan(levels.getKalmanValue(UnitIndex::U1)))
+    obj[PARAM_LEVEL_KALMAN1] = levels.getKalmanValue(UnitIndex::U1);
+  if (!isnan(levels.getStableValue(UnitIndex::U1)))
+    obj[PARAM_LEVEL_STATISTIC1] = levels.getStableValue(UnitIndex::U1);
+
+  if (!isnan(levels.getRawValue(UnitIndex::U2)))
+    obj[PARAM_LEVEL_RAW2] = levels.getRawValue(UnitIndex::U2);
+  if (!isnan(levels.getKalmanValue(UnitIndex::U2)))
+    obj[PARAM_LEVEL_KALMAN2] = levels.getKalmanValue(UnitIndex::U2);
+  if (!isnan(levels.getStableValue(UnitIndex::U2)))
+    obj[PARAM_LEVEL_STATISTIC2] = levels.getStableValue(UnitIndex::U2);
 
   float f = myTemp.getLastTempC();
 
@@ -654,8 +953,8 @@ void KegWebHandler::webStabilityClear(AsyncWebServerRequest *request) {
 
   Log.notice(F("WEB : webServer callback /api/stability/clear." CR));
 
-  myLevelDetection.getStability(UnitIndex::U1)->clear();
-  myLevelDetection.getStability(UnitIndex::U2)->clear();
+  // Done by the level task since it's updating the values
+  myLevelTask.requestClearStability();
 
   AsyncJsonResponse *response = new AsyncJsonResponse(false);
   JsonObject obj = response->getRoot().as<JsonObject>();
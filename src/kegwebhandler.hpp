@@ -47,6 +47,11 @@ class KegWebHandler : public BaseWebServer {
   void webScale(AsyncWebServerRequest *request);
   void webScaleTare(AsyncWebServerRequest *request, JsonVariant &json);
   void webScaleFactor(AsyncWebServerRequest *request, JsonVariant &json);
+  void webScalePoint(AsyncWebServerRequest *request, JsonVariant &json);
+  void webCaptureStart(AsyncWebServerRequest *request, JsonVariant &json);
+  void webCaptureStatus(AsyncWebServerRequest *request);
+  void webCaptureDownload(AsyncWebServerRequest *request);
+  void webScheduler(AsyncWebServerRequest *request);
   void webHardwareScan(AsyncWebServerRequest *request);
   void webHardwareScanStatus(AsyncWebServerRequest *request);
   void webConfigGet(AsyncWebServerRequest *request);
@@ -0,0 +1,200 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_LEVELCUSUM_HPP_
+#define SRC_LEVELCUSUM_HPP_
+
+#include <Arduino.h>
+
+#include <kegconfig.hpp>
+#include <main.hpp>
+
+constexpr auto LEVEL_CUSUM_CONFIRM = 3;  // Samples to confirm a new plateau
+
+enum LevelCusumState { Searching = 0, Plateau = 1, Transition = 2 };
+
+class CusumLevelDetection {
+ private:
+  UnitIndex _idx;
+
+  // Current segment, running mean and two sided cumulative sums
+  double _mean = 0;
+  uint32_t _count = 0;
+  double _high = 0;
+  double _low = 0;
+
+  LevelCusumState _state = LevelCusumState::Searching;
+  float _stable = NAN;
+  float _pour = NAN;
+  bool _newPour = false;
+  bool _newStable = false;
+
+  CusumLevelDetection(const CusumLevelDetection &) = delete;
+  void operator=(const CusumLevelDetection &) = delete;
+
+  void startSegment() {
+    _mean = 0;
+    _count = 0;
+    _high = 0;
+    _low = 0;
+  }
+
+  // The smallest level change in the configuration is the shift we look for,
+  // half of it is allowed as drift and the full shift is the alarm limit.
+  float getShift() {
+    return fmin(myConfig.getScaleDeviationDecreaseValue(),
+                myConfig.getScaleDeviationIncreaseValue());
+  }
+
+  // Returns true if the value is a change point compared to the segment.
+  bool addToSegment(float v) {
+    float shift = getShift();
+    bool change = false;
+
+    if (_count > 0) {
+      double d = v - _mean;
+      _high = fmax(0.0, _high + d - shift / 2);
+      _low = fmax(0.0, _low - d - shift / 2);
+      change = _high > shift || _low > shift;
+    }
+
+    if (change) {
+      startSegment();
+    } else {
+      _count++;
+      _mean += (v - _mean) / _count;
+    }
+
+    if (!_count) {
+      _count = 1;
+      _mean = v;
+    }
+    return change;
+  }
+
+  void checkForLevelChange() {
+    float level = _mean;
+    float delta = level - _stable;
+
+    if (delta > myConfig.getScaleDeviationIncreaseValue()) {
+      Log.notice(F("LVL : Level has increased, adjusting from %F to %F "
+                   "[%d]." CR),
+                 _stable, level, _idx);
+      _stable = level;
+      _newStable = true;
+    } else if (-delta > myConfig.getScaleDeviationDecreaseValue()) {
+      Log.notice(F("LVL : Level has decreased, adjusting from %F to %F "
+                   "[%d]." CR),
+                 _stable, level, _idx);
+      _stable = level;
+      _pour = -delta;
+      _newStable = true;
+      _newPour = true;
+      Log.notice(F("LVL : Beer has been poured volume %F [%d]." CR), _pour,
+                 _idx);
+    }
+  }
+
+  // Online change point detection (two sided CUSUM) that splits the readings
+  // into plateaus and transitions in constant time per value. A pour is
+  // reported as soon as a new plateau is confirmed.
+ public:
+  explicit CusumLevelDetection(UnitIndex idx) { _idx = idx; }
+
+  // Levels that are kept over a restart, the segment is started over
+  struct Checkpoint {
+    float stable;
+    float pour;
+  };
+
+  Checkpoint getCheckpoint() { return {_stable, _pour}; }
+  void restoreCheckpoint(const Checkpoint &state) {
+    clear();
+    _stable = state.stable;
+    _pour = state.pour;
+    if (!isnan(_stable)) _state = LevelCusumState::Plateau;
+  }
+
+  bool hasStableValue() { return !isnan(_stable); }
+  bool hasPourValue() { return !isnan(_pour); }
+
+  float getValue() { return _count ? _mean : NAN; }
+  float getStableValue() { return _stable; }
+  float getPourValue() { return _pour; }
+  LevelCusumState getState() { return _state; }
+
+  bool newPourValue() { return _newPour; }
+  bool newStableValue() { return _newStable; }
+
+  void clear() {
+    startSegment();
+    _state = LevelCusumState::Searching;
+  }
+
+  float processValue(float v) {
+    _newPour = false;
+    _newStable = false;
+
+    if (isnan(v)) return NAN;
+
+    // While in a transition the new plateau starts over until the values are
+    // close, so values from the pour itself are not part of the level.
+    if (_state == LevelCusumState::Transition && _count &&
+        fabs(v - _mean) > getShift() / 2)
+      startSegment();
+
+    bool change = addToSegment(v);
+
+    switch (_state) {
+      case LevelCusumState::Searching:
+        if (_count > myConfig.getScaleStableCount()) {
+          _stable = _mean;
+          _newStable = true;
+          _state = LevelCusumState::Plateau;
+          Log.notice(F("LVL : Found a new stable value %F [%d]." CR), _stable,
+                     _idx);
+        }
+        break;
+
+      case LevelCusumState::Plateau:
+        if (change)
+          _state = LevelCusumState::Transition;
+        else
+          checkForLevelChange();  // Slow changes
+        break;
+
+      case LevelCusumState::Transition:
+        if (_count >= LEVEL_CUSUM_CONFIRM) {
+          checkForLevelChange();
+          _state = LevelCusumState::Plateau;
+        }
+        break;
+    }
+
+    return getValue();
+  }
+};
+
+#endif  // SRC_LEVELCUSUM_HPP_
+
+// EOF
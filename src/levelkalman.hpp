@@ -0,0 +1,246 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_LEVELKALMAN_HPP_
+#define SRC_LEVELKALMAN_HPP_
+
+#include <Arduino.h>
+
+#include <kegconfig.hpp>
+#include <main.hpp>
+
+constexpr auto LEVEL_KALMAN_RATE = 0.01;         // kg/s, level is changing
+constexpr auto LEVEL_KALMAN_GATE = 4.0;          // Std deviations for a step
+constexpr auto LEVEL_KALMAN_SETTLE = 2;          // Quiet samples to end change
+constexpr auto LEVEL_KALMAN_ACCEL = 0.00000001;  // Process noise (kg/s2)^2
+constexpr auto LEVEL_KALMAN_NOISE = 0.0001;      // Default measurement variance
+constexpr auto LEVEL_KALMAN_NOISE_MIN = 0.000001;
+constexpr auto LEVEL_KALMAN_INTERVAL = 2.0;  // Default sample interval (s)
+
+enum LevelKalmanState { Startup = 0, Stable = 1, Changing = 2 };
+
+class KalmanLevelDetection {
+ private:
+  UnitIndex _idx;
+
+  // Filter state (level in kg and rate in kg/s) and covariance
+  double _level = NAN;
+  double _rate = 0;
+  double _p00 = 0;
+  double _p01 = 0;
+  double _p11 = 0;
+  uint32_t _time = 0;
+
+  LevelKalmanState _state = LevelKalmanState::Startup;
+  int _settle = 0;
+  float _start = NAN;  // Stable level before the change started
+  float _stable = NAN;
+  float _pour = NAN;
+  bool _newPour = false;
+  bool _newStable = false;
+
+  KalmanLevelDetection(const KalmanLevelDetection &) = delete;
+  void operator=(const KalmanLevelDetection &) = delete;
+
+  // Returns true if the sample is a step that the model can not explain, the
+  // covariance is then opened up so the filter follows the new level.
+  bool filter(float v, double dt, double r) {
+    double q = LEVEL_KALMAN_ACCEL;
+
+    // Predict, constant rate model
+    _level += _rate * dt;
+    _p00 += dt * (2 * _p01 + dt * _p11) + q * dt * dt * dt * dt / 4;
+    _p01 += dt * _p11 + q * dt * dt * dt / 2;
+    _p11 += q * dt * dt;
+
+    double y = v - _level;
+    bool step = y * y > LEVEL_KALMAN_GATE * LEVEL_KALMAN_GATE * (_p00 + r);
+
+    if (step) {
+      _p00 = y * y;
+      _p01 = 0;
+      _p11 = (y / dt) * (y / dt);
+    }
+
+    // Update
+    double s = _p00 + r;
+    double k0 = _p00 / s;
+    double k1 = _p01 / s;
+
+    _level += k0 * y;
+    _rate += k1 * y;
+    _p11 -= k1 * _p01;
+    _p01 -= k0 * _p01;
+    _p00 -= k0 * _p00;
+    return step;
+  }
+
+  void checkForLevelChange(float level) {
+    float delta = level - _start;
+
+    if (delta > myConfig.getScaleDeviationIncreaseValue()) {
+      Log.notice(F("LVL : Level has increased, adjusting from %F to %F "
+                   "[%d]." CR),
+                 _start, level, _idx);
+      _stable = level;
+      _newStable = true;
+    } else if (-delta > myConfig.getScaleDeviationDecreaseValue()) {
+      Log.notice(F("LVL : Level has decreased, adjusting from %F to %F "
+                   "[%d]." CR),
+                 _start, level, _idx);
+      _stable = level;
+      _newStable = true;
+
+      _pour = -delta;
+      _newPour = true;
+      Log.notice(F("LVL : Beer has been poured volume %F [%d]." CR), _pour,
+                 _idx);
+    }
+  }
+
+  // Estimates the level and the rate of change with a two state kalman filter.
+  // A pour is detected when the rate or a step exceeds the limits and ends
+  // when the level has been quiet for a few samples.
+ public:
+  explicit KalmanLevelDetection(UnitIndex idx) { _idx = idx; }
+
+  // Filter state and levels that are kept over a restart
+  struct Checkpoint {
+    float level;
+    float rate;
+    float p00;
+    float p01;
+    float p11;
+    float stable;
+    float pour;
+  };
+
+  Checkpoint getCheckpoint() {
+    return {static_cast<float>(_level), static_cast<float>(_rate),
+            static_cast<float>(_p00),   static_cast<float>(_p01),
+            static_cast<float>(_p11),   _stable,
+            _pour};
+  }
+
+  // Time is the current time in ms, the next sample is predicted from it.
+  void restoreCheckpoint(const Checkpoint &state, uint32_t time) {
+    clear();
+    _stable = state.stable;
+    _pour = state.pour;
+    if (isnan(state.level)) return;
+
+    _level = state.level;
+    _rate = state.rate;
+    _p00 = state.p00;
+    _p01 = state.p01;
+    _p11 = state.p11;
+    _time = time;
+    if (!isnan(_stable)) _state = LevelKalmanState::Stable;
+  }
+
+  bool hasStableValue() { return !isnan(_stable); }
+  bool hasPourValue() { return !isnan(_pour); }
+  bool isPouring() {
+    return _state == LevelKalmanState::Changing && _level < _start;
+  }
+
+  float getValue() { return _level; }
+  float getRateValue() { return _rate; }
+  float getStableValue() { return _stable; }
+  float getPourValue() { return _pour; }
+  LevelKalmanState getState() { return _state; }
+
+  bool newPourValue() { return _newPour; }
+  bool newStableValue() { return _newStable; }
+
+  void clear() {
+    _level = NAN;
+    _rate = 0;
+    _state = LevelKalmanState::Startup;
+    _settle = 0;
+  }
+
+  // Value is the weight, noise the measured variance of the scale (NAN if
+  // not known) and time the sample time in ms.
+  float processValue(float v, float noise, uint32_t time) {
+    _newPour = false;
+    _newStable = false;
+
+    if (isnan(v)) return NAN;
+
+    double r = isnan(noise) ? LEVEL_KALMAN_NOISE : noise;
+    if (r < LEVEL_KALMAN_NOISE_MIN) r = LEVEL_KALMAN_NOISE_MIN;
+
+    if (isnan(_level)) {
+      _level = v;
+      _rate = 0;
+      _p00 = r;
+      _p01 = 0;
+      _p11 = 1;
+      _time = time;
+      return _level;
+    }
+
+    double dt = (time - _time) / 1000.0;
+    if (dt <= 0) dt = LEVEL_KALMAN_INTERVAL;
+    _time = time;
+
+    bool step = filter(v, dt, r);
+    bool moving = step || fabs(_rate) > LEVEL_KALMAN_RATE;
+
+    _settle = moving ? 0 : _settle + 1;
+
+    switch (_state) {
+      case LevelKalmanState::Startup:
+        if (_settle >= static_cast<int>(myConfig.getScaleStableCount())) {
+          _stable = _level;
+          _newStable = true;
+          _state = LevelKalmanState::Stable;
+          Log.notice(F("LVL : Found a new stable value %F [%d]." CR), _stable,
+                     _idx);
+        }
+        break;
+
+      case LevelKalmanState::Stable:
+        _start = _stable;
+        if (moving)
+          _state = LevelKalmanState::Changing;
+        else
+          checkForLevelChange(_level);  // Slow changes
+        break;
+
+      case LevelKalmanState::Changing:
+        if (_settle >= LEVEL_KALMAN_SETTLE) {
+          checkForLevelChange(_level);
+          _state = LevelKalmanState::Stable;
+        }
+        break;
+    }
+
+    return _level;
+  }
+};
+
+#endif  // SRC_LEVELKALMAN_HPP_
+
+// EOF
@@ -26,28 +26,41 @@ SOFTWARE.
 
 #include <Arduino.h>
 #include <SimpleKalmanFilter.h>
-#include <tinyexpr.h>
 
+#include <hampel.hpp>
 #include <kegconfig.hpp>
 #include <main.hpp>
+#include <rollingwindow.hpp>
+#include <tempcompensation.hpp>
 #include <utils.hpp>
 
+constexpr auto RAW_OUTLIER_WINDOW = 5;
+constexpr auto KALMAN_ADAPTIVE_WEIGHT = 0.05;  // Weight of a new noise value
+constexpr auto KALMAN_ADAPTIVE_MIN = 0.000001;  // Lowest measurement error
+
 class RawLevelDetection {
  private:
   UnitIndex _idx;
 
-  // Raw values
-  static const int _cnt = 10;
-  static const int _validCnt = 5;
-  float _history[_cnt];
+  // Raw values, outliers are replaced before they are used
+  RollingWindow<RAW_WINDOW_MAX> _history;
+  HampelFilter<RAW_OUTLIER_WINDOW> _outlier;
+  uint32_t _rejected = 0;
   float _last = NAN;
 
-  // Kalman filter
+  // Kalman filter, the parameters are read from the configuration and applied
+  // to the running filter when they change.
   float _kalman = NAN;
-  SimpleKalmanFilter *_kalmanFilter = 0;
+  SimpleKalmanFilter _kalmanFilter;
+  float _kalmanMea = NAN;
+  float _kalmanEst = NAN;
+  float _kalmanNoise = NAN;
+  float _noise = NAN;  // Measured variance of the scale when stable
+  bool _restored = false;  // Estimate restored from a checkpoint
 
   // Temperature correction filter
   float _tempCorr = NAN;
+  TempCompensation _tempComp;
 
   // Slope filter
   float _slope = NAN;
@@ -55,23 +68,91 @@ class RawLevelDetection {
   RawLevelDetection(const RawLevelDetection &) = delete;
   void operator=(const RawLevelDetection &) = delete;
 
+  void updateNoise() {
+    // Only use windows without a level change so pours are not seen as noise.
+    if (!_history.isFull() ||
+        fabs(_slope) > myConfig.getScaleKalmanDeviationValue())
+      return;
+
+    float v = _history.variance();
+    if (isnan(v)) return;
+
+    _noise = isnan(_noise) ? v : _noise + KALMAN_ADAPTIVE_WEIGHT * (v - _noise);
+  }
+
+  void configureKalman() {
+    float mea = myConfig.getKalmanMeasurement();
+    float est = myConfig.getKalmanEstimation();
+    float noise = myConfig.getKalmanNoise();
+
+    if (myConfig.isKalmanAdaptive() && !isnan(_noise))
+      mea = _noise < KALMAN_ADAPTIVE_MIN ? KALMAN_ADAPTIVE_MIN : _noise;
+
+    if (mea != _kalmanMea) {
+      _kalmanFilter.setMeasurementError(mea);
+      _kalmanMea = mea;
+    }
+    if (est != _kalmanEst) {
+      _kalmanFilter.setEstimateError(est);
+      _kalmanEst = est;
+    }
+    if (noise != _kalmanNoise) {
+      _kalmanFilter.setProcessNoise(noise);
+      _kalmanNoise = noise;
+    }
+  }
+
   // Stores the last n raw values to smooth out any faulty readings. Can be used
   // as a baseline/reference for other level detection methods.
  public:
-  RawLevelDetection(UnitIndex idx, float kalmanMea, float _kalmanEst,
-                    float kalmanNoise) {
+  // Filter state that is kept over a restart
+  struct Checkpoint {
+    float estimate;
+    float estimateError;
+    float noise;
+  };
+
+  // The filter parameters are set from the configuration on the first value
+  explicit RawLevelDetection(UnitIndex idx) : _kalmanFilter(1, 1, 1) {
+    _history.setSize(10);
     clear();
     _idx = idx;
-    _kalmanFilter = new SimpleKalmanFilter(kalmanMea, _kalmanEst, kalmanNoise);
   }
 
   bool hasRawValue() { return isnan(_last) ? false : true; }
-  bool hasAverageValue() { return count() >= _validCnt ? true : false; }
+  bool hasAverageValue() {
+    return count() >= (_history.size() + 1) / 2 ? true : false;
+  }
   float getRawValue() { return _last; }
   float getAverageValue() { return average(); }
 
   bool hasKalmanValue() { return isnan(_kalman) ? false : true; }
   float getKalmanValue() { return _kalman; }
+  float getKalmanMeasurementError() { return _kalmanMea; }
+  float getNoiseValue() { return _noise; }
+
+  Checkpoint getCheckpoint() {
+    return {_kalman, _kalmanFilter.getEstimateError(), _noise};
+  }
+
+  // The filter only exposes setters for the errors, so the estimate is seeded
+  // with a single update that has no measurement error.
+  void restoreCheckpoint(const Checkpoint &state) {
+    if (isnan(state.estimate)) return;
+
+    _noise = state.noise;
+    configureKalman();
+    _kalmanFilter.setMeasurementError(0);
+    _kalmanFilter.setEstimateError(1);
+    _kalmanFilter.updateEstimate(state.estimate);
+    _kalmanFilter.setEstimateError(state.estimateError);
+    _kalmanMea = NAN;  // Apply the measurement error again on the next value
+    _kalman = state.estimate;
+    _restored = true;
+  }
+
+  uint32_t getRejectedCount() { return _rejected; }
+  void clearRejectedCount() { _rejected = 0; }
 
   bool hasTempCorrValue() { return isnan(_tempCorr) ? false : true; }
   float getTempCorrValue() { return _tempCorr; }
@@ -82,69 +163,62 @@ class RawLevelDetection {
   bool slopeSinking() { return _slope < 0.0 ? true : false; }
 
   void clear() {
-    for (int i = 0; i < _cnt; i++) _history[i] = NAN;
+    _history.clear();
+    _outlier.clear();
     _last = NAN;
     _kalman = NAN;
     _tempCorr = NAN;
+    _restored = false;
   }
   void add(float v, float temp) {
-    // Raw values
-    for (int i = _cnt - 1; i > 0; i--) _history[i] = _history[i - 1];
-    _history[0] = v;
+    bool outlier;
+    float o = v;
+
+    v = _outlier.filter(v, myConfig.getScaleOutlierLimit(), outlier);
+    if (outlier) {
+      _rejected++;
+      Log.notice(F("LVL : Outlier %F replaced with %F [%d]." CR), o, v, _idx);
+    }
+
+    // Raw values, a change of the window size will restart the history
+    _history.setSize(myConfig.getScaleRawWindow());
+    _history.add(v);
     _last = v;
 
     // Temperature correction
     _tempCorr = NAN;
-    const char *formula = myConfig.getScaleTempCompensationFormula(_idx);
-
-    if (strlen(formula) > 0) {
-      double weight = v;
-      double tempC = temp;
-      double tempF = convertCtoF(tempC);
-      int err;
-      te_variable vars[] = {
-          {"weight", &weight}, {"tempC", &tempC}, {"tempF", &tempF}};
-      te_expr *expr = te_compile(formula, vars, 3, &err);
-
-      if (expr) {
-        _tempCorr = te_eval(expr);
-        te_free(expr);
-      }
-
+    if (_tempComp.compile(myConfig.getScaleTempCompensationFormula(_idx))) {
+      _tempCorr = _tempComp.calculate(v, temp);
       Log.notice(F("LVL : %F -> %F" CR), v, _tempCorr);
     }
 
     // Slope calculation
-    if (count() == _cnt) {
-      _slope = _history[0] - _history[_cnt - 1];
+    if (count() == _history.size()) {
+      _slope = _history.newest() - _history.oldest();
     }
 
-    // Kalman filter
-    float k = _kalmanFilter->updateEstimate(isnan(_tempCorr) ? v : _tempCorr);
-    if (hasAverageValue()) {  // Only present value when we have enough sensor
-                              // reads
+    // Kalman filter, when disabled the value is passed through
+    float in = isnan(_tempCorr) ? v : _tempCorr;
+    float k = in;
+
+    updateNoise();
+
+    if (myConfig.isKalmanActive()) {
+      configureKalman();
+      k = _kalmanFilter.updateEstimate(in);
+    }
+
+    if (hasAverageValue() ||
+        _restored) {  // Only present value when we have enough sensor reads
       _kalman = k;
       // Log.notice(F("LVL : Kalman value %F, esterr=%F, gain=%F" CR), k,
-      // _kalmanFilter->getEstimateError(), _kalmanFilter->getKalmanGain());
+      // _kalmanFilter.getEstimateError(), _kalmanFilter.getKalmanGain());
     }
   }
-  float sum() {
-    float sum = 0;
-    for (int i = 0; i < _cnt; i++)
-      if (!isnan(_history[i])) sum += _history[i];
-    return sum;
-  }
-  float average() {
-    int cnt = count();
-    if (cnt == 0) return NAN;
-    return sum() / cnt;
-  }
-  int count() {
-    float cnt = 0;
-    for (int i = 0; i < _cnt; i++)
-      if (!isnan(_history[i])) cnt += 1;
-    return cnt;
-  }
+  float sum() { return _history.sum(); }
+  float average() { return _history.average(); }
+  int count() { return _history.count(); }
+  int windowSize() { return _history.size(); }
 };
 
 #endif  // SRC_LEVELRAW_HPP_
@@ -22,20 +22,24 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
 #include <cstdio>
-#include <kegpush.hpp>
 #include <levels.hpp>
 #include <perf.hpp>
-#include <scale.hpp>
-#include <temp_mgr.hpp>
+#if !defined(KEGMON_NATIVE)
+#include <kegpush.hpp>
+#endif
 
 // Used for introduce noise on the signal to see if it accurate enough
 // #define ENABLE_ADDING_NOISE
 
 LevelDetection::LevelDetection() {
-  _rawLevel[0] = new RawLevelDetection(UnitIndex::U1, 0.001, 0.001, 0.001);
-  _rawLevel[1] = new RawLevelDetection(UnitIndex::U2, 0.001, 0.001, 0.001);
+  _rawLevel[0] = new RawLevelDetection(UnitIndex::U1);
+  _rawLevel[1] = new RawLevelDetection(UnitIndex::U2);
   _statsLevel[0] = new StatsLevelDetection(UnitIndex::U1);
   _statsLevel[1] = new StatsLevelDetection(UnitIndex::U2);
+  _kalmanLevel[0] = new KalmanLevelDetection(UnitIndex::U1);
+  _kalmanLevel[1] = new KalmanLevelDetection(UnitIndex::U2);
+  _cusumLevel[0] = new CusumLevelDetection(UnitIndex::U1);
+  _cusumLevel[1] = new CusumLevelDetection(UnitIndex::U2);
 #if defined(ENABLE_ADDING_NOISE)
   randomSeed(12345L);
 #endif
@@ -56,37 +60,211 @@ void LevelDetection::update(UnitIndex idx, float raw, float temp) {
   raw += err / 20;  // 5%
 #endif
 
-  _stability[idx].add(raw);
+  if (_statePending[idx]) checkRestore(idx, raw);
 
   PERF_BEGIN("level-filter-raw");
   _rawLevel[idx]->add(raw, temp);
+  raw = _rawLevel[idx]->getRawValue();  // Outliers are replaced
   float average = _rawLevel[idx]->getAverageValue();
   float tempCorr = _rawLevel[idx]->getTempCorrValue();
   float slope = _rawLevel[idx]->getSlopeValue();
   PERF_END("level-filter-raw");
 
+  _stability[idx].add(raw);
+
   PERF_BEGIN("level-filter-stats");
   float stats = getStatsDetection(idx)->processValue(
       raw, getRawDetection(idx)->getKalmanValue());
+  PERF_END("level-filter-stats");
+
+  PERF_BEGIN("level-filter-kalman");
+  getKalmanDetection(idx)->processValue(isnan(tempCorr) ? raw : tempCorr,
+                                        getRawDetection(idx)->getNoiseValue(),
+                                        millis());
+  PERF_END("level-filter-kalman");
 
-  if (getStatsDetection(idx)->newPourValue())
+  PERF_BEGIN("level-filter-cusum");
+  getCusumDetection(idx)->processValue(isnan(tempCorr) ? raw : tempCorr);
+  PERF_END("level-filter-cusum");
+
+  if (hasNewPourWeight(idx))
     pushPourUpdate(idx, getBeerStableVolume(idx), getPourVolume(idx));
 
-  if (getStatsDetection(idx)->newStableValue())
+  if (hasNewStableWeight(idx))
     pushKegUpdate(idx, getBeerStableVolume(idx), getPourVolume(idx),
                   getNoStableGlasses(idx));
-  PERF_END("level-filter-stats");
+
+  checkpoint(idx);
 
   Log.verbose(F("LVL : raw=%F, ave=%F, temp=%F, stat=%F, slope=%F [%d]." CR),
               raw, average, tempCorr, stats, slope, idx);
 }
 
+void LevelDetection::getSnapshot(LevelSnapshot& snapshot) {
+  for (int i = 0; i < 2; i++) {
+    UnitIndex idx = static_cast<UnitIndex>(i);
+    LevelTapSnapshot& tap = snapshot.tap[i];
+
+    for (int t = 0; t < LEVELS_TYPES; t++) {
+      LevelDetectionType type = static_cast<LevelDetectionType>(t);
+      tap.hasStable[t] = hasStableWeight(idx, type);
+      tap.hasPour[t] = hasPourWeight(idx, type);
+      tap.total[t] = getTotalWeight(idx, type);
+      tap.totalStable[t] = getTotalStableWeight(idx, type);
+      tap.pour[t] = getPourWeight(idx, type);
+    }
+
+    tap.raw = getRawDetection(idx)->getRawValue();
+    tap.average = getRawDetection(idx)->getAverageValue();
+    tap.kalman = getRawDetection(idx)->getKalmanValue();
+    tap.stable = getStatsDetection(idx)->getStableValue();
+    tap.pouring = getKalmanDetection(idx)->isPouring();
+    tap.slope = getRawDetection(idx)->getSlopeValue();
+    tap.rejected = getRawDetection(idx)->getRejectedCount();
+    tap.statsAverage = getStatsDetection(idx)->ave();
+    tap.statsMin = getStatsDetection(idx)->min();
+    tap.statsMax = getStatsDetection(idx)->max();
+
+    Stability* s = getStability(idx);
+    StabilitySnapshot& st = tap.stability;
+    st.count = s->count();
+    st.total = s->total();
+    st.sum = s->sum();
+    st.min = s->min();
+    st.max = s->max();
+    st.average = s->average();
+    st.variance = s->variance();
+    st.popStdev = s->popStdev();
+    st.unbiasedStdev = s->unbiasedStdev();
+    for (int p = 0; p < STABILITY_EWMA_COUNT; p++)
+      st.periodVariance[p] = s->variance(static_cast<StabilityPeriod>(p));
+  }
+}
+
+void LevelDetection::clearStability() {
+  for (int i = 0; i < 2; i++) {
+    UnitIndex idx = static_cast<UnitIndex>(i);
+    getStability(idx)->clear();
+    getRawDetection(idx)->clearRejectedCount();
+  }
+}
+
+void LevelDetection::checkRestore(UnitIndex idx, float raw) {
+  _stateSum[idx] += raw;
+  if (++_stateReads[idx] < LEVELS_RESTORE_READS) return;
+
+  _statePending[idx] = false;
+
+  // A change smaller than the limit would not be detected as a new level
+  const LevelTapState& tap = _state.tap[idx];
+  float delta = fabs(_stateSum[idx] / _stateReads[idx] - tap.raw.estimate);
+  float limit = fmin(myConfig.getScaleDeviationDecreaseValue(),
+                     myConfig.getScaleDeviationIncreaseValue());
+
+  if (delta > limit) {
+    Log.notice(F("LVL : Weight differs %F from the saved levels, starting "
+                 "over [%d]." CR),
+               delta, idx);
+    return;
+  }
+
+  getRawDetection(idx)->restoreCheckpoint(tap.raw);
+  getStatsDetection(idx)->restoreCheckpoint(tap.stats);
+  getKalmanDetection(idx)->restoreCheckpoint(tap.kalman, millis());
+  getCusumDetection(idx)->restoreCheckpoint(tap.cusum);
+  Log.notice(F("LVL : Restored saved levels, weight=%F [%d]." CR),
+             tap.raw.estimate, idx);
+}
+
+void LevelDetection::checkpoint(UnitIndex idx) {
+  for (auto type : {LevelDetectionType::STATS, LevelDetectionType::KALMAN,
+                    LevelDetectionType::CUSUM}) {
+    if (hasNewStableWeight(idx, type) || hasNewPourWeight(idx, type))
+      _stateChanged = true;
+  }
+
+  // Only save when a level has changed and not too often to save the flash
+  if (!_stateEnabled || !_stateChanged ||
+      (millis() - _stateSaved) < LEVELS_STATE_INTERVAL)
+    return;
+
+  saveState();
+}
+
+bool LevelDetection::loadState() {
+  _stateEnabled = true;
+
+  if (!LittleFS.exists(LEVELS_STATE_FILENAME)) {
+    Log.notice(F("LVL : No saved levels found." CR));
+    return false;
+  }
+
+  LevelState state;
+  File f = LittleFS.open(LEVELS_STATE_FILENAME, "r");
+  size_t n = f ? f.read(reinterpret_cast<uint8_t*>(&state), sizeof(state)) : 0;
+  if (f) f.close();
+
+  if (n != sizeof(state) || state.magic != LEVELS_STATE_MAGIC ||
+      state.version != LEVELS_STATE_VERSION || state.size != sizeof(state)) {
+    Log.error(F("LVL : Saved levels are not valid, ignoring them." CR));
+    return false;
+  }
+
+  _state = state;
+
+  for (int i = 0; i < 2; i++) {
+    _statePending[i] = !isnan(_state.tap[i].raw.estimate);
+    _stateReads[i] = 0;
+    _stateSum[i] = 0;
+  }
+
+  Log.notice(F("LVL : Loaded saved levels, waiting for scale reads." CR));
+  return true;
+}
+
+bool LevelDetection::saveState() {
+  _state.magic = LEVELS_STATE_MAGIC;
+  _state.version = LEVELS_STATE_VERSION;
+  _state.size = sizeof(_state);
+
+  // A tap that is not yet validated keeps the loaded state
+  for (int i = 0; i < 2; i++) {
+    if (_statePending[i]) continue;
+
+    UnitIndex idx = static_cast<UnitIndex>(i);
+    LevelTapState& tap = _state.tap[i];
+    tap.raw = getRawDetection(idx)->getCheckpoint();
+    tap.stats = getStatsDetection(idx)->getCheckpoint();
+    tap.kalman = getKalmanDetection(idx)->getCheckpoint();
+    tap.cusum = getCusumDetection(idx)->getCheckpoint();
+  }
+
+  _stateSaved = millis();
+  _stateChanged = false;
+
+  File f = LittleFS.open(LEVELS_STATE_FILENAME, "w");
+
+  if (!f) {
+    Log.error(F("LVL : Failed to save levels." CR));
+    return false;
+  }
+
+  size_t n = f.write(reinterpret_cast<const uint8_t*>(&_state), sizeof(_state));
+  f.close();
+  Log.notice(F("LVL : Saved levels." CR));
+  return n == sizeof(_state);
+}
+
 void LevelDetection::pushKegUpdate(UnitIndex idx, float stableVol,
                                    float pourVol, float glasses) {
-  myPush.pushKegInformation(idx, stableVol, pourVol, glasses);
   // Log.notice(F("LEVL: New level found: vol=%F, pour=%F [%d]." CR), stableVol,
   // pourVol, idx);
 
+  // The host tools run many replays in parallel in the same directory, so
+  // only the device logs the levels.
+#if !defined(KEGMON_NATIVE)
+  myPush.queueKegInformation(idx, stableVol, pourVol, glasses);
+
   switch (idx) {
     case UnitIndex::U1:
       logLevels(stableVol, NAN, NAN, NAN);
@@ -96,13 +274,15 @@ void LevelDetection::pushKegUpdate(UnitIndex idx, float stableVol,
       logLevels(NAN, stableVol, NAN, NAN);
       break;
   }
+#endif
 }
 
 void LevelDetection::pushPourUpdate(UnitIndex idx, float stableVol,
                                     float pourVol) {
-  myPush.pushPourInformation(idx, stableVol, pourVol);
   // Log.notice(F("LEVL: New pour found: vol=%F, pour=%F [%d]." CR), stableVol,
   // pourVol, idx);
+#if !defined(KEGMON_NATIVE)
+  myPush.queuePourInformation(idx, stableVol, pourVol);
 
   switch (idx) {
     case UnitIndex::U1:
@@ -113,6 +293,7 @@ void LevelDetection::pushPourUpdate(UnitIndex idx, float stableVol,
       logLevels(NAN, stableVol, NAN, pourVol);
       break;
   }
+#endif
 }
 
 void LevelDetection::logLevels(float kegVolume1, float kegVolume2,
@@ -170,6 +351,12 @@ bool LevelDetection::hasStableWeight(UnitIndex idx, LevelDetectionType type) {
     case LevelDetectionType::STATS:
       f = getStatsDetection(idx)->hasStableValue();
       break;
+    case LevelDetectionType::KALMAN:
+      f = getKalmanDetection(idx)->hasStableValue();
+      break;
+    case LevelDetectionType::CUSUM:
+      f = getCusumDetection(idx)->hasStableValue();
+      break;
   }
 
   // Log.notice(F("LVL : StableWeight %s [%d]" CR), f ? "true" : "false", idx);
@@ -186,12 +373,49 @@ bool LevelDetection::hasPourWeight(UnitIndex idx, LevelDetectionType type) {
     case LevelDetectionType::STATS:
       f = getStatsDetection(idx)->hasPourValue();
       break;
+    case LevelDetectionType::KALMAN:
+      f = getKalmanDetection(idx)->hasPourValue();
+      break;
+    case LevelDetectionType::CUSUM:
+      f = getCusumDetection(idx)->hasPourValue();
+      break;
   }
 
   // Log.notice(F("LVL : PourWeight %s [%d]" CR), f ? "true" : "false", idx);
   return f;
 }
 
+bool LevelDetection::hasNewStableWeight(UnitIndex idx,
+                                        LevelDetectionType type) {
+  switch (type) {
+    case LevelDetectionType::RAW:
+      break;
+    case LevelDetectionType::STATS:
+      return getStatsDetection(idx)->newStableValue();
+    case LevelDetectionType::KALMAN:
+      return getKalmanDetection(idx)->newStableValue();
+    case LevelDetectionType::CUSUM:
+      return getCusumDetection(idx)->newStableValue();
+  }
+
+  return false;
+}
+
+bool LevelDetection::hasNewPourWeight(UnitIndex idx, LevelDetectionType type) {
+  switch (type) {
+    case LevelDetectionType::RAW:
+      break;
+    case LevelDetectionType::STATS:
+      return getStatsDetection(idx)->newPourValue();
+    case LevelDetectionType::KALMAN:
+      return getKalmanDetection(idx)->newPourValue();
+    case LevelDetectionType::CUSUM:
+      return getCusumDetection(idx)->newPourValue();
+  }
+
+  return false;
+}
+
 float LevelDetection::getBeerWeight(UnitIndex idx, LevelDetectionType type) {
   float w = getTotalWeight(idx, type);
   // Log.notice(F("LVL : BeerWeight %F [%d]" CR), w, idx);
@@ -224,6 +448,12 @@ float LevelDetection::getPourWeight(UnitIndex idx, LevelDetectionType type) {
     case LevelDetectionType::STATS:
       w = getStatsDetection(idx)->getPourValue();
       break;
+    case LevelDetectionType::KALMAN:
+      w = getKalmanDetection(idx)->getPourValue();
+      break;
+    case LevelDetectionType::CUSUM:
+      w = getCusumDetection(idx)->getPourValue();
+      break;
   }
 
   // Log.notice(F("LVL : PourWeight %F [%d]" CR), w, idx);
@@ -244,6 +474,12 @@ float LevelDetection::getTotalWeight(UnitIndex idx, LevelDetectionType type) {
     case LevelDetectionType::STATS:
       w = getStatsDetection(idx)->getValue();
       break;
+    case LevelDetectionType::KALMAN:
+      w = getKalmanDetection(idx)->getValue();
+      break;
+    case LevelDetectionType::CUSUM:
+      w = getCusumDetection(idx)->getValue();
+      break;
   }
 
   // Log.notice(F("LVL : TotalWeight %F [%d]" CR), w, idx);
@@ -261,6 +497,12 @@ float LevelDetection::getTotalStableWeight(UnitIndex idx,
     case LevelDetectionType::STATS:
       w = getStatsDetection(idx)->getStableValue();
       break;
+    case LevelDetectionType::KALMAN:
+      w = getKalmanDetection(idx)->getStableValue();
+      break;
+    case LevelDetectionType::CUSUM:
+      w = getCusumDetection(idx)->getStableValue();
+      break;
   }
 
   // Log.notice(F("LVL : TotalStableWeight %F [%d]" CR), w, idx);
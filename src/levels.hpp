@@ -27,18 +27,180 @@ SOFTWARE.
 #include <Arduino.h>
 
 #include <kegconfig.hpp>
+#include <levelcusum.hpp>
+#include <levelkalman.hpp>
 #include <levelraw.hpp>
 #include <levelstatistic.hpp>
 #include <stability.hpp>
 #include <weightvolume.hpp>
 
 constexpr auto LEVELS_FILEMAXSIZE = 2000;
+constexpr auto LEVELS_STATE_MAGIC = 0x534c474b;  // KGLS
+constexpr auto LEVELS_STATE_VERSION = 1;
+constexpr auto LEVELS_STATE_INTERVAL = 60 * 1000;  // Minimum ms between saves
+constexpr auto LEVELS_RESTORE_READS = 2;  // Reads used to validate a restore
+constexpr auto LEVELS_TYPES = LevelDetectionType::CUSUM + 1;
+
+// Detector state for both taps that is saved to the file system so the levels
+// are known directly after a restart.
+struct LevelTapState {
+  RawLevelDetection::Checkpoint raw;
+  StatsLevelDetection::Checkpoint stats;
+  KalmanLevelDetection::Checkpoint kalman;
+  CusumLevelDetection::Checkpoint cusum;
+};
+
+struct LevelState {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  LevelTapState tap[2];
+};
+
+// Copy of the Stability statistics for one tap.
+struct StabilitySnapshot {
+  uint32_t count;
+  uint32_t total;
+  float sum;
+  float min;
+  float max;
+  float average;
+  float variance;
+  float popStdev;
+  float unbiasedStdev;
+  float periodVariance[STABILITY_EWMA_COUNT];
+};
+
+// Copy of the levels for one tap after the last update, for all detection
+// types so the consumers can choose as with LevelDetection.
+struct LevelTapSnapshot {
+  bool hasStable[LEVELS_TYPES];
+  bool hasPour[LEVELS_TYPES];
+  float total[LEVELS_TYPES];
+  float totalStable[LEVELS_TYPES];
+  float pour[LEVELS_TYPES];
+  float raw;  // Values of the raw and stats detection, used for logging
+  float average;
+  float kalman;
+  float stable;
+  float slope;        // Used by the sampler
+  bool pouring;       // Pour in progress according to the kalman detection
+  uint32_t rejected;  // Outliers replaced by the raw detection
+  float statsAverage;  // Window of the stats detection, used by the display
+  float statsMin;
+  float statsMax;
+  StabilitySnapshot stability;
+};
+
+// The levels as seen by the web server, display and pushes. The getters have
+// the same names as in LevelDetection and return NAN or false for an unknown
+// type.
+class LevelSnapshot {
+ private:
+  static bool isType(LevelDetectionType type) {
+    return type >= LevelDetectionType::RAW && type < LEVELS_TYPES;
+  }
+
+ public:
+  LevelTapSnapshot tap[2] = {};
+  uint32_t updates = 0;  // Values processed by the level detection
+
+  bool hasStableWeight(UnitIndex idx, LevelDetectionType type =
+                                          myConfig.getLevelDetection()) const {
+    return isType(type) && tap[idx].hasStable[type];
+  }
+  bool hasPourWeight(UnitIndex idx, LevelDetectionType type =
+                                        myConfig.getLevelDetection()) const {
+    return isType(type) && tap[idx].hasPour[type];
+  }
+
+  float getTotalWeight(UnitIndex idx, LevelDetectionType type =
+                                          myConfig.getLevelDetection()) const {
+    return isType(type) ? tap[idx].total[type] : NAN;
+  }
+  float getTotalStableWeight(
+      UnitIndex idx,
+      LevelDetectionType type = myConfig.getLevelDetection()) const {
+    return isType(type) ? tap[idx].totalStable[type] : NAN;
+  }
+  float getTotalRawWeight(UnitIndex idx) const { return tap[idx].raw; }
+  float getPourWeight(UnitIndex idx, LevelDetectionType type =
+                                         myConfig.getLevelDetection()) const {
+    return isType(type) ? tap[idx].pour[type] : NAN;
+  }
+
+  float getBeerWeight(UnitIndex idx, LevelDetectionType type =
+                                         myConfig.getLevelDetection()) const {
+    float w = getTotalWeight(idx, type);
+    return isnan(w) ? NAN : w - myConfig.getKegWeight(idx);
+  }
+  float getBeerStableWeight(
+      UnitIndex idx,
+      LevelDetectionType type = myConfig.getLevelDetection()) const {
+    float w = getTotalStableWeight(idx, type);
+    return isnan(w) ? NAN : w - myConfig.getKegWeight(idx);
+  }
+
+  float getBeerVolume(UnitIndex idx, LevelDetectionType type =
+                                         myConfig.getLevelDetection()) const {
+    WeightVolumeConverter conv(idx);
+    return conv.weightToVolume(getBeerWeight(idx, type));
+  }
+  float getBeerStableVolume(
+      UnitIndex idx,
+      LevelDetectionType type = myConfig.getLevelDetection()) const {
+    WeightVolumeConverter conv(idx);
+    return conv.weightToVolume(getBeerStableWeight(idx, type));
+  }
+  float getPourVolume(UnitIndex idx, LevelDetectionType type =
+                                         myConfig.getLevelDetection()) const {
+    WeightVolumeConverter conv(idx);
+    return conv.weightToVolume(getPourWeight(idx, type));
+  }
+  float getNoGlasses(UnitIndex idx, LevelDetectionType type =
+                                        myConfig.getLevelDetection()) const {
+    WeightVolumeConverter conv(idx);
+    return conv.weightToGlasses(getBeerWeight(idx, type));
+  }
+  float getNoStableGlasses(
+      UnitIndex idx,
+      LevelDetectionType type = myConfig.getLevelDetection()) const {
+    WeightVolumeConverter conv(idx);
+    return conv.weightToGlasses(getBeerStableWeight(idx, type));
+  }
+
+  float getRawValue(UnitIndex idx) const { return tap[idx].raw; }
+  float getAverageValue(UnitIndex idx) const { return tap[idx].average; }
+  float getKalmanValue(UnitIndex idx) const { return tap[idx].kalman; }
+  float getStableValue(UnitIndex idx) const { return tap[idx].stable; }
+  float getSlopeValue(UnitIndex idx) const { return tap[idx].slope; }
+  bool isPouring(UnitIndex idx) const { return tap[idx].pouring; }
+  uint32_t getRejectedCount(UnitIndex idx) const { return tap[idx].rejected; }
+  float getStatsAverage(UnitIndex idx) const { return tap[idx].statsAverage; }
+  float getStatsMin(UnitIndex idx) const { return tap[idx].statsMin; }
+  float getStatsMax(UnitIndex idx) const { return tap[idx].statsMax; }
+  const StabilitySnapshot& getStability(UnitIndex idx) const {
+    return tap[idx].stability;
+  }
+};
 
 class LevelDetection {
  private:
   Stability _stability[2];
   RawLevelDetection* _rawLevel[2] = {0, 0};
   StatsLevelDetection* _statsLevel[2] = {0, 0};
+  KalmanLevelDetection* _kalmanLevel[2] = {0, 0};
+  CusumLevelDetection* _cusumLevel[2] = {0, 0};
+
+  // Checkpoint of the levels, a restored tap is pending until the first reads
+  // have confirmed that the weight is still the same.
+  LevelState _state = {};
+  bool _statePending[2] = {false, false};
+  int _stateReads[2] = {0, 0};
+  float _stateSum[2] = {0, 0};
+  bool _stateEnabled = false;
+  bool _stateChanged = false;
+  uint32_t _stateSaved = 0;
 
   LevelDetection(const LevelDetection&) = delete;
   void operator=(const LevelDetection&) = delete;
@@ -48,16 +210,31 @@ class LevelDetection {
   void pushKegUpdate(UnitIndex idx, float stableVol, float pourVol,
                      float glasses);
   void pushPourUpdate(UnitIndex idx, float stableVol, float pourVol);
+  void checkRestore(UnitIndex idx, float raw);
+  void checkpoint(UnitIndex idx);
 
  public:
   LevelDetection();
   void update(UnitIndex idx, float raw, float temp);
+  void getSnapshot(LevelSnapshot& snapshot);
+  void clearStability();  // Stability and rejected counts for both taps
+
+  // Reads the checkpoint and enables saving of new levels
+  bool loadState();
+  bool saveState();
+  bool isRestorePending(UnitIndex idx) { return _statePending[idx]; }
 
   Stability* getStability(UnitIndex idx) { return &_stability[idx]; }
   RawLevelDetection* getRawDetection(UnitIndex idx) { return _rawLevel[idx]; }
   StatsLevelDetection* getStatsDetection(UnitIndex idx) {
     return _statsLevel[idx];
   }
+  KalmanLevelDetection* getKalmanDetection(UnitIndex idx) {
+    return _kalmanLevel[idx];
+  }
+  CusumLevelDetection* getCusumDetection(UnitIndex idx) {
+    return _cusumLevel[idx];
+  }
 
   // Return values based on the chosen algoritm
   bool hasStableWeight(UnitIndex idx,
@@ -65,6 +242,12 @@ class LevelDetection {
   bool hasPourWeight(UnitIndex idx,
                      LevelDetectionType type = myConfig.getLevelDetection());
 
+  // True if the last update found a new stable level or a pour
+  bool hasNewStableWeight(
+      UnitIndex idx, LevelDetectionType type = myConfig.getLevelDetection());
+  bool hasNewPourWeight(UnitIndex idx,
+                        LevelDetectionType type = myConfig.getLevelDetection());
+
   float getBeerWeight(UnitIndex idx,
                       LevelDetectionType type = myConfig.getLevelDetection());
   float getBeerStableWeight(
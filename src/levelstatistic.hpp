@@ -129,6 +129,19 @@ class StatsLevelDetection {
  public:
   explicit StatsLevelDetection(UnitIndex idx) { _idx = idx; }
 
+  // Levels that are kept over a restart
+  struct Checkpoint {
+    float stable;
+    float pour;
+  };
+
+  Checkpoint getCheckpoint() { return {_stable, _pour}; }
+  void restoreCheckpoint(const Checkpoint &state) {
+    clear();
+    _stable = state.stable;
+    _pour = state.pour;
+  }
+
   bool hasStableValue() { return !isnan(_stable); }
   bool hasPourValue() { return !isnan(_pour); }
 
@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <leveltask.hpp>
+#include <log.hpp>
+
+void LevelTask::begin(LevelTaskCallback acquire) {
+  _acquire = acquire;
+
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+  if (!_levelTask)
+    xTaskCreate(levelLoop, "level", LEVELTASK_LEVEL_STACK, this,
+                LEVELTASK_LEVEL_PRIORITY, &_levelTask);
+  if (_acquire && !_scaleTask)
+    xTaskCreate(scaleLoop, "scale", LEVELTASK_SCALE_STACK, this,
+                LEVELTASK_SCALE_PRIORITY, &_scaleTask);
+  _threaded = _levelTask != nullptr;
+#elif defined(KEGMON_NATIVE)
+  if (!_running) {
+    _running = true;
+    _levelThread = std::thread([this]() {
+      while (_running) {
+        if (!process()) delay(1);
+      }
+      process();
+    });
+    if (_acquire) {
+      _scaleThread = std::thread([this]() {
+        while (_running) {
+          _acquire();
+          delay(LEVELTASK_ACQUIRE_DELAY);
+        }
+      });
+    }
+  }
+  _threaded = true;
+#endif
+
+  Log.notice(F("LVLT: Level detection running %s." CR),
+             _threaded ? "in a separate task" : "from the loop");
+}
+
+void LevelTask::end() {
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+  if (_scaleTask) vTaskDelete(_scaleTask);
+  if (_levelTask) vTaskDelete(_levelTask);
+  _scaleTask = _levelTask = nullptr;
+#elif defined(KEGMON_NATIVE)
+  _running = false;
+  if (_scaleThread.joinable()) _scaleThread.join();
+  if (_levelThread.joinable()) _levelThread.join();
+#endif
+  _threaded = false;
+}
+
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+void LevelTask::scaleLoop(void* p) {
+  LevelTask* task = static_cast<LevelTask*>(p);
+
+  for (;;) {
+    task->_acquire();
+    vTaskDelay(pdMS_TO_TICKS(LEVELTASK_ACQUIRE_DELAY));
+  }
+}
+
+void LevelTask::levelLoop(void* p) {
+  LevelTask* task = static_cast<LevelTask*>(p);
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    task->process();
+  }
+}
+#endif
+
+void LevelTask::loop() {
+  if (_threaded) return;
+
+  if (_acquire) _acquire();
+  process();
+}
+
+bool LevelTask::push(UnitIndex idx, float weight, float temp) {
+  if (!_queue.push({idx, weight, temp})) {
+    _dropped++;
+    return false;
+  }
+
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+  if (_levelTask) xTaskNotifyGive(_levelTask);
+#endif
+  return true;
+}
+
+void LevelTask::requestClearStability() {
+  _clearStability = true;
+
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+  if (_levelTask) xTaskNotifyGive(_levelTask);
+#endif
+}
+
+int LevelTask::process() {
+  LevelSample s;
+  int n = 0;
+  bool clear = _clearStability.exchange(false);
+
+  if (clear) _levels->clearStability();
+
+  while (_queue.pop(s)) {
+    _levels->update(s.idx, s.weight, s.temp);
+    n++;
+  }
+
+  if (n || clear) {
+    _updates += n;
+    publish();
+  }
+
+  return n;
+}
+
+void LevelTask::publish() {
+  uint32_t seq = _sequence.load(std::memory_order_relaxed);
+
+  _sequence.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _levels->getSnapshot(_snapshot);
+  _snapshot.updates = _updates;
+  _sequence.store(seq + 2, std::memory_order_release);
+}
+
+void LevelTask::getSnapshot(LevelSnapshot& snapshot) const {
+  for (;;) {
+    uint32_t seq = _sequence.load(std::memory_order_acquire);
+
+    if (!(seq & 1)) {
+      snapshot = _snapshot;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_sequence.load(std::memory_order_relaxed) == seq) return;
+    }
+
+    // Let the level task finish, it can have a lower priority than the reader
+    delay(1);
+  }
+}
+
+// EOF
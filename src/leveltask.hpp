@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_LEVELTASK_HPP_
+#define SRC_LEVELTASK_HPP_
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <levels.hpp>
+#include <spscqueue.hpp>
+#if defined(KEGMON_NATIVE)
+#include <thread>
+#endif
+
+constexpr auto LEVELTASK_QUEUE_SIZE = 16;
+constexpr auto LEVELTASK_ACQUIRE_DELAY = 5;  // ms between polls of the ADC
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+constexpr auto LEVELTASK_SCALE_STACK = 4096;
+constexpr auto LEVELTASK_LEVEL_STACK = 6144;  // Writes the level log
+constexpr auto LEVELTASK_SCALE_PRIORITY = 3;   // Above the level task
+constexpr auto LEVELTASK_LEVEL_PRIORITY = 2;   // Above the Arduino loop
+#endif
+
+struct LevelSample {
+  UnitIndex idx;
+  float weight;
+  float temp;
+};
+
+typedef void (*LevelTaskCallback)();
+
+// Moves the scale acquisition and the level detection away from the Arduino
+// loop. The acquisition callback reads the scales and pushes the weights to a
+// lock free queue, the level task runs LevelDetection::update() for each and
+// publishes a snapshot of the levels (seqlock) that the web server, display
+// and pushes read. A slow push can then not delay the sampling.
+//
+// ESP32 uses two FreeRTOS tasks, the native build uses std::thread so the
+// handoff can be tested on Linux and on ESP8266 both sides run from loop().
+class LevelTask {
+ private:
+  LevelDetection* _levels;
+  SpscQueue<LevelSample, LEVELTASK_QUEUE_SIZE> _queue;
+  LevelSnapshot _snapshot;
+  std::atomic<uint32_t> _sequence{0};  // Odd while the snapshot is written
+  std::atomic<uint32_t> _dropped{0};
+  std::atomic<bool> _clearStability{false};
+  uint32_t _updates = 0;
+  LevelTaskCallback _acquire = nullptr;
+  bool _threaded = false;
+
+#if defined(ESP32) && !defined(KEGMON_NATIVE)
+  TaskHandle_t _scaleTask = nullptr;
+  TaskHandle_t _levelTask = nullptr;
+  static void scaleLoop(void* p);
+  static void levelLoop(void* p);
+#elif defined(KEGMON_NATIVE)
+  std::thread _scaleThread;
+  std::thread _levelThread;
+  std::atomic<bool> _running{false};
+#endif
+
+  LevelTask(const LevelTask&) = delete;
+  void operator=(const LevelTask&) = delete;
+
+  void publish();
+
+ public:
+  explicit LevelTask(LevelDetection* levels) : _levels(levels) {}
+  ~LevelTask() { end(); }
+
+  void begin(LevelTaskCallback acquire = nullptr);
+  void end();
+  void loop();  // Runs both sides when there are no tasks
+  bool isThreaded() const { return _threaded; }
+
+  // Producer side, false when the queue is full and the value is dropped.
+  bool push(UnitIndex idx, float weight, float temp);
+  // Consumer side, returns the number of values processed.
+  int process();
+
+  // The stability is cleared by the level task on the next process().
+  void requestClearStability();
+
+  // Safe to call from any task.
+  void getSnapshot(LevelSnapshot& snapshot) const;
+  uint32_t getDropped() const { return _dropped.load(); }
+  size_t getQueued() const { return _queue.size(); }
+};
+
+extern LevelTask myLevelTask;
+
+#endif  // SRC_LEVELTASK_HPP_
+
+// EOF
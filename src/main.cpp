@@ -26,10 +26,12 @@ SOFTWARE.
 #include <kegconfig.hpp>
 #include <kegpush.hpp>
 #include <kegwebhandler.hpp>
+#include <leveltask.hpp>
 #include <main.hpp>
 #include <ota.hpp>
 #include <perf.hpp>
 #include <scale.hpp>
+#include <scheduler.hpp>
 #include <serialws.hpp>
 #include <temp_mgr.hpp>
 #include <uptime.hpp>
@@ -57,17 +59,17 @@ KegPushHandler myPush(&myConfig);
 Display myDisplay;
 Scale myScale;
 LevelDetection myLevelDetection;
+LevelTask myLevelTask(&myLevelDetection);
 TempSensorManager myTemp;
 SerialWebSocket mySerialWebSocket;
 DisplayLayout myDisplayLayout;
-
-const int loopInterval = 2000;
-int loopCounter = 0;
-uint32_t loopMillis = 0;
+Scheduler myScheduler;
 
 RunMode runMode = RunMode::normalMode;
 
 void scanI2C(int sda, int scl);
+void setupTasks();
+void scaleAcquire();
 void logStartup();
 void checkCoreDump();
 
@@ -104,6 +106,7 @@ void setup() {
   PERF_BEGIN("setup-config");
   myConfig.loadFile();
   PERF_END("setup-config");
+  myLevelDetection.loadState();
   myConfig.setWifiScanAP(true);
 
   delay(4000);
@@ -185,6 +188,8 @@ void setup() {
   PERF_END("main-setup");
   PERF_PUSH();
   myTemp.read();
+  myLevelTask.begin(scaleAcquire);
+  setupTasks();
   delay(3000);
 }
 
@@ -195,212 +200,236 @@ void loop() {
   myWebHandler.loop();
   myWifi.loop();
   mySerialWebSocket.loop();
+
+  // Scale reads and level detection, runs in separate tasks on ESP32
+  myLevelTask.loop();
+
+  // Deliver pours and level changes found by the level detection
+  myPush.loop();
+
+  // Periodic work, at most one task is run for each loop
+  myScheduler.loop();
+}
+
+// Read the scales when the sampler is due (2 seconds), the values are
+// handed to the level detection by myLevelTask.
+void scaleAcquire() {
+  static uint32_t reconnect = millis();
+  LevelSnapshot levels;
+  bool due[2];
+
   myScale.loop(UnitIndex::U1);
   myScale.loop(UnitIndex::U2);
 
-  if (abs(static_cast<int32_t>((millis() - loopMillis))) >
-      loopInterval) {  // 2 seconds loop interval
-    loopMillis = millis();
-    loopCounter++;
+  due[UnitIndex::U1] = myScale.isReadDue(UnitIndex::U1);
+  due[UnitIndex::U2] = myScale.isReadDue(UnitIndex::U2);
 
-    // Send updates to push targets at regular intervals (300 seconds / 5min)
-    if (!(loopCounter % 300)) {
-      Log.info(F("LOOP: Pushing updates to configured targets." CR));
+  // The sampler uses the noise and slope from the level task
+  if (due[UnitIndex::U1] || due[UnitIndex::U2])
+    myLevelTask.getSnapshot(levels);
 
-      myPush.pushTempInformation(myTemp.getLastTempC(), true);
+  if (due[UnitIndex::U1]) {
+    myLevelTask.push(UnitIndex::U1, myScale.read(UnitIndex::U1),
+                     myTemp.getLastTempC());
+    myScale.updateSampler(UnitIndex::U1, levels);
+  }
 
-      if (myLevelDetection.hasStableWeight(UnitIndex::U1))
-        myPush.pushKegInformation(
-            UnitIndex::U1, myLevelDetection.getBeerStableVolume(UnitIndex::U1),
-            myLevelDetection.getPourVolume(UnitIndex::U1),
-            myLevelDetection.getNoStableGlasses(UnitIndex::U1), true);
+  if (due[UnitIndex::U2]) {
+    myLevelTask.push(UnitIndex::U2, myScale.read(UnitIndex::U2),
+                     myTemp.getLastTempC());
+    myScale.updateSampler(UnitIndex::U2, levels);
+  }
 
-      if (myLevelDetection.hasStableWeight(UnitIndex::U2))
-        myPush.pushKegInformation(
-            UnitIndex::U2, myLevelDetection.getBeerStableVolume(UnitIndex::U2),
-            myLevelDetection.getPourVolume(UnitIndex::U2),
-            myLevelDetection.getNoStableGlasses(UnitIndex::U2), true);
-    }
+  // Try to reconnect to scales if they are missing (60 seconds). The driver
+  // itself is not replaced since the web server also uses it.
+  if (millis() - reconnect > 60000) {
+    reconnect = millis();
 
-    // Try to reconnect to scales if they are missing (60 seconds)
-    if (!(loopCounter % 30)) {
-      if (!myScale.isConnected(UnitIndex::U1) ||
-          !myScale.isConnected(UnitIndex::U2)) {
-        myScale.setup();  // Try to reconnect to scale
-      }
+    if (!myScale.isConnected(UnitIndex::U1) ||
+        !myScale.isConnected(UnitIndex::U2)) {
+      myScale.reconnect();
     }
+  }
+}
 
-    // Try to reconnect to scales if they are missing (60 seconds)
-    if (!(loopCounter % 10)) {
-      printHeap("Loop:");
-    }
+// Send the temperature to push targets at regular intervals (600 seconds /
+// 10min), the keg levels are resent by the push handler.
+void pushTask() {
+  Log.info(F("LOOP: Pushing updates to configured targets." CR));
 
-    // The temp sensor should not be read too often.
-    if (!(loopCounter % 15)) {
-      myTemp.read();
-      Log.notice(F("LOOP: Reading temperature=%F,humidity=%F,pressure=%F" CR),
-                 myTemp.getLastTempC(), myTemp.getLastPressure(),
-                 myTemp.getLastPressure());
-    }
+  myPush.pushTempInformation(myTemp.getLastTempC(), true);
+}
 
-    // Check if the temp sensor exist and try to reinitialize
-    if (!(loopCounter % 10)) {
-      if (!myTemp.hasSensor()) {
-        myTemp.reset();
-        myTemp.setup();
-      }
-    }
+void heapTask() { printHeap("Loop:"); }
 
-    // Read the scales, only once per loop
-    float t = myTemp.getLastTempC();
-
-    PERF_BEGIN("loop-scale-read1");
-    myLevelDetection.update(UnitIndex::U1, myScale.read(UnitIndex::U1), t);
-    PERF_END("loop-scale-read1");
-    PERF_BEGIN("loop-scale-read2");
-    myLevelDetection.update(UnitIndex::U2, myScale.read(UnitIndex::U2), t);
-    PERF_END("loop-scale-read2");
-
-    // Update screens
-    PERF_BEGIN("loop-display-default");
-    myDisplayLayout.loop();
-    myDisplayLayout.showCurrent(
-        UnitIndex::U1, myScale.isConnected(UnitIndex::U1),
-        myLevelDetection.getBeerWeight(UnitIndex::U1, LevelDetectionType::RAW),
-        myLevelDetection.getBeerVolume(UnitIndex::U1, LevelDetectionType::RAW),
-        myLevelDetection.getNoGlasses(UnitIndex::U1, LevelDetectionType::STATS),
-        myLevelDetection.getPourVolume(UnitIndex::U1,
-                                       LevelDetectionType::STATS),
-        myTemp.getLastTempC(),
-        myLevelDetection.hasStableWeight(UnitIndex::U1,
-                                         LevelDetectionType::STATS));
-    myDisplayLayout.showCurrent(
-        UnitIndex::U2, myScale.isConnected(UnitIndex::U2),
-        myLevelDetection.getBeerWeight(UnitIndex::U2, LevelDetectionType::RAW),
-        myLevelDetection.getBeerVolume(UnitIndex::U2, LevelDetectionType::RAW),
-        myLevelDetection.getNoGlasses(UnitIndex::U2, LevelDetectionType::STATS),
-        myLevelDetection.getPourVolume(UnitIndex::U2,
-                                       LevelDetectionType::STATS),
-        myTemp.getLastTempC(),
-        myLevelDetection.hasStableWeight(UnitIndex::U2,
-                                         LevelDetectionType::STATS));
-    PERF_END("loop-display-default");
-    PERF_PUSH();
-
-    /*Log.notice(
-        F("LOOP: Reading data raw1=%F,raw2=%F,kalman1=%F,kalman2=%F,stab1=%F, "
-          "stab2=%F,ave1=%F,ave2=%F,min1=%F,min2=%F,max1=%F,max2=%F,pour1=%F,"
-          "pour2=%F" CR),
-        myScale.getTotalRawWeight(UnitIndex::U1),
-        myScale.getTotalRawWeight(UnitIndex::U2),
-        myScale.getTotalWeight(UnitIndex::U1),
-        myScale.getTotalWeight(UnitIndex::U2),
-        myScale.getTotalStableWeight(UnitIndex::U1),
-        myScale.getTotalStableWeight(UnitIndex::U2),
-        myScale.getStatsDetection(UnitIndex::U1)->ave(),
-        myScale.getStatsDetection(UnitIndex::U2)->ave(),
-        myScale.getStatsDetection(UnitIndex::U1)->min(),
-        myScale.getStatsDetection(UnitIndex::U2)->min(),
-        myScale.getStatsDetection(UnitIndex::U1)->max(),
-        myScale.getStatsDetection(UnitIndex::U2)->max(),
-        myScale.getPourWeight(UnitIndex::U1),
-        myScale.getPourWeight(UnitIndex::U2));*/
-    Log.notice(
-        F("LOOP: Reading data raw1=%F,raw2=%F,stable1=%F, "
-          "stable2=%F,pour1=%F,"
-          "pour2=%F" CR),
-        myLevelDetection.getRawDetection(UnitIndex::U1)->getRawValue(),
-        myLevelDetection.getRawDetection(UnitIndex::U2)->getRawValue(),
-        myLevelDetection.getStatsDetection(UnitIndex::U1)->getStableValue(),
-        myLevelDetection.getStatsDetection(UnitIndex::U2)->getStableValue(),
-        myLevelDetection.getStatsDetection(UnitIndex::U1)->getPourValue(),
-        myLevelDetection.getStatsDetection(UnitIndex::U2)->getPourValue());
-
-    if (myConfig.hasTargetInfluxDb2()) {
-      Log.notice(F("LOOP: Sending data to configured influxdb" CR));
-
-      // This part is used to send data to an influxdb in order to get data on
-      // scale stability/drift over time.
-      char buf[250];
-
-      float raw1 =
-          myLevelDetection.getRawDetection(UnitIndex::U1)->getRawValue();
-      float raw2 =
-          myLevelDetection.getRawDetection(UnitIndex::U2)->getRawValue();
-      float stb1 =
-          myLevelDetection.getStatsDetection(UnitIndex::U1)->getStableValue();
-      float stb2 =
-          myLevelDetection.getStatsDetection(UnitIndex::U2)->getStableValue();
-
-      String s;
-      snprintf(&buf[0], sizeof(buf),
-               "scale,host=%s,device=%s "
-               "level-raw1=%f,"
-               "level-raw2=%f",
-               myConfig.getMDNS(), myConfig.getID(), isnan(raw1) ? 0 : raw1,
-               isnan(raw2) ? 0 : raw2);
-      s = &buf[0];
-
-      float ave1 =
-          myLevelDetection.getRawDetection(UnitIndex::U1)->getAverageValue();
-      float ave2 =
-          myLevelDetection.getRawDetection(UnitIndex::U2)->getAverageValue();
-
-      snprintf(&buf[0], sizeof(buf), ",level-average1=%f,level-average2=%f",
-               isnan(ave1) ? 0 : ave1, isnan(ave2) ? 0 : ave2);
-      s += &buf[0];
-
-      float kal1 =
-          myLevelDetection.getRawDetection(UnitIndex::U1)->getKalmanValue();
-      float kal2 =
-          myLevelDetection.getRawDetection(UnitIndex::U2)->getKalmanValue();
-
-      snprintf(&buf[0], sizeof(buf), ",level-kalman1=%f,level-kalman2=%f",
-               isnan(kal1) ? 0 : kal1, isnan(kal2) ? 0 : kal2);
-      s += &buf[0];
-
-      float stats1 =
-          myLevelDetection.getStatsDetection(UnitIndex::U1)->getStableValue();
-      float stats2 =
-          myLevelDetection.getStatsDetection(UnitIndex::U2)->getStableValue();
-
-      snprintf(&buf[0], sizeof(buf), ",level-stats1=%f,level-stats2=%f",
-
-               isnan(stats1) ? 0 : stats1, isnan(stats2) ? 0 : stats2);
-      s += &buf[0];
-
-      if (!isnan(myTemp.getLastTempC())) {
-        snprintf(&buf[0], sizeof(buf), ",tempC=%f,tempF=%f",
-                 myTemp.getLastTempC(), myTemp.getLastTempF());
-        s = s + &buf[0];
-      }
+void statisticsTask() { myScheduler.logStatistics(); }
 
-      if (!isnan(myTemp.getLastHumidity())) {
-        snprintf(&buf[0], sizeof(buf), ",humidity=%f",
-                 myTemp.getLastHumidity());
-        s = s + &buf[0];
-      }
+// The temp sensor should not be read too often (30 seconds).
+void tempReadTask() {
+  myTemp.read();
+  Log.notice(F("LOOP: Reading temperature=%F,humidity=%F,pressure=%F" CR),
+             myTemp.getLastTempC(), myTemp.getLastPressure(),
+             myTemp.getLastPressure());
+}
 
-      if (!isnan(stb1)) {
-        snprintf(&buf[0], sizeof(buf), ",stable1=%f", stb1);
-        s = s + &buf[0];
-      }
+// Check if the temp sensor exist and try to reinitialize (20 seconds)
+void tempReconnectTask() {
+  if (!myTemp.hasSensor()) {
+    myTemp.reset();
+    myTemp.setup();
+  }
+}
 
-      if (!isnan(stb2)) {
-        snprintf(&buf[0], sizeof(buf), ",stable2=%f", stb2);
-        s = s + &buf[0];
-      }
+// Store a finished tare or factor calibration
+void calibrationTask() { myScale.saveCalibration(); }
+
+// Update screens
+void displayTask() {
+  LevelSnapshot levels;
+  myLevelTask.getSnapshot(levels);
+
+  PERF_BEGIN("loop-display-default");
+  myDisplayLayout.loop();
+  myDisplayLayout.showCurrent(
+      UnitIndex::U1, myScale.isConnected(UnitIndex::U1),
+      levels.getBeerWeight(UnitIndex::U1, LevelDetectionType::RAW),
+      levels.getBeerVolume(UnitIndex::U1, LevelDetectionType::RAW),
+      levels.getNoGlasses(UnitIndex::U1, LevelDetectionType::STATS),
+      levels.getPourVolume(UnitIndex::U1, LevelDetectionType::STATS),
+      myTemp.getLastTempC(),
+      levels.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+  myDisplayLayout.showCurrent(
+      UnitIndex::U2, myScale.isConnected(UnitIndex::U2),
+      levels.getBeerWeight(UnitIndex::U2, LevelDetectionType::RAW),
+      levels.getBeerVolume(UnitIndex::U2, LevelDetectionType::RAW),
+      levels.getNoGlasses(UnitIndex::U2, LevelDetectionType::STATS),
+      levels.getPourVolume(UnitIndex::U2, LevelDetectionType::STATS),
+      myTemp.getLastTempC(),
+      levels.hasStableWeight(UnitIndex::U2, LevelDetectionType::STATS));
+  PERF_END("loop-display-default");
+  PERF_PUSH();
+
+  /*Log.notice(
+      F("LOOP: Reading data raw1=%F,raw2=%F,kalman1=%F,kalman2=%F,stab1=%F, "
+        "stab2=%F,ave1=%F,ave2=%F,min1=%F,min2=%F,max1=%F,max2=%F,pour1=%F,"
+        "pour2=%F" CR),
+      myScale.getTotalRawWeight(UnitIndex::U1),
+      myScale.getTotalRawWeight(UnitIndex::U2),
+      myScale.getTotalWeight(UnitIndex::U1),
+      myScale.getTotalWeight(UnitIndex::U2),
+      myScale.getTotalStableWeight(UnitIndex::U1),
+      myScale.getTotalStableWeight(UnitIndex::U2),
+      myScale.getStatsDetection(UnitIndex::U1)->ave(),
+      myScale.getStatsDetection(UnitIndex::U2)->ave(),
+      myScale.getStatsDetection(UnitIndex::U1)->min(),
+      myScale.getStatsDetection(UnitIndex::U2)->min(),
+      myScale.getStatsDetection(UnitIndex::U1)->max(),
+      myScale.getStatsDetection(UnitIndex::U2)->max(),
+      myScale.getPourWeight(UnitIndex::U1),
+      myScale.getPourWeight(UnitIndex::U2));*/
+  Log.notice(
+      F("LOOP: Reading data raw1=%F,raw2=%F,stable1=%F, "
+        "stable2=%F,pour1=%F,"
+        "pour2=%F" CR),
+      levels.getRawValue(UnitIndex::U1),
+      levels.getRawValue(UnitIndex::U2),
+      levels.getStableValue(UnitIndex::U1),
+      levels.getStableValue(UnitIndex::U2),
+      levels.getPourWeight(UnitIndex::U1, LevelDetectionType::STATS),
+      levels.getPourWeight(UnitIndex::U2, LevelDetectionType::STATS));
+}
+
+void influxTask() {
+  LevelSnapshot levels;
+  myLevelTask.getSnapshot(levels);
+
+  if (myConfig.hasTargetInfluxDb2()) {
+    Log.notice(F("LOOP: Sending data to configured influxdb" CR));
+
+    // This part is used to send data to an influxdb in order to get data on
+    // scale stability/drift over time.
+    char buf[250];
+
+    float raw1 = levels.getRawValue(UnitIndex::U1);
+    float raw2 = levels.getRawValue(UnitIndex::U2);
+    float stb1 = levels.getStableValue(UnitIndex::U1);
+    float stb2 = levels.getStableValue(UnitIndex::U2);
+
+    String s;
+    snprintf(&buf[0], sizeof(buf),
+             "scale,host=%s,device=%s "
+             "level-raw1=%f,"
+             "level-raw2=%f",
+             myConfig.getMDNS(), myConfig.getID(), isnan(raw1) ? 0 : raw1,
+             isnan(raw2) ? 0 : raw2);
+    s = &buf[0];
+
+    float ave1 = levels.getAverageValue(UnitIndex::U1);
+    float ave2 = levels.getAverageValue(UnitIndex::U2);
+
+    snprintf(&buf[0], sizeof(buf), ",level-average1=%f,level-average2=%f",
+             isnan(ave1) ? 0 : ave1, isnan(ave2) ? 0 : ave2);
+    s += &buf[0];
+
+    float kal1 = levels.getKalmanValue(UnitIndex::U1);
+    float kal2 = levels.getKalmanValue(UnitIndex::U2);
+
+    snprintf(&buf[0], sizeof(buf), ",level-kalman1=%f,level-kalman2=%f",
+             isnan(kal1) ? 0 : kal1, isnan(kal2) ? 0 : kal2);
+    s += &buf[0];
+
+    float stats1 = levels.getStableValue(UnitIndex::U1);
+    float stats2 = levels.getStableValue(UnitIndex::U2);
+
+    snprintf(&buf[0], sizeof(buf), ",level-stats1=%f,level-stats2=%f",
+
+             isnan(stats1) ? 0 : stats1, isnan(stats2) ? 0 : stats2);
+    s += &buf[0];
+
+    if (!isnan(myTemp.getLastTempC())) {
+      snprintf(&buf[0], sizeof(buf), ",tempC=%f,tempF=%f",
+               myTemp.getLastTempC(), myTemp.getLastTempF());
+      s = s + &buf[0];
+    }
+
+    if (!isnan(myTemp.getLastHumidity())) {
+      snprintf(&buf[0], sizeof(buf), ",humidity=%f",
+               myTemp.getLastHumidity());
+      s = s + &buf[0];
+    }
+
+    if (!isnan(stb1)) {
+      snprintf(&buf[0], sizeof(buf), ",stable1=%f", stb1);
+      s = s + &buf[0];
+    }
+
+    if (!isnan(stb2)) {
+      snprintf(&buf[0], sizeof(buf), ",stable2=%f", stb2);
+      s = s + &buf[0];
+    }
 
 #if LOG_LEVEL == 6
-      Log.verbose(F("LOOP: %s" CR), s.c_str());
+    Log.verbose(F("LOOP: %s" CR), s.c_str());
 #endif
-      myPush.sendInfluxDb2(
-          s, myConfig.getTargetInfluxDB2(), myConfig.getOrgInfluxDB2(),
-          myConfig.getBucketInfluxDB2(), myConfig.getTokenInfluxDB2());
-    }
+    myPush.sendInfluxDb2(
+        s, myConfig.getTargetInfluxDB2(), myConfig.getOrgInfluxDB2(),
+        myConfig.getBucketInfluxDB2(), myConfig.getTokenInfluxDB2());
   }
 }
 
+void setupTasks() {
+  // Name, callback, period and jitter (ms). The first runs are staggered so
+  // tasks with related periods don't start in the same loop.
+  myScheduler.add("calibration", calibrationTask, 2000, 1000);
+  myScheduler.add("display", displayTask, 2000, 500);
+  myScheduler.add("influx", influxTask, 2000, 2000);
+  myScheduler.add("heap", heapTask, 20000, 5000);
+  myScheduler.add("temp-reconnect", tempReconnectTask, 20000, 5000);
+  myScheduler.add("temp-read", tempReadTask, 30000, 5000);
+  myScheduler.add("push", pushTask, 600000, 30000);
+  myScheduler.add("statistics", statisticsTask, 600000, 60000);
+}
+
 void scanI2C(int sda, int scl) {
   byte error, address;
   int n = 0;
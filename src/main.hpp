@@ -34,6 +34,7 @@ constexpr auto CFG_FILENAME = "/kegmon1.json";
 constexpr auto STARTUP_FILENAME = "/startup.log";
 constexpr auto LEVELS_FILENAME = "/levels.log";
 constexpr auto LEVELS_FILENAME2 = "/levels2.log";
+constexpr auto LEVELS_STATE_FILENAME = "/levels.state";
 
 constexpr auto DISPLAY_ADR1 = 0x3c;
 constexpr auto DISPLAY_ADR2 = 0x3d;
@@ -52,6 +53,8 @@ constexpr auto PIN_LED = 2;
 constexpr auto PIN_LED = BUILTIN_LED;
 #elif defined(ESP32S3)
 constexpr auto PIN_LED = BUILTIN_LED;
+#elif defined(KEGMON_NATIVE)
+constexpr auto PIN_LED = 0;
 #else
 #error "Undefined target platform"
 #endif
@@ -60,7 +63,9 @@ enum UnitIndex { U1 = 0, U2 = 1 };
 /*
  * RAW: Last value read
  * STATS: Statistics applied and average value used over the last 20 seconds
+ * KALMAN: Two state (level and rate) kalman filter
+ * CUSUM: Change point detection, splits the values into plateaus
  */
-enum LevelDetectionType { RAW = 0, STATS = 1 };
+enum LevelDetectionType { RAW = 0, STATS = 1, KALMAN = 2, CUSUM = 3 };
 
 #endif  // SRC_MAIN_HPP_
@@ -0,0 +1,200 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <LittleFS.h>
+
+#include <log.hpp>
+#include <outbox.hpp>
+
+bool PushOutbox::begin() {
+  File f = LittleFS.open(OUTBOX_INDEX_FILENAME, "r");
+  bool valid = false;
+
+  if (f) {
+    valid = f.read(reinterpret_cast<uint8_t*>(&_index), sizeof(_index)) ==
+                sizeof(_index) &&
+            _index.magic == OUTBOX_MAGIC &&
+            _index.version == OUTBOX_VERSION && _index.size == sizeof(_index);
+    f.close();
+  }
+
+  f = LittleFS.open(OUTBOX_FILENAME, "r");
+  _count = valid && f ? f.size() / sizeof(OutboxRecord) : 0;
+  if (f) f.close();
+
+  if (!valid) {
+    if (LittleFS.exists(OUTBOX_FILENAME)) LittleFS.remove(OUTBOX_FILENAME);
+    _index = {OUTBOX_MAGIC, OUTBOX_VERSION, sizeof(_index), 0, {}};
+  }
+
+  // Cursors can be ahead of the file if the index was saved after a failed
+  // append.
+  for (int i = 0; i < OUTBOX_TARGETS; i++) {
+    if (_index.cursor[i] < _index.first) _index.cursor[i] = _index.first;
+    if (_index.cursor[i] > _index.first + _count)
+      _index.cursor[i] = _index.first + _count;
+  }
+
+  _open = true;
+  Log.notice(F("OBOX: Outbox opened with %d records." CR), _count);
+  return valid;
+}
+
+bool PushOutbox::saveIndex() {
+  File f = LittleFS.open(OUTBOX_INDEX_FILENAME, "w");
+
+  if (!f) {
+    Log.error(F("OBOX: Failed to save outbox index." CR));
+    return false;
+  }
+
+  size_t n = f.write(reinterpret_cast<const uint8_t*>(&_index), sizeof(_index));
+  f.close();
+  return n == sizeof(_index);
+}
+
+bool PushOutbox::append(const OutboxRecord& record) {
+  if (_count >= OUTBOX_RECORDS_MAX) {
+    uint32_t first = _index.cursor[0];
+
+    for (int i = 1; i < OUTBOX_TARGETS; i++)
+      if (_index.cursor[i] < first) first = _index.cursor[i];
+
+    // A target has been down for long, drop the oldest quarter
+    if (first - _index.first < OUTBOX_RECORDS_MAX / 4) {
+      uint32_t slowest = first;
+      first = _index.first + OUTBOX_RECORDS_MAX / 4;
+      _lost += first - slowest;
+      Log.warning(F("OBOX: Outbox is full, dropping oldest records." CR));
+    }
+
+    if (!compact(first)) return false;
+  }
+
+  File f = LittleFS.open(OUTBOX_FILENAME, "a");
+
+  if (!f) {
+    Log.error(F("OBOX: Failed to append to outbox." CR));
+    return false;
+  }
+
+  size_t n = f.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+  f.close();
+
+  if (n != sizeof(record)) return false;
+
+  _count++;
+  return true;
+}
+
+int PushOutbox::read(int target, OutboxRecord* records, int max) {
+  uint32_t n = pending(target);
+
+  if (!n) return 0;
+  if (n > static_cast<uint32_t>(max)) n = max;
+
+  File f = LittleFS.open(OUTBOX_FILENAME, "r");
+
+  if (!f) return 0;
+
+  f.seek((_index.cursor[target] - _index.first) * sizeof(OutboxRecord));
+  n = f.read(reinterpret_cast<uint8_t*>(records), n * sizeof(OutboxRecord)) /
+      sizeof(OutboxRecord);
+  f.close();
+  return n;
+}
+
+void PushOutbox::advance(int target, uint32_t n) {
+  if (!n) return;
+
+  uint32_t end = _index.first + _count;
+  _index.cursor[target] += n;
+  if (_index.cursor[target] > end) _index.cursor[target] = end;
+
+  // When everything is delivered the file can be removed without copying
+  bool done = true;
+
+  for (int i = 0; i < OUTBOX_TARGETS; i++)
+    if (_index.cursor[i] != end) done = false;
+
+  if (done && _count) {
+    LittleFS.remove(OUTBOX_FILENAME);
+    _index.first = end;
+    _count = 0;
+  }
+
+  saveIndex();
+}
+
+bool PushOutbox::compact(uint32_t first) {
+  uint32_t skip = first - _index.first;
+
+  if (!skip) return true;
+  if (skip > _count) skip = _count;
+
+  File src = LittleFS.open(OUTBOX_FILENAME, "r");
+  File dst = LittleFS.open(OUTBOX_TEMP_FILENAME, "w");
+
+  if (!src || !dst) {
+    Log.error(F("OBOX: Failed to compact outbox." CR));
+    return false;
+  }
+
+  OutboxRecord buf[OUTBOX_BATCH];
+  src.seek(skip * sizeof(OutboxRecord));
+
+  for (;;) {
+    size_t n = src.read(reinterpret_cast<uint8_t*>(&buf[0]), sizeof(buf));
+    if (!n) break;
+    dst.write(reinterpret_cast<const uint8_t*>(&buf[0]), n);
+  }
+
+  src.close();
+  dst.close();
+  LittleFS.remove(OUTBOX_FILENAME);
+  LittleFS.rename(OUTBOX_TEMP_FILENAME, OUTBOX_FILENAME);
+
+  _index.first += skip;
+  _count -= skip;
+
+  for (int i = 0; i < OUTBOX_TARGETS; i++)
+    if (_index.cursor[i] < _index.first) _index.cursor[i] = _index.first;
+
+  return saveIndex();
+}
+
+void PushOutbox::failed(int target, uint32_t now) {
+  _backoff[target] = _backoff[target] ? _backoff[target] * 2
+                                      : OUTBOX_BACKOFF_MIN;
+  if (_backoff[target] > OUTBOX_BACKOFF_MAX)
+    _backoff[target] = OUTBOX_BACKOFF_MAX;
+  _next[target] = now + _backoff[target];
+  Log.notice(F("OBOX: Delivery failed, retrying in %d s [%d]." CR),
+             _backoff[target] / 1000, target);
+}
+
+void PushOutbox::retry() {
+  for (int i = 0; i < OUTBOX_TARGETS; i++) _next[i] = millis();
+}
+
+// EOF
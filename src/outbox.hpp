@@ -0,0 +1,113 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_OUTBOX_HPP_
+#define SRC_OUTBOX_HPP_
+
+#include <Arduino.h>
+
+#include <main.hpp>
+
+constexpr auto OUTBOX_FILENAME = "/outbox.dat";
+constexpr auto OUTBOX_INDEX_FILENAME = "/outbox.idx";
+constexpr auto OUTBOX_TEMP_FILENAME = "/outbox.tmp";
+constexpr auto OUTBOX_MAGIC = 0x424f474b;  // KGOB
+constexpr auto OUTBOX_VERSION = 1;
+constexpr auto OUTBOX_TARGETS = 4;
+#if defined(ESP8266)
+constexpr auto OUTBOX_RECORDS_MAX = 512;  // 8 kB
+#else
+constexpr auto OUTBOX_RECORDS_MAX = 2048;  // 32 kB
+#endif
+constexpr auto OUTBOX_BATCH = 4;  // Records sent to a target for each loop
+constexpr uint32_t OUTBOX_BACKOFF_MIN = 10 * 1000;       // ms
+constexpr uint32_t OUTBOX_BACKOFF_MAX = 60 * 60 * 1000;  // ms
+
+// One pour or keg event (16 bytes), stored in the order they were found.
+struct OutboxRecord {
+  uint32_t time;  // Epoch seconds
+  uint8_t type;   // PushEventType
+  uint8_t idx;
+  uint16_t glasses;  // x10
+  float stableVol;
+  float pourVol;
+};
+
+// The records in the file are numbered from first, a target has delivered all
+// records before its cursor.
+struct OutboxIndex {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t first;
+  uint32_t cursor[OUTBOX_TARGETS];
+};
+
+static_assert(sizeof(OutboxRecord) == 16, "Outbox record must be 16 bytes");
+
+// Append only file of events that still need to be delivered to one or more
+// targets, so events found while the network or a target is down are sent
+// later. Only the cursors and the retry timers are kept in RAM. Records that
+// all targets have delivered are removed, when the file is full the oldest
+// records are dropped.
+class PushOutbox {
+ private:
+  OutboxIndex _index = {};
+  uint32_t _count = 0;  // Records in the file
+  uint32_t _lost = 0;   // Records dropped before all targets had them
+  uint32_t _next[OUTBOX_TARGETS] = {};     // millis() of the next attempt
+  uint32_t _backoff[OUTBOX_TARGETS] = {};  // ms, 0 when the target is ok
+  bool _open = false;
+
+  bool saveIndex();
+  bool compact(uint32_t first);
+
+ public:
+  bool begin();
+  bool isOpen() const { return _open; }
+
+  bool append(const OutboxRecord& record);
+  // Reads up to max records from the cursor of the target.
+  int read(int target, OutboxRecord* records, int max);
+  void advance(int target, uint32_t n);
+
+  uint32_t pending(int target) const {
+    return _index.first + _count - _index.cursor[target];
+  }
+  uint32_t count() const { return _count; }
+  uint32_t lost() const { return _lost; }
+
+  // Exponential backoff for a target that failed.
+  bool isDue(int target, uint32_t now) const {
+    return !_backoff[target] ||
+           static_cast<int32_t>(now - _next[target]) >= 0;
+  }
+  void failed(int target, uint32_t now);
+  void succeeded(int target) { _backoff[target] = 0; }
+  void retry();  // Try all targets directly, e.g. after a reconnect
+  uint32_t getBackoff(int target) const { return _backoff[target]; }
+};
+
+#endif  // SRC_OUTBOX_HPP_
+
+// EOF
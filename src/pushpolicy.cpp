@@ -0,0 +1,96 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <pushpolicy.hpp>
+
+void PushCoalescer::update(const KegUpdate& update, uint32_t now) {
+  Slot& s = _slot[update.idx];
+
+  if (s.pending)
+    _coalesced++;  // Latest value wins, the wait starts with the first one
+  else
+    s.since = now;
+
+  s.update = update;
+  s.valid = true;
+  s.pending = true;
+  s.refresh = false;
+}
+
+bool PushCoalescer::next(uint32_t now, KegUpdate& update) {
+  for (int i = 0; i < PUSH_POLICY_TAPS; i++) {
+    Slot& s = _slot[i];
+
+    if (!s.valid) continue;
+
+    if (!s.pending && s.attempted && _policy.refresh &&
+        now - s.lastTime >= _policy.refresh) {
+      s.pending = true;
+      s.refresh = true;
+      s.since = now - _policy.delay;
+    }
+
+    if (!s.pending || now - s.since < _policy.delay) continue;
+    if (s.attempted && now - s.lastTime < _policy.minInterval) continue;
+
+    if (!s.refresh && s.delivered &&
+        fabs(s.update.stableVol - s.lastVol) < _policy.minChange) {
+      s.pending = false;
+      _coalesced++;
+      continue;
+    }
+
+    update = s.update;
+    return true;
+  }
+
+  return false;
+}
+
+void PushCoalescer::delivered(UnitIndex idx, uint32_t now) {
+  Slot& s = _slot[idx];
+
+  skipped(idx, now);
+  s.delivered = true;
+  s.lastVol = s.update.stableVol;
+}
+
+void PushCoalescer::skipped(UnitIndex idx, uint32_t now) {
+  Slot& s = _slot[idx];
+
+  s.pending = false;
+  s.refresh = false;
+  s.attempted = true;
+  s.lastTime = now;
+}
+
+int PushCoalescer::pending() const {
+  int n = 0;
+
+  for (int i = 0; i < PUSH_POLICY_TAPS; i++)
+    if (_slot[i].pending) n++;
+
+  return n;
+}
+
+// EOF
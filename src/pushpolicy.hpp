@@ -0,0 +1,85 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_PUSHPOLICY_HPP_
+#define SRC_PUSHPOLICY_HPP_
+
+#include <Arduino.h>
+
+#include <main.hpp>
+
+constexpr auto PUSH_POLICY_TAPS = 2;
+
+// Limits for how often keg levels are sent to one target.
+struct PushPolicy {
+  uint32_t delay;        // ms an update waits for newer values before sent
+  uint32_t minInterval;  // ms between two updates for the same tap
+  float minChange;       // Smaller changes (liters) than this are not sent
+  uint32_t refresh;      // ms before the last level is sent again, 0 = never
+};
+
+struct KegUpdate {
+  UnitIndex idx;
+  float stableVol;
+  float pourVol;
+  float glasses;
+};
+
+// Keeps the latest keg level per tap for one target and decides when it
+// should be sent. Updates that arrive while one is waiting replace it, so a
+// burst of level changes results in one request.
+class PushCoalescer {
+ private:
+  struct Slot {
+    KegUpdate update;
+    bool valid;      // Update contains a level
+    bool pending;    // Update has not been sent
+    bool refresh;    // Pending since the refresh time passed
+    bool attempted;  // lastTime is set
+    bool delivered;  // lastVol has been delivered
+    uint32_t since;     // millis() when the update became pending
+    uint32_t lastTime;  // millis() of the last attempt
+    float lastVol;
+  };
+
+  PushPolicy _policy = {};
+  Slot _slot[PUSH_POLICY_TAPS] = {};
+  uint32_t _coalesced = 0;  // Updates replaced or below the change limit
+
+ public:
+  void setPolicy(const PushPolicy& policy) { _policy = policy; }
+  const PushPolicy& getPolicy() const { return _policy; }
+
+  void update(const KegUpdate& update, uint32_t now);
+  // Returns true and the update if one of the taps should be sent now.
+  bool next(uint32_t now, KegUpdate& update);
+  void delivered(UnitIndex idx, uint32_t now);
+  void skipped(UnitIndex idx, uint32_t now);  // Target is not configured
+
+  int pending() const;
+  uint32_t getCoalesced() const { return _coalesced; }
+};
+
+#endif  // SRC_PUSHPOLICY_HPP_
+
+// EOF
@@ -0,0 +1,131 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_ROLLINGWINDOW_HPP_
+#define SRC_ROLLINGWINDOW_HPP_
+
+#include <Arduino.h>
+
+// Fixed capacity ring buffer that keeps the sum, sum of squares and number of
+// valid (non NaN) values up to date so that adding a value and reading the
+// statistics is done in constant time regardless of the window size. The
+// active window size can be changed at runtime up to the capacity.
+template <int CAPACITY>
+class RollingWindow {
+ private:
+  float _buf[CAPACITY];
+  int _size = CAPACITY;
+  int _head = 0;    // Next position to write
+  int _filled = 0;  // Number of positions written (including NaN)
+  int _valid = 0;   // Number of non NaN values in the window
+  double _sum = 0;
+  double _sumSq = 0;
+
+  // The running sums are recalculated once per lap to avoid accumulating
+  // rounding errors, this keeps the cost constant per value.
+  void resync() {
+    double s = 0, sq = 0;
+    for (int i = 0; i < _filled; i++) {
+      if (!isnan(_buf[i])) {
+        s += _buf[i];
+        sq += static_cast<double>(_buf[i]) * _buf[i];
+      }
+    }
+    _sum = s;
+    _sumSq = sq;
+  }
+
+ public:
+  RollingWindow() { clear(); }
+
+  void clear() {
+    for (int i = 0; i < CAPACITY; i++) _buf[i] = NAN;
+    _head = 0;
+    _filled = 0;
+    _valid = 0;
+    _sum = 0;
+    _sumSq = 0;
+  }
+
+  int capacity() const { return CAPACITY; }
+  int size() const { return _size; }
+  void setSize(int size) {
+    if (size < 1) size = 1;
+    if (size > CAPACITY) size = CAPACITY;
+    if (size == _size) return;
+    _size = size;
+    clear();
+  }
+
+  void add(float v) {
+    if (_filled == _size) {
+      float old = _buf[_head];
+      if (!isnan(old)) {
+        _sum -= old;
+        _sumSq -= static_cast<double>(old) * old;
+        _valid--;
+      }
+    } else {
+      _filled++;
+    }
+
+    _buf[_head] = v;
+    if (!isnan(v)) {
+      _sum += v;
+      _sumSq += static_cast<double>(v) * v;
+      _valid++;
+    }
+
+    if (++_head == _size) {
+      _head = 0;
+      resync();
+    }
+  }
+
+  bool isFull() const { return _filled == _size; }
+  int count() const { return _valid; }
+  float sum() const { return _sum; }
+  float average() const { return _valid ? _sum / _valid : NAN; }
+
+  // Population variance of the values in the window
+  float variance() const {
+    if (!_valid) return NAN;
+    double mean = _sum / _valid;
+    double v = _sumSq / _valid - mean * mean;
+    return v < 0 ? 0 : v;
+  }
+
+  // Newest and oldest values in the window
+  float newest() const {
+    if (!_filled) return NAN;
+    return _buf[_head == 0 ? _size - 1 : _head - 1];
+  }
+  float oldest() const {
+    if (!_filled) return NAN;
+    return _filled == _size ? _buf[_head] : _buf[0];
+  }
+};
+
+#endif  // SRC_ROLLINGWINDOW_HPP_
+
+// EOF
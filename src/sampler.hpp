@@ -0,0 +1,142 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SAMPLER_HPP_
+#define SRC_SAMPLER_HPP_
+
+#include <Arduino.h>
+
+constexpr auto SAMPLER_INTERVAL = 2000;    // ms, cadence of the level values
+constexpr auto SAMPLER_POUR_WINDOW = 500;  // ms of conversions during a pour
+constexpr auto SAMPLER_COUNT_MIN = 2;
+constexpr auto SAMPLER_COUNT_MAX = 32;  // Conversions the driver can keep
+constexpr float SAMPLER_NOISE_TARGET = 0.002;  // kg, stdev of one read
+constexpr float SAMPLER_WEIGHT = 0.2;  // Smoothing of the rate and noise
+
+enum SamplerMode {
+  SAMPLER_STARTUP = 0,  // Not enough data, all conversions are used
+  SAMPLER_IDLE = 1,     // Level is stable, count set by the noise
+  SAMPLER_POUR = 2      // Level is changing, only the latest conversions
+};
+
+// Chooses how many ADC conversions are averaged into one weight. The weight
+// is always read every SAMPLER_INTERVAL since the level detections count
+// values (stable count, raw window, kalman process noise), so their time span
+// stays the same. When the level is stable the count is the number of
+// conversions needed to get the noise below the target, limited to the
+// conversions of one interval. When the level changes fresh values are more
+// important than a low noise so only the latest conversions are used.
+class AdaptiveSampler {
+ private:
+  SamplerMode _mode;
+  int _count;
+  float _rate;   // Conversions per second delivered by the driver
+  float _noise;  // Variance of a single conversion (kg2)
+  uint32_t _lastRead;
+  uint32_t _lastConversions;
+  bool _first;
+
+  static int clampCount(float n) {
+    if (isnan(n) || n < SAMPLER_COUNT_MIN) return SAMPLER_COUNT_MIN;
+    if (n > SAMPLER_COUNT_MAX) return SAMPLER_COUNT_MAX;
+    return static_cast<int>(ceil(n));
+  }
+
+ public:
+  AdaptiveSampler() { clear(); }
+
+  void clear() {
+    _mode = SamplerMode::SAMPLER_STARTUP;
+    _count = SAMPLER_COUNT_MAX;
+    _rate = NAN;
+    _noise = NAN;
+    _lastRead = 0;
+    _lastConversions = 0;
+    _first = true;
+  }
+
+  bool isDue(uint32_t now) const {
+    return _first || now - _lastRead >= SAMPLER_INTERVAL;
+  }
+
+  // Called after each read. Conversions is the total number of conversions
+  // collected by the driver (0 when not known), variance the running variance
+  // of the weights and slope the change over the raw history.
+  void update(uint32_t now, uint32_t conversions, float variance, float slope,
+              float deviation) {
+    int used = 0;
+
+    if (!_first && conversions > _lastConversions && now != _lastRead) {
+      uint32_t n = conversions - _lastConversions;
+      float r = n * 1000.0 / (now - _lastRead);
+      used = static_cast<int>(n) < _count ? n : _count;
+      _rate = isnan(_rate) ? r : _rate + SAMPLER_WEIGHT * (r - _rate);
+    }
+
+    _first = false;
+    _lastRead = now;
+    _lastConversions = conversions;
+
+    // Drivers that don't report conversions use all of them
+    if (isnan(_rate)) {
+      _mode = SamplerMode::SAMPLER_STARTUP;
+    } else if (!isnan(slope) && fabs(slope) > deviation) {
+      _mode = SamplerMode::SAMPLER_POUR;
+    } else if (!isnan(variance) && used) {
+      // A read is the average of used conversions, so a single conversion has
+      // used times the variance.
+      float v = variance * used;
+      _noise = isnan(_noise) ? v : _noise + SAMPLER_WEIGHT * (v - _noise);
+      _mode = SamplerMode::SAMPLER_IDLE;
+    }
+
+    switch (_mode) {
+      case SamplerMode::SAMPLER_POUR:
+        _count = clampCount(_rate * SAMPLER_POUR_WINDOW / 1000);
+        break;
+
+      case SamplerMode::SAMPLER_IDLE: {
+        // Older conversions than one interval would make the value lag
+        int fit = clampCount(_rate * SAMPLER_INTERVAL / 1000);
+        _count = clampCount(_noise /
+                            (SAMPLER_NOISE_TARGET * SAMPLER_NOISE_TARGET));
+        if (_count > fit) _count = fit;
+        break;
+      }
+
+      default:
+        _count = SAMPLER_COUNT_MAX;
+        break;
+    }
+  }
+
+  SamplerMode getMode() const { return _mode; }
+  int getCount() const { return _count; }
+  uint32_t getInterval() const { return SAMPLER_INTERVAL; }
+  float getRate() const { return _rate; }
+  float getNoise() const { return _noise; }
+};
+
+#endif  // SRC_SAMPLER_HPP_
+
+// EOF
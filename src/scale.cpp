@@ -21,28 +21,209 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
-#include <kegpush.hpp>
 #include <perf.hpp>
 #include <scale.hpp>
+#include <scale_replay.hpp>
+#if !defined(KEGMON_NATIVE)
+#include <scale_hx711.hpp>
+#include <scale_nau7802.hpp>
+#endif
 
-void Scale::loop(UnitIndex idx) {
-  if (_sched[idx].tare) {
-#if LOG_LEVEL == 6
-    Log.verbose(F("SCAL: Tare triggered [%d]." CR), idx);
+void Scale::setup(bool force) {
+  ScaleSensorType type = myConfig.getScaleSensorType();
+
+  if (!_driver || type != _driverType) {
+    switch (type) {
+#if !defined(KEGMON_NATIVE)
+      case ScaleSensorType::ScaleHX711:
+        Log.info(F("SCAL: Initializing scale driver HX711." CR));
+        _driver.reset(new ScaleDriverHX711);
+        break;
+
+      case ScaleSensorType::ScaleNAU7802:
+        Log.info(F("SCAL: Initializing scale driver NAU7802." CR));
+        _driver.reset(new ScaleDriverNAU7802);
+        break;
 #endif
-    tare(idx);
-    readRaw(idx);
-    _sched[idx].tare = false;
+
+      case ScaleSensorType::ScaleReplay:
+        Log.info(F("SCAL: Initializing scale driver for replay." CR));
+        _driver.reset(
+            new ScaleDriverReplay(SCALE_REPLAY_FILENAME, SCALE_REPLAY_SPEED));
+        break;
+
+      default:
+        Log.error(F("SCAL: Unable to find scale driver type." CR));
+        _driver.reset();
+        return;
+    }
+
+    _driverType = type;
+    _capture.setup();
+    _driver->setCapture(&_capture);
+    _sampler[UnitIndex::U1].clear();
+    _sampler[UnitIndex::U2].clear();
   }
 
-  if (_sched[idx].findFactor) {
-#if LOG_LEVEL == 6
-    Log.verbose(F("SCAL: Find factor triggered [%d]." CR), idx);
+  _driver->setup(force);
+}
+
+void Scale::reconnect() {
+  if (_driver) _driver->setup(false);
+}
+
+float Scale::read(UnitIndex idx, bool skipValidation) {
+#if defined(DEBUG_LINK_SCALES)
+  idx = UnitIndex::U1;
 #endif
-    findFactor(idx, _sched[idx].factorWeight);
-    readRaw(idx);
-    _sched[idx].findFactor = false;
+
+  if (!_driver) return 0;
+
+  updateTables();
+
+  float raw = NAN;
+
+  if (_table[idx].size()) {
+    float c = _driver->readCounts(idx);
+    if (!isnan(c)) raw = _table[idx].convert(c - myConfig.getScaleOffset(idx));
+  }
+
+  if (isnan(raw)) raw = _driver->read(idx);
+
+  if (!skipValidation) {
+    // If the value is higher/lower than 100 kb/lbs then the reading is proably
+    // wrong, just ignore the reading
+    if (raw > 100) {
+      Log.error(F("SCAL: Ignoring value since it's higher than 100kg, %F "
+                  "[%d]." CR),
+                raw, idx);
+      return NAN;
+    }
+
+    if (raw < -100) {
+      Log.error(F("SCAL: Ignoring value since it's less than -100kg %F "
+                  "[%d]." CR),
+                raw, idx);
+      return NAN;
+    }
+  }
+
+  return raw;
+}
+
+void Scale::updateSampler(UnitIndex idx, const LevelSnapshot& levels) {
+  if (!_driver) return;
+
+  AdaptiveSampler& s = _sampler[idx];
+  SamplerMode mode = s.getMode();
+
+  s.update(millis(), _driver->getConversions(idx),
+           levels.getStability(idx)
+               .periodVariance[StabilityPeriod::PERIOD_MINUTE],
+           levels.getSlopeValue(idx), myConfig.getScaleKalmanDeviationValue());
+  _driver->setReadCount(idx, s.getCount());
+
+  if (mode != s.getMode()) {
+    Log.notice(F("SCAL: Sampler mode %d, count=%d, interval=%l ms [%d]." CR),
+               s.getMode(), s.getCount(), s.getInterval(), idx);
+  }
+}
+
+void Scale::calibrate(UnitIndex idx) {
+  ScaleCalibration& c = _calibration[idx];
+  int32_t raw;
+
+  if (!_driver) {
+    c.finish(false);
+    return;
+  }
+
+  while (!c.isComplete() && _driver->pollConversion(idx, raw))
+    c.add(raw, millis());
+
+  if (!c.isComplete()) {
+    if (c.isTimeout(millis())) {
+      Log.error(F("SCAL: No conversions from the scale, calibration "
+                  "failed [%d]." CR),
+                idx);
+      c.finish(false);
+    }
+    return;
+  }
+
+  int32_t l = c.average();
+  _lastRaw[idx] = l;
+
+  if (c.getState() == CalibrationState::CALIBRATION_TARE) {
+    Log.notice(F("SCAL: New scale offset found %l [%d]." CR), l, idx);
+    myConfig.setScaleOffset(idx, l);
+  } else if (c.getState() == CalibrationState::CALIBRATION_POINT) {
+    float counts = l - myConfig.getScaleOffset(idx);
+    Log.notice(F("SCAL: Calibration point for weight %F, counts %F [%d]." CR),
+               c.getWeight(), counts, idx);
+
+    if (!myConfig.addScalePoint(idx, counts, c.getWeight())) {
+      c.finish(false);
+      return;
+    }
+  } else {
+    float f = (l - myConfig.getScaleOffset(idx)) / c.getWeight();
+    Log.notice(
+        F("SCAL: Detecting factor for weight %F, raw %l %F [%d]." CR),
+        c.getWeight(), l, f, idx);
+
+    if (isinf(f) || isnan(f)) f = 0.0;
+
+    myConfig.setScaleFactor(idx, f);
   }
+
+  _driver->applyCalibration(idx);
+  _savePending = true;
+  c.finish(true);
+}
+
+void Scale::updateTables() {
+  // The tables are only built again when the points in the config change
+  if (_tableChanges == myConfig.getScalePointChanges()) return;
+
+  _tableChanges = myConfig.getScalePointChanges();
+  _table[UnitIndex::U1].set(myConfig.getScalePoints(UnitIndex::U1),
+                            myConfig.getScalePointCount(UnitIndex::U1));
+  _table[UnitIndex::U2].set(myConfig.getScalePoints(UnitIndex::U2),
+                            myConfig.getScalePointCount(UnitIndex::U2));
+}
+
+void Scale::saveCalibration() {
+  // Writing the file takes a while so it's done when both scales are idle
+  if (isScheduleRunning() || !_savePending.exchange(false)) return;
+
+  Log.notice(F("SCAL: Saving calibration." CR));
+  myConfig.saveFile();
+}
+
+void Scale::loop(UnitIndex idx) {
+  int state = _request[idx].state.exchange(CalibrationState::CALIBRATION_IDLE,
+                                           std::memory_order_acquire);
+
+  if (_driver) _driver->loop(idx);
+
+  if (state == CalibrationState::CALIBRATION_CLEAR) {
+    // Nothing to measure, the table is built again on the next read
+    Log.notice(F("SCAL: Removing the calibration points [%d]." CR), idx);
+    myConfig.clearScalePoints(idx);
+    _savePending = true;
+  } else if (state != CalibrationState::CALIBRATION_IDLE) {
+    _calibration[idx].start(static_cast<CalibrationState>(state),
+                            myConfig.getScaleReadCountCalibration(),
+                            _request[idx].weight, millis());
+  }
+
+  if (_calibration[idx].isRunning()) calibrate(idx);
+
+  // Progress first so a finished calibration is never shown below 100%
+  _status[idx].progress.store(_calibration[idx].progress());
+  _status[idx].state.store(_calibration[idx].getState(),
+                           std::memory_order_release);
 }
 
 // EOF
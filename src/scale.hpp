@@ -24,112 +24,106 @@ SOFTWARE.
 #ifndef SRC_SCALE_HPP_
 #define SRC_SCALE_HPP_
 
-#include <HX711.h>
-#include <SparkFun_Qwiic_Scale_NAU7802_Arduino_Library.h>
-
+#include <atomic>
+#include <memory>
+#include <calibration.hpp>
 #include <kegconfig.hpp>
 #include <levels.hpp>
 #include <main.hpp>
+#include <sampler.hpp>
+#include <scale_base.hpp>
 
 // #define DEBUG_LINK_SCALES  // For test rig to use one scale for both...
 
 class Scale {
  private:
-  class Schedule {
-   public:
-    bool tare = false;
-    bool findFactor = false;
-    float factorWeight = 0;
+  std::unique_ptr<ScaleDriver> _driver;
+  ScaleSensorType _driverType = ScaleSensorType::ScaleHX711;
+
+  ScaleCalibration _calibration[2];
+  // Calibrations requested from the web, started from loop() so only the
+  // task that reads the scale touches _calibration.
+  struct CalibrationRequest {
+    std::atomic<int> state{CalibrationState::CALIBRATION_IDLE};
+    float weight = 0;
   };
-
-  HX711* _hxScale[2] = {0, 0};
-  NAU7802* _nauScale[2] = {0, 0};
-
-  Schedule _sched[2];
+  CalibrationRequest _request[2];
+  // State and progress of _calibration as seen by the web server and the
+  // save in loop(), published by the scale task after each loop.
+  struct CalibrationStatus {
+    std::atomic<int> state{CalibrationState::CALIBRATION_IDLE};
+    std::atomic<int> progress{0};
+  };
+  CalibrationStatus _status[2];
+  std::atomic<bool> _savePending{false};
+  CalibrationTable _table[2];
+  uint32_t _tableChanges = 0;
+  RawCapture _capture;
   int32_t _lastRaw[2] = {0, 0};
+  AdaptiveSampler _sampler[2];
 
   Scale(const Scale&) = delete;
   void operator=(const Scale&) = delete;
 
-  void tare(UnitIndex idx) {
-    switch (myConfig.getScaleSensorType()) {
-      case ScaleSensorType::ScaleHX711:
-        tareHX711(idx);
-        break;
-      case ScaleNAU7802:
-        tareNAU7802(idx);
-        break;
-    }
-  }
-  void findFactor(UnitIndex idx, float weight) {
-    switch (myConfig.getScaleSensorType()) {
-      case ScaleHX711:
-        findFactorHX711(idx, weight);
-        break;
-      case ScaleSensorType::ScaleNAU7802:
-        findFactorNAU7802(idx, weight);
-        break;
-    }
-  }
-  int32_t readRaw(UnitIndex idx) {
-    if (myConfig.getScaleSensorType() == ScaleSensorType::ScaleHX711)
-      return readRawHX711(idx);
-    else
-      return readRawNAU7802(idx);
+  void calibrate(UnitIndex idx);
+  void updateTables();
+  void requestCalibration(UnitIndex idx, CalibrationState state,
+                          float weight) {
+    _request[idx].weight = weight;
+    _request[idx].state.store(state, std::memory_order_release);
   }
 
-  void setupHX711(bool force);
-  void setupNAU7802(bool force);
-  void setScaleFactorHX711(UnitIndex idx);
-  void setScaleFactorNAU7802(UnitIndex idx);
-  void tareHX711(UnitIndex idx);
-  void tareNAU7802(UnitIndex idx);
-  void findFactorHX711(UnitIndex idx, float weight);
-  void findFactorNAU7802(UnitIndex idx, float weight);
-  float readHX711(UnitIndex idx, bool skipValidation);
-  float readNAU7802(UnitIndex idx, bool skipValidation);
-  int32_t readRawHX711(UnitIndex idx);
-  int32_t readRawNAU7802(UnitIndex idx);
-
  public:
   Scale() {}
 
-  void setup(bool force = false) {
-    switch (myConfig.getScaleSensorType()) {
-      case ScaleSensorType::ScaleHX711:
-        setupHX711(force);
-        break;
-      case ScaleSensorType::ScaleNAU7802:
-        setupNAU7802(force);
-        break;
-    }
-  }
+  // Creates the driver, only call this before the tasks are started since
+  // the driver is used from several tasks.
+  void setup(bool force = false);
+  void reconnect();  // Retries missing scales with the same driver
   void loop(UnitIndex idx);
-  void scheduleTare(UnitIndex idx) { _sched[idx].tare = true; }
+  void scheduleTare(UnitIndex idx) {
+    requestCalibration(idx, CalibrationState::CALIBRATION_TARE, 0);
+  }
   void scheduleFindFactor(UnitIndex idx, float weight) {
-    _sched[idx].findFactor = true;
-    _sched[idx].factorWeight = weight;
+    requestCalibration(idx, CalibrationState::CALIBRATION_FACTOR, weight);
+  }
+  void scheduleAddPoint(UnitIndex idx, float weight) {
+    requestCalibration(idx, CalibrationState::CALIBRATION_POINT, weight);
+  }
+  void scheduleClearPoints(UnitIndex idx) {
+    requestCalibration(idx, CalibrationState::CALIBRATION_CLEAR, 0);
   }
   bool isScheduleRunning() {
-    return _sched[UnitIndex::U1].findFactor ||
-           _sched[UnitIndex::U2].findFactor || _sched[UnitIndex::U1].tare ||
-           _sched[UnitIndex::U2].tare;
+    return _request[UnitIndex::U1].state.load() ||
+           _request[UnitIndex::U2].state.load() ||
+           ScaleCalibration::isRunning(getCalibrationState(UnitIndex::U1)) ||
+           ScaleCalibration::isRunning(getCalibrationState(UnitIndex::U2));
+  }
+  CalibrationState getCalibrationState(UnitIndex idx) {
+    return static_cast<CalibrationState>(
+        _status[idx].state.load(std::memory_order_acquire));
   }
+  int getCalibrationProgress(UnitIndex idx) {
+    return _status[idx].progress.load();
+  }
+  void saveCalibration();
   int32_t readLastRaw(UnitIndex idx) { return _lastRaw[idx]; }
+  ScaleDriver* getDriver() { return _driver.get(); }
+  RawCapture* getCapture() { return &_capture; }
+
+  // Read cadence and count are chosen by the sampler from the level detection
+  bool isReadDue(UnitIndex idx) { return _sampler[idx].isDue(millis()); }
+  void updateSampler(UnitIndex idx, const LevelSnapshot& levels);
+  const AdaptiveSampler* getSampler(UnitIndex idx) { return &_sampler[idx]; }
 
 #if defined(DEBUG_LINK_SCALES)
   bool isConnected(UnitIndex idx) { return true; }
 #else
   bool isConnected(UnitIndex idx) {
-    return _hxScale[idx] != 0 || _nauScale[idx] != 0 ? true : false;
+    return _driver && _driver->isConnected(idx);
   }
 #endif
-  float read(UnitIndex idx, bool skipValidation = false) {
-    if (myConfig.getScaleSensorType() == ScaleSensorType::ScaleHX711)
-      return readHX711(idx, skipValidation);
-    else
-      return readNAU7802(idx, skipValidation);
-  }
+  float read(UnitIndex idx, bool skipValidation = false);
 };
 
 extern Scale myScale;
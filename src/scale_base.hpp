@@ -0,0 +1,74 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SCALE_BASE_HPP_
+#define SRC_SCALE_BASE_HPP_
+
+#include <Arduino.h>
+
+#include <capture.hpp>
+#include <main.hpp>
+
+// Interface for the ADC that reads the load cells, one driver handles both
+// scales. The driver is selected once when the scale is setup.
+class ScaleDriver {
+ protected:
+  RawCapture* _capture = 0;
+
+  // Drivers call this for every conversion collected by loop()
+  void captureConversion(UnitIndex idx, int32_t raw) {
+    if (_capture) _capture->add(idx, raw);
+  }
+
+ public:
+  ScaleDriver() = default;
+  virtual ~ScaleDriver() {}
+
+  void setCapture(RawCapture* capture) { _capture = capture; }
+
+  virtual void setup(bool force) = 0;
+  virtual void loop(UnitIndex idx) {}  // Collect conversions, must not block
+  virtual bool isConnected(UnitIndex idx) = 0;
+
+  // Used by the adaptive sampler, drivers that collect conversions report the
+  // total number collected and average the newest count in read().
+  virtual uint32_t getConversions(UnitIndex idx) { return 0; }
+  virtual void setReadCount(UnitIndex idx, int count) {}
+
+  virtual float read(UnitIndex idx) = 0;      // Weight in kg
+  virtual int32_t readRaw(UnitIndex idx) = 0;  // Value without scale factor
+
+  // Conversions behind the next weight without offset and factor, NAN when
+  // the driver has no counts. Used with the multi point calibration.
+  virtual float readCounts(UnitIndex idx) { return NAN; }
+
+  // Calibration, returns the newest conversion collected by loop() once.
+  // After the offset or factor has changed in the configuration it is applied
+  // with applyCalibration().
+  virtual bool pollConversion(UnitIndex idx, int32_t& raw) { return false; }
+  virtual void applyCalibration(UnitIndex idx) = 0;
+};
+
+#endif  // SRC_SCALE_BASE_HPP_
+
+// EOF
@@ -21,13 +21,27 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
-#include <kegpush.hpp>
+#include <kegconfig.hpp>
 #include <perf.hpp>
-#include <scale.hpp>
+#include <scale_hx711.hpp>
 
-void Scale::setupHX711(bool force) {
+ScaleDriverHX711::~ScaleDriverHX711() {
+  for (int i = 0; i < 2; i++) {
+    if (_hxScale[i]) delete _hxScale[i];
+#if defined(ENABLE_HX711_SPI)
+    if (_hxSpi[i]) delete _hxSpi[i];
+#endif
+  }
+}
+
+void ScaleDriverHX711::setup(bool force) {
   if (!_hxScale[0] || force) {
     if (_hxScale[0]) delete _hxScale[0];
+#if defined(ENABLE_HX711_SPI)
+    if (_hxSpi[0]) delete _hxSpi[0];
+    _hxSpi[0] = 0;
+#endif
+    _hxSamples[0].clear();
 
 #if LOG_LEVEL == 6
     Log.verbose(F("SCAL: HX711 initializing scale [0], using offset %l." CR),
@@ -43,6 +57,11 @@ void Scale::setupHX711(bool force) {
     if (_hxScale[0]->wait_ready_timeout(500)) {
       Log.notice(F("SCAL: HX711 scale [0] found." CR));
       _hxScale[0]->get_units(1);
+#if defined(ENABLE_HX711_SPI)
+      _hxSpi[0] = new HX711Spi(FSPI);
+      _hxSpi[0]->begin(myConfig.getPinScale1Data(),
+                        myConfig.getPinScale1Clock());
+#endif
     } else {
       Log.error(
           F("SCAL: HX711 scale [0] not responding, disabling interface." CR));
@@ -53,6 +72,11 @@ void Scale::setupHX711(bool force) {
 
   if (!_hxScale[1] || force) {
     if (_hxScale[1]) delete _hxScale[1];
+#if defined(ENABLE_HX711_SPI)
+    if (_hxSpi[1]) delete _hxSpi[1];
+    _hxSpi[1] = 0;
+#endif
+    _hxSamples[1].clear();
 
 #if LOG_LEVEL == 6
     Log.verbose(F("SCAL: HX711 initializing [1], using offset %l." CR),
@@ -68,6 +92,11 @@ void Scale::setupHX711(bool force) {
     if (_hxScale[1]->wait_ready_timeout(500)) {
       Log.notice(F("SCAL: HX711 scale [1] found." CR));
       _hxScale[1]->get_units(1);
+#if defined(ENABLE_HX711_SPI)
+      _hxSpi[1] = new HX711Spi(HSPI);
+      _hxSpi[1]->begin(myConfig.getPinScale2Data(),
+                        myConfig.getPinScale2Clock());
+#endif
     } else {
       Log.error(
           F("SCAL: HX711 scale [1] not responding, disabling interface." CR));
@@ -76,11 +105,11 @@ void Scale::setupHX711(bool force) {
     }
   }
 
-  setScaleFactorHX711(UnitIndex::U1);
-  setScaleFactorHX711(UnitIndex::U2);
+  setScaleFactor(UnitIndex::U1);
+  setScaleFactor(UnitIndex::U2);
 }
 
-void Scale::setScaleFactorHX711(UnitIndex idx) {
+void ScaleDriverHX711::setScaleFactor(UnitIndex idx) {
   if (!_hxScale[idx]) return;
 
   float fs = myConfig.getScaleFactor(idx);
@@ -90,11 +119,106 @@ void Scale::setScaleFactorHX711(UnitIndex idx) {
   _hxScale[idx]->set_scale(fs);
 }
 
-float Scale::readHX711(UnitIndex idx, bool skipValidation) {
-#if defined(DEBUG_LINK_SCALES)
-  idx = UnitIndex::U1;
+#if !defined(ESP8266)
+static portMUX_TYPE hx711Mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+void ScaleDriverHX711::loop(UnitIndex idx) {
+  // The conversion is only clocked out when DOUT shows that it is ready, this
+  // takes less than 100 us so the loop never waits for the ADC.
+  if (isPair()) {
+    if (idx != UnitIndex::U1 || !_hxScale[0]->is_ready() ||
+        !_hxScale[1]->is_ready())
+      return;
+
+    int32_t raw[2];
+    readPair(raw);
+    addConversion(UnitIndex::U1, raw[0]);
+    addConversion(UnitIndex::U2, raw[1]);
+    return;
+  }
+
+  if (!_hxScale[idx] || !_hxScale[idx]->is_ready()) return;
+
+  addConversion(idx, readConversion(idx));
+}
+
+int32_t ScaleDriverHX711::readConversion(UnitIndex idx) {
+#if defined(ENABLE_HX711_SPI)
+  if (_hxSpi[idx]) {
+    _hxScale[idx]->wait_ready();
+    return _hxSpi[idx]->read();
+  }
+#endif
+  return _hxScale[idx]->read();
+}
+
+float ScaleDriverHX711::readAverage(UnitIndex idx, int count) {
+  if (count < 1) count = 1;
+
+  int64_t sum = 0;
+  for (int i = 0; i < count; i++) sum += readConversion(idx);
+
+  return static_cast<float>(sum) / count;
+}
+
+void ScaleDriverHX711::readPair(int32_t (&raw)[2]) {
+  // Same timing as HX711::read() but both chips share the clock pulses, so
+  // interrupts are only disabled once for the two conversions.
+  uint8_t clock1 = myConfig.getPinScale1Clock();
+  uint8_t clock2 = myConfig.getPinScale2Clock();
+  uint8_t data1 = myConfig.getPinScale1Data();
+  uint8_t data2 = myConfig.getPinScale2Data();
+  uint32_t v1 = 0, v2 = 0;
+
+#if defined(ESP8266)
+  noInterrupts();
+#else
+  portENTER_CRITICAL(&hx711Mux);
+#endif
+
+  for (int i = 0; i < HX711_PULSES; i++) {
+    digitalWrite(clock1, HIGH);
+    digitalWrite(clock2, HIGH);
+    delayMicroseconds(1);
+    if (i < HX711_DATA_BITS) {
+      v1 = (v1 << 1) | digitalRead(data1);
+      v2 = (v2 << 1) | digitalRead(data2);
+    }
+    digitalWrite(clock1, LOW);
+    digitalWrite(clock2, LOW);
+    delayMicroseconds(1);
+  }
+
+#if defined(ESP8266)
+  interrupts();
+#else
+  portEXIT_CRITICAL(&hx711Mux);
+#endif
+
+  raw[0] = hx711SignExtend(v1);
+  raw[1] = hx711SignExtend(v2);
+}
+
+float ScaleDriverHX711::readCounts(UnitIndex idx) {
+  if (!_hxScale[idx]) return NAN;
+
+  if (_hxSamples[idx].count()) {
+    float c = _hxSamples[idx].average();
+#if LOG_LEVEL == 6
+    Log.verbose(F("SCAL: HX711 Using %d collected conversions [%d]" CR),
+                _hxSamples[idx].count(), idx);
 #endif
+    _hxSamples[idx].clear();
+    return c;
+  }
+
+  // Nothing collected yet (startup or the chip stopped), the level detection
+  // skips the value instead of this waiting for the ADC
+  return NAN;
+}
 
+float ScaleDriverHX711::read(UnitIndex idx) {
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: HX711 reading scale for [%d]." CR), idx);
 #endif
@@ -108,63 +232,26 @@ float Scale::readHX711(UnitIndex idx, bool skipValidation) {
   if (!_hxScale[idx]) return 0;
 
   PERF_BEGIN("scale-read");
-  float raw = _hxScale[idx]->get_units(myConfig.getScaleReadCount());
+  float raw = (readCounts(idx) - _hxScale[idx]->get_offset()) /
+              _hxScale[idx]->get_scale();
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: HX711 Reading weight=%F [%d]" CR), raw, idx);
 #endif
 
-  if (!skipValidation) {
-    // If the value is higher/lower than 100 kb/lbs then the reading is proably
-    // wrong, just ignore the reading
-    if (raw > 100) {
-      Log.error(F("SCAL: HX711 Ignoring value since it's higher than 100kg, %F "
-                  "[%d]." CR),
-                raw, idx);
-      PERF_END("scale-read");
-      return NAN;
-    }
-
-    if (raw < -100) {
-      Log.error(F("SCAL: HX711 Ignoring value since it's less than -100kg %F "
-                  "[%d]." CR),
-                raw, idx);
-      PERF_END("scale-read");
-      return NAN;
-    }
-  }
-
   PERF_END("scale-read");
   return raw;
 }
 
-void Scale::tareHX711(UnitIndex idx) {
-  if (!_hxScale[idx]) return;
-
-  Log.notice(
-      F("SCAL: HX711 set scale to zero, prepare for calibration %d [%d]." CR),
-      myConfig.getScaleReadCountCalibration(), idx);
-
-  _hxScale[idx]->set_scale(1.0);
-  _hxScale[idx]->tare(myConfig.getScaleReadCountCalibration());
-  int32_t l = _hxScale[idx]->get_offset();
-  Log.verbose(F("SCAL: HX711 New scale offset found %l [%d]." CR), l, idx);
-  myConfig.setScaleOffset(idx, l);
-  myConfig.saveFile();
-}
-
-int32_t Scale::readRawHX711(UnitIndex idx) {
-#if defined(DEBUG_LINK_SCALES)
-  idx = UnitIndex::U1;
-#endif
+int32_t ScaleDriverHX711::readRaw(UnitIndex idx) {
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: HX711 Reading raw scale for [%d]." CR), idx);
 #endif
   if (!_hxScale[idx]) return 0;
   PERF_BEGIN("scale-readraw");
-  int32_t l = _hxScale[idx]->read_average(
-      myConfig.getScaleReadCountCalibration());  // get the raw value without
-                                                 // applying scaling factor
-  _lastRaw[idx] = l;
+  int32_t l = readAverage(
+      idx, myConfig.getScaleReadCountCalibration());  // get the raw value
+                                                      // without applying
+                                                      // scaling factor
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: HX711 Reading scale raw weight=%d [%d]" CR), l, idx);
 #endif
@@ -172,22 +259,21 @@ int32_t Scale::readRawHX711(UnitIndex idx) {
   return l;
 }
 
-void Scale::findFactorHX711(UnitIndex idx, float weight) {
-  if (!_hxScale[idx]) return;
-
-  float l = _hxScale[idx]->get_units(myConfig.getScaleReadCountCalibration());
-  float f = l / weight;
-  Log.notice(
-      F("SCAL: HX711 Detecting factor for weight %F, raw %l %F [%d]." CR),
-      weight, l, f, idx);
+bool ScaleDriverHX711::pollConversion(UnitIndex idx, int32_t& raw) {
+  if (!_hxHasLatest[idx]) return false;
 
-  if (isinf(f) || isnan(f)) f = 0.0;
+  raw = _hxLatest[idx];
+  _hxHasLatest[idx] = false;
+  return true;
+}
 
-  myConfig.setScaleFactor(idx, f);
-  myConfig.saveFile();  // save the factor to file
+void ScaleDriverHX711::applyCalibration(UnitIndex idx) {
+  if (!_hxScale[idx]) return;
 
-  setScaleFactorHX711(idx);  // apply the factor after it has been saved
-  readHX711(idx, true);
+  _hxScale[idx]->set_offset(myConfig.getScaleOffset(idx));
+  setScaleFactor(idx);
+  Log.notice(F("SCAL: HX711 Using offset %l and factor %F [%d]." CR),
+             _hxScale[idx]->get_offset(), _hxScale[idx]->get_scale(), idx);
 }
 
 // EOF
@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SCALE_HX711_HPP_
+#define SRC_SCALE_HX711_HPP_
+
+#include <HX711.h>
+
+#include <hx711spi.hpp>
+#include <rollingwindow.hpp>
+#include <scale_base.hpp>
+
+constexpr auto HX711_SAMPLE_MAX = 32;  // Conversions kept between two reads
+
+class ScaleDriverHX711 : public ScaleDriver {
+ private:
+  HX711* _hxScale[2] = {0, 0};
+#if defined(ENABLE_HX711_SPI)
+  HX711Spi* _hxSpi[2] = {0, 0};
+#endif
+
+  // Raw conversions collected by loop() since the last read, the window size
+  // is the read count chosen by the sampler.
+  RollingWindow<HX711_SAMPLE_MAX> _hxSamples[2];
+  uint32_t _hxConversions[2] = {0, 0};
+  int32_t _hxLatest[2] = {0, 0};
+  bool _hxHasLatest[2] = {false, false};
+
+  ScaleDriverHX711(const ScaleDriverHX711&) = delete;
+  void operator=(const ScaleDriverHX711&) = delete;
+
+  void setScaleFactor(UnitIndex idx);
+  void readPair(int32_t (&raw)[2]);
+  int32_t readConversion(UnitIndex idx);
+  float readAverage(UnitIndex idx, int count);
+  void addConversion(UnitIndex idx, int32_t raw) {
+    _hxSamples[idx].add(raw);
+    _hxConversions[idx]++;
+    _hxLatest[idx] = raw;
+    _hxHasLatest[idx] = true;
+    captureConversion(idx, raw);
+  }
+
+ public:
+  ScaleDriverHX711() {}
+  ~ScaleDriverHX711();
+
+  void setup(bool force) override;
+  void loop(UnitIndex idx) override;
+  bool isConnected(UnitIndex idx) override { return _hxScale[idx] != 0; }
+  uint32_t getConversions(UnitIndex idx) override {
+    return _hxConversions[idx];
+  }
+  void setReadCount(UnitIndex idx, int count) override {
+    _hxSamples[idx].setSize(count);  // Only cleared when the size changes
+  }
+
+  float read(UnitIndex idx) override;
+  float readCounts(UnitIndex idx) override;
+  int32_t readRaw(UnitIndex idx) override;
+  bool pollConversion(UnitIndex idx, int32_t& raw) override;
+  void applyCalibration(UnitIndex idx) override;
+
+  // Both HX711 are read in one pass when they are connected, not needed when
+  // the SPI peripheral generates the clock.
+#if defined(ENABLE_HX711_SPI)
+  bool isPair() { return false; }
+#else
+  bool isPair() { return _hxScale[0] != 0 && _hxScale[1] != 0; }
+#endif
+};
+
+#endif  // SRC_SCALE_HX711_HPP_
+
+// EOF
@@ -21,18 +21,25 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
-#include <kegpush.hpp>
+#include <kegconfig.hpp>
 #include <perf.hpp>
-#include <scale.hpp>
+#include <scale_nau7802.hpp>
 
 // NOTE! Since the esp8266 only suppors one I2C bus we need a different hardware
 // design with a multiplexer to support multiple NAU on that platform. ESP32
 // however supports two I2C busses so that is the prefered platform is NAU is to
 // be used.
 
-void Scale::setupNAU7802(bool force) {
+ScaleDriverNAU7802::~ScaleDriverNAU7802() {
+  for (int i = 0; i < 2; i++) {
+    if (_nauScale[i]) delete _nauScale[i];
+  }
+}
+
+void ScaleDriverNAU7802::setup(bool force) {
   if (!_nauScale[0] || force) {
     if (_nauScale[0]) delete _nauScale[0];
+    _nauFilter[0].clear();
 
 #if LOG_LEVEL == 6
     Log.verbose(F("SCAL: NAU7802 initializing scale [0]." CR));
@@ -58,6 +65,7 @@ void Scale::setupNAU7802(bool force) {
 
   if (!_nauScale[1] || force) {
     if (_nauScale[1]) delete _nauScale[1];
+    _nauFilter[1].clear();
 
 #if defined(ESP8266)
     Log.error(
@@ -94,11 +102,11 @@ void Scale::setupNAU7802(bool force) {
 #endif
   }
 
-  setScaleFactorNAU7802(UnitIndex::U1);
-  setScaleFactorNAU7802(UnitIndex::U2);
+  setScaleFactor(UnitIndex::U1);
+  setScaleFactor(UnitIndex::U2);
 }
 
-void Scale::setScaleFactorNAU7802(UnitIndex idx) {
+void ScaleDriverNAU7802::setScaleFactor(UnitIndex idx) {
   if (!_nauScale[idx]) return;
 
   float fs = myConfig.getScaleFactor(idx);
@@ -109,11 +117,27 @@ void Scale::setScaleFactorNAU7802(UnitIndex idx) {
       fs);  // apply the saved scale factor so we get valid results
 }
 
-float Scale::readNAU7802(UnitIndex idx, bool skipValidation) {
-#if defined(DEBUG_LINK_SCALES)
-  idx = UnitIndex::U1;
-#endif
+void ScaleDriverNAU7802::loop(UnitIndex idx) {
+  // The chip converts continuously at 320 SPS, a ready conversion is read and
+  // added to the decimation filter without waiting.
+  if (!_nauScale[idx] || !_nauScale[idx]->available()) return;
+
+  _nauLatest[idx] = _nauScale[idx]->getReading();
+  _nauHasLatest[idx] = true;
+  captureConversion(idx, _nauLatest[idx]);
+  _nauFilter[idx].setFactor(myConfig.getScaleDecimation());
+  _nauFilter[idx].add(_nauLatest[idx]);
+}
+
+float ScaleDriverNAU7802::readCounts(UnitIndex idx) {
+  if (!_nauScale[idx]) return NAN;
+
+  if (_nauFilter[idx].hasOutput()) return _nauFilter[idx].output();
 
+  return _nauScale[idx]->getAverage(8);  // Same as getWeight()
+}
+
+float ScaleDriverNAU7802::read(UnitIndex idx) {
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: NAU7802 reading scale for [%d]." CR), idx);
 #endif
@@ -127,64 +151,39 @@ float Scale::readNAU7802(UnitIndex idx, bool skipValidation) {
   if (!_nauScale[idx]) return 0;
 
   PERF_BEGIN("scale-read");
-  float raw = _nauScale[idx]->getWeight(true);  // default is 8 reads
+  float raw;
+
+  if (_nauFilter[idx].hasOutput()) {
+    raw = (readCounts(idx) - _nauScale[idx]->getZeroOffset()) /
+          _nauScale[idx]->getCalibrationFactor();
+  } else {
+    // The filter has not produced a value yet (startup)
+    raw = _nauScale[idx]->getWeight(true);  // default is 8 reads
+  }
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: NAU7802 Reading weight=%F [%d]" CR), raw, idx);
 #endif
 
-  if (!skipValidation) {
-    // If the value is higher/lower than 100 kb/lbs then the reading is proably
-    // wrong, just ignore the reading
-    if (raw > 100) {
-      Log.error(
-          F("SCAL: NAU7802 Ignoring value since it's higher than 100kg, %F "
-            "[%d]." CR),
-          raw, idx);
-      PERF_END("scale-read");
-      return NAN;
-    }
-
-    if (raw < -100) {
-      Log.error(F("SCAL: NAU7802 Ignoring value since it's less than -100kg %F "
-                  "[%d]." CR),
-                raw, idx);
-      PERF_END("scale-read");
-      return NAN;
-    }
-  }
-
   PERF_END("scale-read");
   return raw;
 }
 
-void Scale::tareNAU7802(UnitIndex idx) {
-  if (!_nauScale[idx]) return;
-
-  Log.notice(
-      F("SCAL: NAU7802 set scale to zero, prepare for calibration [%d]." CR),
-      idx);
-
-  _nauScale[idx]->calculateZeroOffset();  // Default is 8 reads
-  int32_t l = _nauScale[idx]->getZeroOffset();
-  Log.verbose(F("SCAL: NAU7802 New scale offset found %l [%d]." CR), l, idx);
-  myConfig.setScaleOffset(idx, l);
-  myConfig.saveFile();
-}
-
-int32_t Scale::readRawNAU7802(UnitIndex idx) {
-#if defined(DEBUG_LINK_SCALES)
-  idx = UnitIndex::U1;
-#endif
+int32_t ScaleDriverNAU7802::readRaw(UnitIndex idx) {
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: NAU7802 Reading raw scale for [%d]." CR), idx);
 #endif
   if (!_nauScale[idx]) return 0;
   PERF_BEGIN("scale-readraw");
-  while (!_nauScale[idx]->available()) {
-    delay(1);
+  int32_t l;
+
+  if (_nauFilter[idx].hasOutput()) {
+    l = _nauFilter[idx].output();
+  } else {
+    while (!_nauScale[idx]->available()) {
+      delay(1);
+    }
+    l = _nauScale[idx]->getReading();
   }
-  int32_t l = _nauScale[idx]->getReading();
-  _lastRaw[idx] = l;
 #if LOG_LEVEL == 6
   Log.verbose(F("SCAL: NAU7802 Reading scale raw weight=%d [%d]" CR), l, idx);
 #endif
@@ -192,19 +191,22 @@ int32_t Scale::readRawNAU7802(UnitIndex idx) {
   return l;
 }
 
-void Scale::findFactorNAU7802(UnitIndex idx, float weight) {
-  if (!_nauScale[idx]) return;
+bool ScaleDriverNAU7802::pollConversion(UnitIndex idx, int32_t& raw) {
+  if (!_nauHasLatest[idx]) return false;
 
-  _nauScale[idx]->calculateCalibrationFactor(
-      weight, myConfig.getScaleReadCountCalibration());
-  float f = _nauScale[idx]->getCalibrationFactor();
-  Log.notice(
-      F("SCAL: NAU7802 Detecting factor for weight %F, factor %F [%d]." CR),
-      weight, f, idx);
+  raw = _nauLatest[idx];
+  _nauHasLatest[idx] = false;
+  return true;
+}
+
+void ScaleDriverNAU7802::applyCalibration(UnitIndex idx) {
+  if (!_nauScale[idx]) return;
 
-  myConfig.setScaleFactor(idx, f);
-  myConfig.saveFile();
-  readNAU7802(idx, true);
+  _nauScale[idx]->setZeroOffset(myConfig.getScaleOffset(idx));
+  setScaleFactor(idx);
+  Log.notice(F("SCAL: NAU7802 Using offset %l and factor %F [%d]." CR),
+             _nauScale[idx]->getZeroOffset(),
+             _nauScale[idx]->getCalibrationFactor(), idx);
 }
 
 // EOF
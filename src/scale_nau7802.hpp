@@ -0,0 +1,65 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SCALE_NAU7802_HPP_
+#define SRC_SCALE_NAU7802_HPP_
+
+#include <SparkFun_Qwiic_Scale_NAU7802_Arduino_Library.h>
+
+#include <decimator.hpp>
+#include <scale_base.hpp>
+
+constexpr auto NAU7802_CIC_ORDER = 2;
+
+class ScaleDriverNAU7802 : public ScaleDriver {
+ private:
+  NAU7802* _nauScale[2] = {0, 0};
+
+  // The chip runs continuously, every conversion is filtered by loop()
+  CicDecimator<NAU7802_CIC_ORDER> _nauFilter[2];
+  int32_t _nauLatest[2] = {0, 0};
+  bool _nauHasLatest[2] = {false, false};
+
+  ScaleDriverNAU7802(const ScaleDriverNAU7802&) = delete;
+  void operator=(const ScaleDriverNAU7802&) = delete;
+
+  void setScaleFactor(UnitIndex idx);
+
+ public:
+  ScaleDriverNAU7802() {}
+  ~ScaleDriverNAU7802();
+
+  void setup(bool force) override;
+  void loop(UnitIndex idx) override;
+  bool isConnected(UnitIndex idx) override { return _nauScale[idx] != 0; }
+
+  float read(UnitIndex idx) override;
+  float readCounts(UnitIndex idx) override;
+  int32_t readRaw(UnitIndex idx) override;
+  bool pollConversion(UnitIndex idx, int32_t& raw) override;
+  void applyCalibration(UnitIndex idx) override;
+};
+
+#endif  // SRC_SCALE_NAU7802_HPP_
+
+// EOF
@@ -0,0 +1,90 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <log.hpp>
+#include <scale_replay.hpp>
+
+void ScaleDriverReplay::setup(bool force) {
+  if (_dataset.isOpen() && !force) return;
+
+  if (!_dataset.open(_file)) {
+    Log.error(F("SCAL: Unable to open dataset %s for replay." CR), _file);
+    return;
+  }
+
+  Log.notice(F("SCAL: Replaying %d records from %s, speed %F." CR),
+             _dataset.count(), _file, _speed);
+  _hasCurrent = false;
+  restart();
+}
+
+void ScaleDriverReplay::restart() {
+  _dataset.rewind();
+  _hasNext = _dataset.next(_next);
+  _first = _next.time;
+  _start = millis();
+}
+
+// Moves to the next record, returns false when the dataset has started over.
+bool ScaleDriverReplay::advance() {
+  if (!_hasNext) return false;
+
+  _current = _next;
+  _hasCurrent = true;
+  _hasNext = _dataset.next(_next);
+
+  if (!_hasNext) {
+    Log.notice(F("SCAL: End of dataset reached, starting over." CR));
+    restart();
+    return false;
+  }
+
+  return true;
+}
+
+void ScaleDriverReplay::loop(UnitIndex idx) {
+  if (idx != UnitIndex::U1 || _speed <= 0 || !_dataset.isOpen()) return;
+
+  uint32_t elapsed = (millis() - _start) * _speed;
+
+  while (_hasNext && _next.time - _first <= elapsed) {
+    if (!advance()) break;
+  }
+}
+
+float ScaleDriverReplay::read(UnitIndex idx) {
+  if (!_dataset.isOpen()) return NAN;
+
+  if (_speed <= 0 && idx == UnitIndex::U1) advance();
+
+  if (!_hasCurrent) return NAN;
+
+  return idx == UnitIndex::U1 ? _current.scale1 : _current.scale2;
+}
+
+void ScaleDriverReplay::applyCalibration(UnitIndex idx) {
+  Log.notice(F("SCAL: Calibration is not used when replaying data [%d]." CR),
+             idx);
+}
+
+// EOF
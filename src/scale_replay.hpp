@@ -0,0 +1,74 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SCALE_REPLAY_HPP_
+#define SRC_SCALE_REPLAY_HPP_
+
+#include <dataset.hpp>
+#include <scale_base.hpp>
+
+constexpr auto SCALE_REPLAY_FILENAME = "/simulated.kds";
+
+// Playback speed, 1 is real time and 0 steps one record for every read
+#if !defined(SCALE_REPLAY_SPEED)
+#define SCALE_REPLAY_SPEED 1.0
+#endif
+
+// Streams the weights from a recorded dataset (.kds) instead of reading an
+// ADC, the dataset starts over when the end is reached.
+class ScaleDriverReplay : public ScaleDriver {
+ private:
+  DatasetReader _dataset;
+  const char* _file;
+  float _speed;
+  DatasetRecord _current;
+  DatasetRecord _next;
+  bool _hasCurrent = false;
+  bool _hasNext = false;
+  uint32_t _start = 0;  // Time when the playback started (ms)
+  uint32_t _first = 0;  // Time of the first record (ms)
+
+  ScaleDriverReplay(const ScaleDriverReplay&) = delete;
+  void operator=(const ScaleDriverReplay&) = delete;
+
+  void restart();
+  bool advance();
+
+ public:
+  ScaleDriverReplay(const char* file, float speed)
+      : _file(file), _speed(speed) {}
+
+  void setup(bool force) override;
+  void loop(UnitIndex idx) override;
+  bool isConnected(UnitIndex idx) override { return _dataset.isOpen(); }
+
+  float read(UnitIndex idx) override;
+  int32_t readRaw(UnitIndex idx) override { return 0; }
+  void applyCalibration(UnitIndex idx) override;
+
+  uint32_t index() const { return _dataset.index(); }
+};
+
+#endif  // SRC_SCALE_REPLAY_HPP_
+
+// EOF
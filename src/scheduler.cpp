@@ -0,0 +1,145 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <log.hpp>
+#include <scheduler.hpp>
+
+void Scheduler::swap(int a, int b) {
+  int t = _heap[a];
+  _heap[a] = _heap[b];
+  _heap[b] = t;
+}
+
+void Scheduler::siftUp(int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!before(i, parent)) break;
+    swap(i, parent);
+    i = parent;
+  }
+}
+
+void Scheduler::siftDown(int i) {
+  for (;;) {
+    int first = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+
+    if (left < _count && before(left, first)) first = left;
+    if (right < _count && before(right, first)) first = right;
+    if (first == i) break;
+    swap(i, first);
+    i = first;
+  }
+}
+
+int Scheduler::add(const char* name, SchedulerCallback callback,
+                   uint32_t period, uint32_t jitter, int32_t delay,
+                   uint32_t now) {
+  if (_count >= SCHEDULER_TASKS_MAX || !callback || !period) {
+    Log.error(F("SCHD: Unable to add task %s." CR), name);
+    return -1;
+  }
+
+  if (delay < 0) delay = period + (_count * SCHEDULER_SPREAD) % period;
+
+  int id = _count++;
+  SchedulerTask& t = _tasks[id];
+  t = SchedulerTask();
+  t.name = name;
+  t.callback = callback;
+  t.period = period;
+  t.jitter = jitter;
+  t.next = now + delay;
+
+  _heap[id] = id;
+  siftUp(id);
+
+  Log.verbose(F("SCHD: Added task %s, period %u ms, first run in %l ms." CR),
+              name, period, delay);
+  return id;
+}
+
+bool Scheduler::loop(uint32_t now) {
+  if (!_count) return false;
+
+  SchedulerTask& t = _tasks[_heap[0]];
+  uint32_t late = now - t.next;
+
+  if (static_cast<int32_t>(late) < 0) return false;
+
+  uint32_t start = micros();
+  t.callback();
+  uint32_t time = micros() - start;
+
+  t.runs++;
+  t.lastTime = time;
+  t.totalTime += time;
+  if (time > t.maxTime) t.maxTime = time;
+  if (late > t.jitter) t.late++;
+  if (late > t.maxLate) t.maxLate = late;
+
+  // Keep the phase, periods that were missed completely are dropped instead
+  // of being run back to back.
+  t.next += t.period;
+  if (static_cast<int32_t>(now - t.next) >= 0) {
+    uint32_t missed = (now - t.next) / t.period + 1;
+    t.next += missed * t.period;
+    t.skipped += missed;
+  }
+
+  siftDown(0);
+  return true;
+}
+
+void Scheduler::trigger(int id, uint32_t now) {
+  for (int i = 0; i < _count; i++) {
+    if (_heap[i] == id) {
+      if (static_cast<int32_t>(_tasks[id].next - now) > 0) {
+        _tasks[id].next = now;
+        siftUp(i);
+      }
+      return;
+    }
+  }
+}
+
+void Scheduler::clearStatistics() {
+  for (int i = 0; i < _count; i++) {
+    SchedulerTask& t = _tasks[i];
+    t.runs = t.late = t.skipped = t.maxLate = t.lastTime = t.maxTime = 0;
+    t.totalTime = 0;
+  }
+}
+
+void Scheduler::logStatistics() const {
+  for (int i = 0; i < _count; i++) {
+    const SchedulerTask& t = _tasks[i];
+    Log.notice(F("SCHD: Task %s runs=%u,late=%u,skipped=%u,max-late=%u ms,"
+                 "average=%u us,max=%u us." CR),
+               t.name, t.runs, t.late, t.skipped, t.maxLate, t.averageTime(),
+               t.maxTime);
+  }
+}
+
+// EOF
@@ -0,0 +1,106 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SCHEDULER_HPP_
+#define SRC_SCHEDULER_HPP_
+
+#include <Arduino.h>
+
+constexpr auto SCHEDULER_TASKS_MAX = 12;
+constexpr auto SCHEDULER_SPREAD = 250;  // ms between the first run of tasks
+
+typedef void (*SchedulerCallback)();
+
+struct SchedulerTask {
+  const char* name;
+  SchedulerCallback callback;
+  uint32_t period;  // ms
+  uint32_t jitter;  // ms a run can be late before it's counted as late
+  uint32_t next;    // millis() when the task is due
+
+  // Statistics
+  uint32_t runs;
+  uint32_t late;     // Runs that started more than jitter after the deadline
+  uint32_t skipped;  // Periods dropped when the task fell behind
+  uint32_t maxLate;  // ms
+  uint32_t lastTime;  // us
+  uint32_t maxTime;   // us
+  uint64_t totalTime;  // us
+
+  uint32_t averageTime() const {
+    return runs ? static_cast<uint32_t>(totalTime / runs) : 0;
+  }
+};
+
+// Runs periodic work from loop() ordered on the deadline (min-heap). At most
+// one task is run for each call so work that is due at the same time is
+// spread over consecutive loops instead of landing in the same one, the
+// scale reads and the web server run in between.
+class Scheduler {
+ private:
+  SchedulerTask _tasks[SCHEDULER_TASKS_MAX];
+  int _heap[SCHEDULER_TASKS_MAX];  // Index into _tasks, earliest deadline first
+  int _count = 0;
+
+  bool before(int a, int b) const {
+    return static_cast<int32_t>(_tasks[_heap[a]].next -
+                                _tasks[_heap[b]].next) < 0;
+  }
+  void swap(int a, int b);
+  void siftUp(int i);
+  void siftDown(int i);
+
+ public:
+  // The first run is after delay ms. A negative delay waits one period and
+  // staggers the task against the ones already added, so tasks with related
+  // periods don't share the same phase.
+  int add(const char* name, SchedulerCallback callback, uint32_t period,
+          uint32_t jitter, int32_t delay = -1) {
+    return add(name, callback, period, jitter, delay, millis());
+  }
+  int add(const char* name, SchedulerCallback callback, uint32_t period,
+          uint32_t jitter, int32_t delay, uint32_t now);
+
+  bool loop() { return loop(millis()); }
+  bool loop(uint32_t now);  // Returns true when a task was run
+
+  // Run the task on the next loop.
+  void trigger(int id) { trigger(id, millis()); }
+  void trigger(int id, uint32_t now);
+
+  int size() const { return _count; }
+  const SchedulerTask* getTask(int id) const {
+    return id >= 0 && id < _count ? &_tasks[id] : nullptr;
+  }
+  uint32_t getNext() const {  // Deadline of the first task
+    return _count ? _tasks[_heap[0]].next : 0;
+  }
+  void clearStatistics();
+  void logStatistics() const;
+};
+
+extern Scheduler myScheduler;
+
+#endif  // SRC_SCHEDULER_HPP_
+
+// EOF
@@ -0,0 +1,75 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_SPSCQUEUE_HPP_
+#define SRC_SPSCQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+// Lock free ring buffer for one producer and one consumer, for example an
+// acquisition task and a processing task. N must be a power of two, the
+// indexes run freely and are masked on access so all N slots are used.
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ private:
+  T _buf[N];
+  std::atomic<size_t> _head{0};  // Next slot to read, owned by the consumer
+  std::atomic<size_t> _tail{0};  // Next slot to write, owned by the producer
+
+ public:
+  // Producer side, returns false when the queue is full.
+  bool push(const T& item) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail - _head.load(std::memory_order_acquire) >= N) return false;
+
+    _buf[tail & (N - 1)] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, returns false when the queue is empty.
+  bool pop(T& item) {
+    size_t head = _head.load(std::memory_order_relaxed);
+
+    if (head == _tail.load(std::memory_order_acquire)) return false;
+
+    item = _buf[head & (N - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return _tail.load(std::memory_order_acquire) -
+           _head.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  constexpr size_t capacity() const { return N; }
+};
+
+#endif  // SRC_SPSCQUEUE_HPP_
+
+// EOF
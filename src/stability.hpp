@@ -24,25 +24,158 @@ SOFTWARE.
 #ifndef SRC_STABILITY_HPP_
 #define SRC_STABILITY_HPP_
 
-#include <Statistic.h>
+#include <Arduino.h>
+
+constexpr auto STABILITY_WINDOW = 120;  // Values in the window (4 min at 2s)
+constexpr auto STABILITY_EWMA_COUNT = 3;
+
+// Time constants (seconds) for the exponentially weighted statistics
+constexpr float STABILITY_EWMA_TAU[STABILITY_EWMA_COUNT] = {60.0, 3600.0,
+                                                            86400.0};
+enum StabilityPeriod { PERIOD_MINUTE = 0, PERIOD_HOUR = 1, PERIOD_DAY = 2 };
+
+// Exponentially weighted mean and variance where the weight depends on the
+// time since the last value, so the result covers a fixed period of time.
+class EwmaStatistic {
+ private:
+  double _mean = 0;
+  double _variance = 0;
+  bool _valid = false;
+
+ public:
+  void clear() {
+    _mean = 0;
+    _variance = 0;
+    _valid = false;
+  }
+
+  void add(float v, float dt, float tau) {
+    if (!_valid) {
+      _mean = v;
+      _variance = 0;
+      _valid = true;
+      return;
+    }
+
+    double alpha = 1.0 - exp(-dt / tau);
+    double diff = v - _mean;
+    double incr = alpha * diff;
+    _mean += incr;
+    _variance = (1.0 - alpha) * (_variance + diff * incr);
+  }
+
+  float average() const { return _valid ? _mean : NAN; }
+  float variance() const { return _valid ? _variance : NAN; }
+};
 
 class Stability {
  private:
-  statistic::Statistic<float, uint32_t, true> _stability;
+  // Sliding window with Welford style updates of mean and squared deviations
+  float _buf[STABILITY_WINDOW];
+  int _head = 0;
+  int _count = 0;
+  double _mean = 0;
+  double _m2 = 0;
+  uint32_t _total = 0;
+
+  // Monotonic queues with window positions for the min and max values
+  uint8_t _minQueue[STABILITY_WINDOW];
+  uint8_t _maxQueue[STABILITY_WINDOW];
+  int _minHead = 0, _minLen = 0;
+  int _maxHead = 0, _maxLen = 0;
+
+  EwmaStatistic _ewma[STABILITY_EWMA_COUNT];
+  uint32_t _lastTime = 0;
+
+  static_assert(STABILITY_WINDOW <= 256, "Queue positions are 8 bit");
+
+  int queuePos(int head, int i) const { return (head + i) % STABILITY_WINDOW; }
+
+  template <typename Compare>
+  void pushQueue(uint8_t *queue, int &head, int &len, int pos, float v,
+                 Compare keep) {
+    // Remove the position that leaves the window
+    if (len && queue[head] == pos) {
+      head = queuePos(head, 1);
+      len--;
+    }
+    // Values that can never be the min/max again are dropped
+    while (len && !keep(_buf[queue[queuePos(head, len - 1)]], v)) len--;
+    queue[queuePos(head, len)] = pos;
+    len++;
+  }
 
   // For viewing the stability of the scale over time. Uses raw / unfiltered
-  // values.
+  // values. All statistics use fixed memory and are updated in constant time.
  public:
-  void clear() { _stability.clear(); }
-  void add(float v) { _stability.add(v); }
-  float sum() { return _stability.sum(); }
-  float min() { return _stability.minimum(); }
-  float max() { return _stability.maximum(); }
-  float average() { return _stability.average(); }
-  float variance() { return _stability.variance(); }
-  float popStdev() { return _stability.pop_stdev(); }
-  float unbiasedStdev() { return _stability.unbiased_stdev(); }
-  uint32_t count() { return _stability.count(); }
+  Stability() { clear(); }
+
+  void clear() {
+    _head = 0;
+    _count = 0;
+    _mean = 0;
+    _m2 = 0;
+    _total = 0;
+    _minHead = _minLen = 0;
+    _maxHead = _maxLen = 0;
+    for (int i = 0; i < STABILITY_EWMA_COUNT; i++) _ewma[i].clear();
+  }
+
+  void add(float v) {
+    if (isnan(v)) return;
+
+    uint32_t now = millis();
+    float dt = _total ? (now - _lastTime) / 1000.0 : 0;
+    _lastTime = now;
+    _total++;
+
+    for (int i = 0; i < STABILITY_EWMA_COUNT; i++)
+      _ewma[i].add(v, dt, STABILITY_EWMA_TAU[i]);
+
+    int pos = _head;
+
+    if (_count == STABILITY_WINDOW) {
+      // Replace the oldest value, mean and m2 are updated in one step
+      float old = _buf[pos];
+      double oldMean = _mean;
+      double diff = static_cast<double>(v) - old;
+      _mean += diff / _count;
+      _m2 += diff * (v - _mean + old - oldMean);
+      if (_m2 < 0) _m2 = 0;
+    } else {
+      _count++;
+      double delta = v - _mean;
+      _mean += delta / _count;
+      _m2 += delta * (v - _mean);
+    }
+
+    _buf[pos] = v;
+    _head = queuePos(_head, 1);
+
+    pushQueue(_minQueue, _minHead, _minLen, pos, v,
+              [](float a, float b) { return a < b; });
+    pushQueue(_maxQueue, _maxHead, _maxLen, pos, v,
+              [](float a, float b) { return a > b; });
+  }
+
+  // Statistics for the values in the window
+  float sum() { return _mean * _count; }
+  float min() { return _minLen ? _buf[_minQueue[_minHead]] : NAN; }
+  float max() { return _maxLen ? _buf[_maxQueue[_maxHead]] : NAN; }
+  float average() { return _count ? _mean : NAN; }
+  float variance() { return _count ? _m2 / _count : NAN; }
+  float popStdev() { return sqrt(variance()); }
+  float unbiasedStdev() {
+    return _count > 1 ? sqrt(_m2 / (_count - 1)) : NAN;
+  }
+  uint32_t count() { return _count; }
+
+  // Number of values since the last clear
+  uint32_t total() { return _total; }
+
+  // Exponentially weighted statistics for the last minute, hour or day
+  float average(StabilityPeriod p) { return _ewma[p].average(); }
+  float variance(StabilityPeriod p) { return _ewma[p].variance(); }
 };
 
 #endif  // SRC_STABILITY_HPP_
@@ -0,0 +1,152 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_TEMPCOMPENSATION_HPP_
+#define SRC_TEMPCOMPENSATION_HPP_
+
+#include <Arduino.h>
+#include <tinyexpr.h>
+
+#include <utils.hpp>
+
+// Keeps a compiled version of the temperature compensation formula so that it
+// only needs to be parsed when the formula in the configuration changes. The
+// most common formula shape, weight*(a+b*(tempC-c)), is detected and evaluated
+// directly without using tinyexpr.
+class TempCompensation {
+ private:
+  String _formula;
+  te_expr *_expr = 0;
+  double _weight = 0;
+  double _tempC = 0;
+  double _tempF = 0;
+
+  bool _linear = false;
+  double _a = 0;
+  double _b = 0;
+  double _c = 0;
+
+  TempCompensation(const TempCompensation &) = delete;
+  void operator=(const TempCompensation &) = delete;
+
+  // Spaces are allowed between the tokens as in tinyexpr, not inside them
+  static void skipSpaces(const char *&p) { while (isspace(*p)) p++; }
+
+  static bool matchText(const char *&p, const char *s) {
+    size_t l = strlen(s);
+    skipSpaces(p);
+    if (strncmp(p, s, l)) return false;
+    p += l;
+    return true;
+  }
+
+  static bool matchSign(const char *&p, double &sign) {
+    skipSpaces(p);
+    if (*p != '+' && *p != '-') return false;
+    sign = *p++ == '-' ? -1 : 1;
+    return true;
+  }
+
+  // Unsigned number, tinyexpr also requires a digit or a point first
+  static bool matchNumber(const char *&p, double &d) {
+    char *end;
+    skipSpaces(p);
+    if (!isdigit(*p) && *p != '.') return false;
+    d = strtod(p, &end);
+    p = end;
+    return true;
+  }
+
+  // Detect weight*(a+b*(tempC-c)), the sign in front of b and c is kept.
+  bool parseLinear(const char *formula) {
+    const char *p = formula;
+    double a, b, c, signB, signC;
+
+    if (!matchText(p, "weight") || !matchText(p, "*") || !matchText(p, "(") ||
+        !matchNumber(p, a) || !matchSign(p, signB) || !matchNumber(p, b) ||
+        !matchText(p, "*") || !matchText(p, "(") || !matchText(p, "tempC") ||
+        !matchSign(p, signC) || !matchNumber(p, c) || !matchText(p, ")") ||
+        !matchText(p, ")"))
+      return false;
+
+    skipSpaces(p);
+    if (*p) return false;
+
+    _a = a;
+    _b = signB * b;
+    _c = signC * c;
+    return true;
+  }
+
+ public:
+  TempCompensation() {}
+  ~TempCompensation() { clear(); }
+
+  void clear() {
+    if (_expr) te_free(_expr);
+    _expr = 0;
+    _linear = false;
+    _formula = "";
+  }
+
+  // Will only compile the formula if it differs from the last one used.
+  bool compile(const char *formula) {
+    if (!strcmp(formula, _formula.c_str())) return isValid();
+
+    clear();
+    _formula = formula;
+
+    if (!strlen(formula)) return false;
+
+    if (parseLinear(formula)) {
+      _linear = true;
+      return true;
+    }
+
+    int err;
+    te_variable vars[] = {
+        {"weight", &_weight}, {"tempC", &_tempC}, {"tempF", &_tempF}};
+    _expr = te_compile(formula, vars, 3, &err);
+    return isValid();
+  }
+
+  bool isValid() const { return _linear || _expr; }
+  bool isLinear() const { return _linear; }
+
+  float calculate(float weight, float tempC) {
+    if (_linear)
+      return static_cast<double>(weight) *
+             (_a + _b * (static_cast<double>(tempC) + _c));
+
+    if (!_expr) return NAN;
+
+    _weight = weight;
+    _tempC = tempC;
+    _tempF = convertCtoF(tempC);
+    return te_eval(_expr);
+  }
+};
+
+#endif  // SRC_TEMPCOMPENSATION_HPP_
+
+// EOF
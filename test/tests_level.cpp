@@ -22,18 +22,46 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
 #include <AUnit.h>
+#include <LittleFS.h>
+#include <levelcusum.hpp>
+#include <levelkalman.hpp>
 #include <levelraw.hpp>
+#include <levels.hpp>
+#include <leveltask.hpp>
 #include <log.hpp>
 #include <main.hpp>
 #include <kegconfig.hpp>
+#include <spscqueue.hpp>
+#include <stability.hpp>
+#include <tempcompensation.hpp>
 
-RawLevelDetection raw(UnitIndex::U1, 1, 1, 1);
+RawLevelDetection raw(UnitIndex::U1);
 KegConfig myConfig("TEST", "TEST");
 
+namespace {
+// Readings with a small alternating noise around a level.
+float noisy(float level, int i, float amplitude = 0.001) {
+  const float noise[4] = {1.0, -1.0, 0.5, -0.5};
+  return level + amplitude * noise[i % 4];
+}
+
+// Plateau before and after 33 cl is poured, the pour starts at POUR_START.
+constexpr auto POUR_START = 20;
+constexpr auto POUR_BEFORE = 2.27;
+constexpr auto POUR_AFTER = 1.93;
+constexpr auto POUR_VOLUME = 0.34;
+
+float pourValue(int i) {
+  return noisy(i < POUR_START ? POUR_BEFORE : POUR_AFTER, i);
+}
+}  // namespace
+
 test(level_raw) {
   float data[10] = { 1.0, 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7, 1.8, 1.9 };
   float sum;
 
+  myConfig.setScaleRawWindow(8);
+
   // Check that we have the default values
   assertEqual(raw.hasRawValue(), false);
   assertEqual(raw.hasAverageValue(), false);
@@ -66,4 +94,375 @@ test(level_raw) {
   assertEqual(raw.sum(), sum);
 }
 
+test(level_raw_window) {
+  RawLevelDetection r(UnitIndex::U1);
+
+  myConfig.setScaleRawWindow(4);
+
+  r.add(1.0, 0);
+  r.add(2.0, 0);
+  assertEqual(r.hasAverageValue(), true);
+  assertEqual(r.hasSlopeValue(), false);
+  r.add(3.0, 0);
+  r.add(4.0, 0);
+  assertEqual(r.count(), 4);
+  assertEqual(r.sum(), 10.0);
+  assertEqual(r.getSlopeValue(), 3.0);
+
+  // Oldest value is replaced
+  r.add(5.0, 0);
+  assertEqual(r.count(), 4);
+  assertEqual(r.sum(), 14.0);
+  assertEqual(r.average(), 3.5);
+  assertEqual(r.getSlopeValue(), 3.0);
+
+  // Changing the window size will restart the history
+  myConfig.setScaleRawWindow(6);
+  r.add(6.0, 0);
+  assertEqual(r.windowSize(), 6);
+  assertEqual(r.count(), 1);
+  assertEqual(r.sum(), 6.0);
+}
+
+test(level_raw_kalman) {
+  RawLevelDetection r(UnitIndex::U1);
+
+  myConfig.setScaleRawWindow(4);
+  myConfig.setKalmanActive(true);
+  myConfig.setKalmanAdaptive(false);
+  myConfig.setKalmanMeasurement(0.5);
+
+  r.add(10.0, 0);
+  r.add(10.0, 0);
+  assertEqual(r.getKalmanMeasurementError(), 0.5);
+
+  // Changes in the configuration are applied to the running filter
+  myConfig.setKalmanMeasurement(0.2);
+  r.add(10.0, 0);
+  assertNear(r.getKalmanMeasurementError(), 0.2, 0.0001);
+
+  // Adaptive mode uses the measured noise when the level is stable
+  myConfig.setKalmanAdaptive(true);
+  r.add(10.2, 0);
+  r.add(10.0, 0);
+  assertNear(r.getNoiseValue(), 0.0075, 0.0001);
+  assertNear(r.getKalmanMeasurementError(), 0.0075, 0.0001);
+  myConfig.setKalmanAdaptive(false);
+
+  // When disabled the value is passed through
+  myConfig.setKalmanActive(false);
+  r.add(10.5, 0);
+  assertEqual(r.getKalmanValue(), 10.5);
+  myConfig.setKalmanActive(true);
+}
+
+test(level_raw_outlier) {
+  RawLevelDetection r(UnitIndex::U1);
+
+  myConfig.setScaleRawWindow(4);
+  myConfig.setScaleOutlierLimit(1.0);
+
+  r.add(10.0, 0);
+  r.add(10.1, 0);
+  r.add(9.9, 0);
+  r.add(10.0, 0);
+
+  // A single spike is replaced with the median
+  r.add(99.0, 0);
+  assertEqual(r.getRejectedCount(), static_cast<uint32_t>(1));
+  assertNear(r.getRawValue(), 10.0, 0.001);
+  assertNear(r.average(), 10.0, 0.001);
+
+  for (int i = 0; i < 5; i++) r.add(10.0, 0);
+  assertEqual(r.getRejectedCount(), static_cast<uint32_t>(1));
+
+  // A real level change is accepted when it is the majority
+  r.add(20.0, 0);
+  r.add(20.0, 0);
+  assertEqual(r.getRejectedCount(), static_cast<uint32_t>(3));
+  r.add(20.0, 0);
+  assertEqual(r.getRejectedCount(), static_cast<uint32_t>(3));
+  assertNear(r.getRawValue(), 20.0, 0.001);
+
+  r.clearRejectedCount();
+  assertEqual(r.getRejectedCount(), static_cast<uint32_t>(0));
+}
+
+test(level_temp_linear) {
+  // The closed form gives the same result as tinyexpr, "+0" at the end keeps
+  // the formula from being matched.
+  const char* formulas[] = {"weight*(1.0+0.002*(tempC+20))",
+                            "weight * (1.0 - 0.002 * (tempC - 20))",
+                            "weight*(1.0+0.002*(tempC-20.5))"};
+  const float temps[] = {-5.0, 4.0, 20.0, 30.0};
+  TempCompensation fast, expr;
+
+  for (const char* f : formulas) {
+    assertTrue(fast.compile(f));
+    assertTrue(fast.isLinear());
+    assertTrue(expr.compile((String(f) + "+0").c_str()));
+    assertFalse(expr.isLinear());
+
+    for (float t : temps)
+      assertNear(fast.calculate(10.0, t), expr.calculate(10.0, t), 0.0001);
+  }
+
+  // Other shapes fall back to tinyexpr
+  assertTrue(fast.compile("weight*(1.0+0.002*(tempF-68))"));
+  assertFalse(fast.isLinear());
+  assertNear(fast.calculate(10.0, 30.0), 10.0 * (1.0 + 0.002 * 18), 0.0001);
+
+  // Spaces only separate tokens, tinyexpr rejects a space inside a number
+  assertFalse(fast.compile("weight*(1 0+0.002*(tempC-20))"));
+  assertFalse(fast.isLinear());
+}
+
+test(level_kalman_pour) {
+  KalmanLevelDetection k(UnitIndex::U1);
+  uint32_t time = 0;
+  int i, pour = -1;
+
+  myConfig.setScaleStableCount(8);
+  myConfig.setScaleDeviationDecreaseValue(0.1);
+
+  for (i = 0; i < POUR_START; i++, time += 2000)
+    k.processValue(pourValue(i), 0.000001, time);
+
+  assertEqual(k.hasStableValue(), true);
+  assertNear(k.getStableValue(), POUR_BEFORE, 0.002);
+  assertEqual(k.hasPourValue(), false);
+
+  // A deviation inside the innovation gate is only partly followed
+  k.processValue(POUR_BEFORE + 0.002, 0.000001, time);
+  time += 2000;
+  assertEqual(k.getState(), LevelKalmanState::Stable);
+  assertLess(k.getValue(), POUR_BEFORE + 0.0015);
+
+  // A step outside the gate resets the covariance so the level follows it
+  // directly, the pour should be reported within a few samples
+  for (i = POUR_START; i < POUR_START + 10; i++, time += 2000) {
+    k.processValue(pourValue(i), 0.000001, time);
+    if (i == POUR_START) {
+      assertEqual(k.isPouring(), true);
+      assertNear(k.getValue(), POUR_AFTER, 0.002);
+    }
+    if (k.newPourValue()) pour = i - POUR_START;
+  }
+
+  assertMore(pour, -1);
+  assertLess(pour, 4);
+  assertNear(k.getPourValue(), POUR_VOLUME, 0.005);
+  assertNear(k.getStableValue(), POUR_AFTER, 0.002);
+  assertEqual(k.isPouring(), false);
+}
+
+test(level_cusum_pour) {
+  CusumLevelDetection c(UnitIndex::U1);
+  int i, pour = -1;
+
+  myConfig.setScaleStableCount(8);
+  myConfig.setScaleDeviationDecreaseValue(0.1);
+  myConfig.setScaleDeviationIncreaseValue(0.4);
+
+  for (i = 0; i < POUR_START; i++) c.processValue(pourValue(i));
+
+  assertEqual(c.hasStableValue(), true);
+  assertEqual(c.getState(), LevelCusumState::Plateau);
+  assertNear(c.getStableValue(), POUR_BEFORE, 0.002);
+
+  // A single spike is not a pour
+  c.processValue(2.45);
+  for (i = 0; i < 5; i++) c.processValue(pourValue(i));
+  assertEqual(c.hasPourValue(), false);
+
+  // 33 cl poured, the first value is taken during the pour
+  c.processValue(2.06);
+  for (i = POUR_START; i < POUR_START + 10; i++) {
+    c.processValue(pourValue(i));
+    if (c.newPourValue()) pour = i - POUR_START;
+  }
+
+  assertEqual(pour, 2);
+  assertNear(c.getPourValue(), POUR_VOLUME, 0.005);
+  assertNear(c.getStableValue(), POUR_AFTER, 0.002);
+}
+
+test(level_cusum_shift) {
+  CusumLevelDetection c(UnitIndex::U1);
+  int i;
+
+  // The shift is the smallest level change (0.1), half of it is drift
+  myConfig.setScaleStableCount(8);
+  myConfig.setScaleDeviationDecreaseValue(0.1);
+  myConfig.setScaleDeviationIncreaseValue(0.4);
+
+  for (i = 0; i < POUR_START; i++) c.processValue(pourValue(i));
+  assertEqual(c.getState(), LevelCusumState::Plateau);
+
+  // An offset within the drift never adds up to a change
+  for (i = 0; i < 10; i++) c.processValue(noisy(POUR_BEFORE - 0.04, i));
+  assertEqual(c.getState(), LevelCusumState::Plateau);
+  assertEqual(c.newStableValue(), false);
+
+  // The sum of a larger deviation has to exceed the shift
+  c.processValue(POUR_BEFORE - 0.13);
+  assertEqual(c.getState(), LevelCusumState::Plateau);
+  for (i = 0; i < 5; i++) c.processValue(pourValue(i));
+  c.processValue(POUR_BEFORE - 0.2);
+  assertEqual(c.getState(), LevelCusumState::Transition);
+}
+
+test(level_stability_window) {
+  Stability s;
+  float data[5] = {10.0, 10.2, 9.9, 10.1, 9.8};
+
+  assertEqual(s.count(), static_cast<uint32_t>(0));
+
+  // Fill the window and add a few more so the first values are replaced
+  for (int i = 0; i < STABILITY_WINDOW + 3; i++) s.add(data[i % 5]);
+
+  assertEqual(s.count(), static_cast<uint32_t>(STABILITY_WINDOW));
+  assertEqual(s.total(), static_cast<uint32_t>(STABILITY_WINDOW + 3));
+  assertNear(s.average(), 10.0, 0.001);
+  assertNear(s.variance(), 0.02, 0.0001);
+  assertNear(s.min(), 9.8, 0.0001);
+  assertNear(s.max(), 10.2, 0.0001);
+
+  // Min and max follow the window
+  for (int i = 0; i < STABILITY_WINDOW; i++) s.add(12.0);
+  assertNear(s.min(), 12.0, 0.0001);
+  assertNear(s.max(), 12.0, 0.0001);
+  assertNear(s.variance(), 0.0, 0.0001);
+
+  s.clear();
+  assertEqual(s.count(), static_cast<uint32_t>(0));
+  assertEqual(isnan(s.variance(StabilityPeriod::PERIOD_HOUR)), true);
+}
+
+test(level_stability_ewma) {
+  EwmaStatistic e;
+
+  e.add(10.0, 0, 60);
+  assertNear(e.average(), 10.0, 0.0001);
+  assertNear(e.variance(), 0.0, 0.0001);
+
+  // One time constant moves the average 63% towards the new value
+  e.add(12.0, 60, 60);
+  assertNear(e.average(), 11.264, 0.001);
+  assertNear(e.variance(), 0.930, 0.001);
+}
+
+test(level_restore) {
+  int i;
+
+  myConfig.setScaleRawWindow(4);
+  myConfig.setKalmanActive(false);
+  LittleFS.begin();
+  LittleFS.remove(LEVELS_STATE_FILENAME);
+
+  // Static since each instance is about 2 kB and the test runs on the loop
+  // stack of an ESP8266
+  static LevelDetection l;
+  assertFalse(l.loadState());
+  for (i = 0; i < 30; i++) l.update(UnitIndex::U1, noisy(10.0, i, 0.01), NAN);
+  assertTrue(l.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+  assertTrue(l.saveState());
+
+  // Levels are back after the reads have confirmed the weight
+  static LevelDetection r;
+  assertTrue(r.loadState());
+  assertTrue(r.isRestorePending(UnitIndex::U1));
+  assertFalse(r.isRestorePending(UnitIndex::U2));
+  r.update(UnitIndex::U1, 10.01, NAN);
+  assertFalse(r.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+  r.update(UnitIndex::U1, 9.99, NAN);
+  assertFalse(r.isRestorePending(UnitIndex::U1));
+  assertTrue(r.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+  assertTrue(r.hasStableWeight(UnitIndex::U1, LevelDetectionType::KALMAN));
+  assertTrue(r.hasStableWeight(UnitIndex::U1, LevelDetectionType::CUSUM));
+  assertNear(r.getStatsDetection(UnitIndex::U1)->getStableValue(),
+             l.getStatsDetection(UnitIndex::U1)->getStableValue(), 0.0001);
+  assertNear(r.getRawDetection(UnitIndex::U1)->getKalmanValue(), 10.0, 0.02);
+
+  // The keg was changed while the power was off
+  static LevelDetection c;
+  assertTrue(c.loadState());
+  c.update(UnitIndex::U1, 15.0, NAN);
+  c.update(UnitIndex::U1, 15.0, NAN);
+  assertFalse(c.isRestorePending(UnitIndex::U1));
+  assertFalse(c.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+
+  LittleFS.remove(LEVELS_STATE_FILENAME);
+  myConfig.setKalmanActive(true);
+}
+
+test(level_spsc_queue) {
+  SpscQueue<int, 4> q;
+  int v;
+
+  assertTrue(q.empty());
+  assertFalse(q.pop(v));
+  for (int i = 0; i < 4; i++) assertTrue(q.push(i));
+  assertFalse(q.push(4));
+  assertEqual(q.size(), static_cast<size_t>(4));
+
+  // Indexes continue after the wrap
+  for (int i = 0; i < 10; i++) {
+    assertTrue(q.pop(v));
+    assertEqual(v, i);
+    assertTrue(q.push(i + 4));
+  }
+  assertEqual(q.size(), static_cast<size_t>(4));
+}
+
+test(level_task) {
+  const int n = 200;
+  // Static to keep the 2.5 kB off the loop stack of an ESP8266
+  static LevelDetection l;
+  static LevelTask task(&l);
+  static LevelSnapshot s;
+
+  myConfig.setScaleRawWindow(4);
+
+  // Values are processed by the level task (or from loop() without tasks)
+  // while this side produces them and reads the snapshot.
+  task.begin();
+  for (int i = 0; i < n; i++) {
+    while (!task.push(i % 2 ? UnitIndex::U2 : UnitIndex::U1,
+                      i % 2 ? 20.0 : 10.0, NAN)) {
+      task.loop();
+      delay(1);
+    }
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    task.loop();
+    task.getSnapshot(s);
+    if (s.updates == n) break;
+    delay(1);
+  }
+  task.end();
+
+  assertEqual(s.updates, static_cast<uint32_t>(n));
+  assertEqual(task.getQueued(), static_cast<size_t>(0));
+  assertNear(s.getTotalRawWeight(UnitIndex::U1), 10.0, 0.0001);
+  assertNear(s.getTotalRawWeight(UnitIndex::U2), 20.0, 0.0001);
+  assertEqual(s.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS),
+              l.hasStableWeight(UnitIndex::U1, LevelDetectionType::STATS));
+  assertFalse(s.isPouring(UnitIndex::U1));
+  assertEqual(s.getStability(UnitIndex::U2).total,
+              static_cast<uint32_t>(n / 2));
+
+  // An unknown type from the config is not used as an index
+  LevelDetectionType unknown = static_cast<LevelDetectionType>(7);
+  assertFalse(s.hasStableWeight(UnitIndex::U1, unknown));
+  assertTrue(isnan(s.getTotalWeight(UnitIndex::U1, unknown)));
+
+  // Stability is cleared by the level task
+  task.requestClearStability();
+  task.process();
+  task.getSnapshot(s);
+  assertEqual(s.getStability(UnitIndex::U2).total, static_cast<uint32_t>(0));
+}
+
 // EOF
@@ -0,0 +1,163 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+#include <LittleFS.h>
+#include <outbox.hpp>
+#include <pushpolicy.hpp>
+
+namespace {
+void clearOutbox() {
+  LittleFS.begin();
+  LittleFS.remove(OUTBOX_FILENAME);
+  LittleFS.remove(OUTBOX_INDEX_FILENAME);
+}
+
+OutboxRecord record(int i) {
+  return {static_cast<uint32_t>(1000 + i), 0, 0, 0, static_cast<float>(i),
+          0.5};
+}
+}  // namespace
+
+test(push_outbox) {
+  OutboxRecord r[OUTBOX_BATCH];
+  clearOutbox();
+
+  PushOutbox o;
+  assertFalse(o.begin());
+  for (int i = 0; i < 6; i++) assertTrue(o.append(record(i)));
+  assertEqual(o.count(), static_cast<uint32_t>(6));
+
+  // Each target has its own cursor
+  assertEqual(o.read(0, &r[0], OUTBOX_BATCH), OUTBOX_BATCH);
+  assertEqual(r[3].stableVol, 3.0f);
+  o.advance(0, 4);
+  assertEqual(o.pending(0), static_cast<uint32_t>(2));
+  assertEqual(o.pending(1), static_cast<uint32_t>(6));
+  assertEqual(o.read(0, &r[0], OUTBOX_BATCH), 2);
+  assertEqual(r[0].stableVol, 4.0f);
+  assertEqual(r[1].time, static_cast<uint32_t>(1005));
+
+  // The cursors are kept after a restart
+  PushOutbox p;
+  assertTrue(p.begin());
+  assertEqual(p.count(), static_cast<uint32_t>(6));
+  assertEqual(p.pending(0), static_cast<uint32_t>(2));
+  assertEqual(p.pending(3), static_cast<uint32_t>(6));
+
+  // The file is removed when all targets have the records
+  for (int i = 0; i < OUTBOX_TARGETS; i++) p.advance(i, p.pending(i));
+  assertEqual(p.count(), static_cast<uint32_t>(0));
+  assertFalse(LittleFS.exists(OUTBOX_FILENAME));
+  assertTrue(p.append(record(6)));
+  assertEqual(p.read(2, &r[0], OUTBOX_BATCH), 1);
+  assertEqual(r[0].stableVol, 6.0f);
+
+  clearOutbox();
+}
+
+test(push_outbox_full) {
+  OutboxRecord r;
+  clearOutbox();
+
+  PushOutbox o;
+  o.begin();
+  for (int i = 0; i < OUTBOX_RECORDS_MAX; i++) o.append(record(i));
+  for (int i = 1; i < OUTBOX_TARGETS; i++) o.advance(i, OUTBOX_RECORDS_MAX);
+  assertEqual(o.count(), static_cast<uint32_t>(OUTBOX_RECORDS_MAX));
+
+  // Target 0 is down, the oldest quarter is dropped
+  assertTrue(o.append(record(OUTBOX_RECORDS_MAX)));
+  assertEqual(o.lost(), static_cast<uint32_t>(OUTBOX_RECORDS_MAX / 4));
+  assertEqual(o.count(),
+              static_cast<uint32_t>(OUTBOX_RECORDS_MAX * 3 / 4 + 1));
+  assertEqual(o.pending(0), o.count());
+  assertEqual(o.pending(1), static_cast<uint32_t>(1));
+  assertEqual(o.read(0, &r, 1), 1);
+  assertEqual(r.stableVol, static_cast<float>(OUTBOX_RECORDS_MAX / 4));
+
+  clearOutbox();
+}
+
+test(push_outbox_backoff) {
+  PushOutbox o;
+
+  assertTrue(o.isDue(0, 0));
+  o.failed(0, 1000);
+  assertEqual(o.getBackoff(0), OUTBOX_BACKOFF_MIN);
+  assertFalse(o.isDue(0, 1000));
+  assertTrue(o.isDue(0, 1000 + OUTBOX_BACKOFF_MIN));
+  assertTrue(o.isDue(1, 1000));
+
+  o.failed(0, 1000);
+  assertEqual(o.getBackoff(0), 2 * OUTBOX_BACKOFF_MIN);
+  for (int i = 0; i < 20; i++) o.failed(0, 1000);
+  assertEqual(o.getBackoff(0), OUTBOX_BACKOFF_MAX);
+
+  o.succeeded(0);
+  assertTrue(o.isDue(0, 1000));
+}
+
+test(push_coalescer) {
+  PushCoalescer c;
+  KegUpdate u;
+
+  c.setPolicy({5000, 30000, 0.05, 600000});
+  assertFalse(c.next(0, u));
+
+  // A burst of levels is sent as the last one after the delay
+  c.update({UnitIndex::U1, 10.0, 0, 20}, 1000);
+  c.update({UnitIndex::U1, 12.0, 0, 24}, 3000);
+  c.update({UnitIndex::U1, 15.0, 0, 30}, 5000);
+  assertFalse(c.next(5999, u));
+  assertTrue(c.next(6000, u));
+  assertEqual(u.stableVol, 15.0f);
+  assertEqual(c.getCoalesced(), static_cast<uint32_t>(2));
+  c.delivered(UnitIndex::U1, 6000);
+  assertEqual(c.pending(), 0);
+
+  // Not before the interval and only if the change is large enough
+  c.update({UnitIndex::U1, 14.0, 0, 28}, 7000);
+  assertFalse(c.next(35999, u));
+  assertTrue(c.next(36000, u));
+  c.delivered(UnitIndex::U1, 36000);
+  c.update({UnitIndex::U1, 14.02, 0, 28}, 70000);
+  assertFalse(c.next(80000, u));
+  assertEqual(c.pending(), 0);
+  assertEqual(c.getCoalesced(), static_cast<uint32_t>(3));
+
+  // The taps are independent and a failed update is kept
+  c.update({UnitIndex::U2, 5.0, 0, 10}, 80000);
+  assertTrue(c.next(85000, u));
+  assertEqual(u.idx, UnitIndex::U2);
+  assertTrue(c.next(90000, u));
+  c.delivered(UnitIndex::U2, 90000);
+
+  // The last level is sent again after the refresh time
+  assertFalse(c.next(635999, u));
+  assertTrue(c.next(636000, u));
+  assertEqual(u.idx, UnitIndex::U1);
+  assertEqual(u.stableVol, 14.02f);
+}
+
+// EOF
@@ -0,0 +1,303 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+#include <LittleFS.h>
+#include <calibration.hpp>
+#include <capture.hpp>
+#include <decimator.hpp>
+#include <hx711spi.hpp>
+#include <sampler.hpp>
+#include <scale_replay.hpp>
+
+// Host model of a HX711 on the SPI bus, MOSI is PD_SCK and MISO is DOUT. The
+// next bit is shifted out on every rising edge of PD_SCK.
+class HX711SpiMock {
+ private:
+  uint32_t _value;
+  int _pulses = 0;
+
+ public:
+  explicit HX711SpiMock(int32_t value) : _value(value & 0xffffff) {}
+
+  int pulses() { return _pulses; }
+
+  void transfer(const uint8_t (&tx)[HX711_SPI_BYTES],
+                uint8_t (&rx)[HX711_SPI_BYTES]) {
+    bool clock = false;
+    bool data = false;  // Low when a conversion is ready
+
+    for (int bit = 0; bit < HX711_SPI_BYTES * 8; bit++) {
+      bool c = (tx[bit / 8] >> (7 - bit % 8)) & 1;
+
+      if (c && !clock) {
+        data = _pulses < HX711_DATA_BITS
+                   ? (_value >> (HX711_DATA_BITS - 1 - _pulses)) & 1
+                   : true;
+        _pulses++;
+      }
+
+      clock = c;
+      rx[bit / 8] = (rx[bit / 8] & ~(0x80 >> (bit % 8))) |
+                    (data ? 0x80 >> (bit % 8) : 0);
+    }
+  }
+};
+
+test(scale_hx711_sign) {
+  uint32_t raw[4] = {0x000000, 0x7fffff, 0x800000, 0xffffff};
+  int32_t values[4] = {0, 8388607, -8388608, -1};
+
+  for (int i = 0; i < 4; i++) assertEqual(hx711SignExtend(raw[i]), values[i]);
+}
+
+test(scale_hx711_spi) {
+  int32_t values[5] = {0, 1, 123456, -1, -8388608};
+  uint8_t tx[HX711_SPI_BYTES];
+  uint8_t rx[HX711_SPI_BYTES];
+
+  hx711SpiClock(tx);
+
+  for (int i = 0; i < 5; i++) {
+    HX711SpiMock mock(values[i]);
+
+    mock.transfer(tx, rx);
+    assertEqual(mock.pulses(), HX711_PULSES);  // Gain is kept at 128
+    assertEqual(hx711SpiDecode(rx), values[i]);
+  }
+
+  // PD_SCK must be low when the transfer ends
+  assertEqual(tx[HX711_SPI_BYTES - 1] & 0x01, 0);
+}
+
+test(scale_decimator) {
+  CicDecimator<2> cic;
+  int i, outputs = 0;
+
+  // A constant is passed through once the filter is filled
+  cic.setFactor(4);
+  for (i = 0; i < 8; i++) assertFalse(cic.add(1000));
+  for (i = 0; i < 16; i++) outputs += cic.add(1000) ? 1 : 0;
+  assertEqual(outputs, 4);
+  assertNear(cic.output(), 1000.0, 0.001);
+
+  // Noise at the input rate is removed
+  for (i = 0; i < 40; i++) cic.add(i % 2 ? 1100 : 900);
+  assertNear(cic.output(), 1000.0, 0.001);
+
+  // Negative values and a large offset
+  cic.setFactor(320);
+  assertFalse(cic.hasOutput());
+  for (i = 0; i < 960; i++) cic.add(-8000000 + (i % 3) - 1);
+  assertEqual(cic.outputs(), static_cast<uint32_t>(1));
+  assertNear(cic.output(), -8000000.0, 1.0);
+}
+
+test(scale_sampler) {
+  AdaptiveSampler s;
+
+  // All conversions are used until the driver reports them
+  assertTrue(s.isDue(0));
+  s.update(0, 0, NAN, NAN, 0.1);
+  assertEqual(s.getMode(), SamplerMode::SAMPLER_STARTUP);
+  assertEqual(s.getCount(), SAMPLER_COUNT_MAX);
+  assertFalse(s.isDue(1000));
+  assertTrue(s.isDue(2000));
+  s.update(2000, 0, 0.00001, 1.0, 0.1);
+  assertEqual(s.getMode(), SamplerMode::SAMPLER_STARTUP);
+
+  // Low noise, a few conversions is enough
+  s.clear();
+  s.update(0, 0, NAN, NAN, 0.1);
+  s.update(2000, 20, 0.0000001, 0.0, 0.1);
+  assertEqual(s.getMode(), SamplerMode::SAMPLER_IDLE);
+  assertNear(s.getRate(), 10.0, 0.001);
+  assertEqual(s.getCount(), 2);
+
+  // Pouring, the cadence is the same but only the latest values are used
+  assertFalse(s.isDue(2500));
+  s.update(4000, 40, 0.0000001, -0.5, 0.1);
+  assertEqual(s.getMode(), SamplerMode::SAMPLER_POUR);
+  assertEqual(s.getInterval(), static_cast<uint32_t>(SAMPLER_INTERVAL));
+  assertEqual(s.getCount(), 5);
+
+  // High noise, limited to the conversions of one interval
+  s.clear();
+  s.update(0, 0, NAN, NAN, 0.1);
+  s.update(2000, 10, 0.0001, 0.0, 0.1);
+  assertEqual(s.getMode(), SamplerMode::SAMPLER_IDLE);
+  assertEqual(s.getCount(), 10);
+}
+
+test(scale_calibration) {
+  ScaleCalibration c;
+
+  assertFalse(c.isRunning());
+  c.start(CalibrationState::CALIBRATION_FACTOR, 4, 2.5, 1000);
+  assertTrue(c.isRunning());
+  assertEqual(c.getWeight(), 2.5f);
+
+  // Conversions are gathered over several calls
+  c.add(-1000, 1010);
+  c.add(-1002, 1020);
+  assertEqual(c.progress(), 50);
+  assertFalse(c.isComplete());
+  c.add(-998, 1030);
+  c.add(-1000, 1040);
+  c.add(5000, 1050);  // Ignored when complete
+  assertTrue(c.isComplete());
+  assertEqual(c.average(), static_cast<int32_t>(-1000));
+  c.finish(true);
+  assertFalse(c.isRunning());
+  assertEqual(c.progress(), 100);
+
+  // No conversions from the driver
+  c.start(CalibrationState::CALIBRATION_TARE, 10, 0, 1000);
+  assertFalse(c.isTimeout(1000 + CALIBRATION_TIMEOUT));
+  assertTrue(c.isTimeout(1001 + CALIBRATION_TIMEOUT));
+  c.finish(false);
+  assertEqual(c.getState(), CalibrationState::CALIBRATION_FAILED);
+}
+
+test(scale_calibration_table) {
+  CalibrationTable t;
+  CalibrationPoint p[4] = {
+      {40000, 20.0}, {10000, 5.0}, {21000, 10.0}, {10000, 5.5}};
+
+  // Needs at least one point besides the tare
+  t.set(p, 0);
+  assertEqual(t.size(), 0);
+  assertTrue(isnan(t.convert(1000)));
+
+  // One point is the same as a scale factor
+  t.set(p, 1);
+  assertEqual(t.size(), 1);
+  assertNear(t.convert(20000), 10.0, 0.0001);
+  assertNear(t.convert(-2000), -1.0, 0.0001);
+
+  // Points are sorted and the duplicate counts are skipped
+  t.set(p, 4);
+  assertEqual(t.size(), 3);
+  assertNear(t.convert(5000), 2.5, 0.0001);
+  assertNear(t.convert(10000), 5.0, 0.0001);
+  assertNear(t.convert(15500), 7.5, 0.0001);
+  assertNear(t.convert(21000), 10.0, 0.0001);
+  assertNear(t.convert(30500), 15.0, 0.0001);
+
+  // Outside the points the last segment is extended
+  assertNear(t.convert(59000), 30.0, 0.0001);
+}
+
+test(scale_capture) {
+  RawCapture c;
+  CaptureHeader h;
+  CaptureRecord r;
+  uint8_t buf[5];
+  uint32_t i;
+
+  // Nothing is recorded before a start
+  c.setup();
+  assertTrue(c.capacity() > static_cast<uint32_t>(0));
+  c.add(UnitIndex::U1, 100);
+  assertEqual(c.count(), static_cast<uint32_t>(0));
+  assertFalse(c.start(CAPTURE_SECONDS_MAX + 1));
+
+  assertTrue(c.start(10));
+  assertTrue(c.isRunning());
+  for (i = 0; i < c.capacity() + 3; i++)
+    c.add(i % 2 ? UnitIndex::U2 : UnitIndex::U1, -static_cast<int32_t>(i));
+  c.stop();
+  assertEqual(c.count(), c.capacity());
+  assertEqual(c.dropped(), static_cast<uint32_t>(3));
+
+  // Read in small parts as the web server does
+  assertEqual(c.read(reinterpret_cast<uint8_t*>(&h), sizeof(h), 0),
+              sizeof(h));
+  assertEqual(strncmp(h.magic, CAPTURE_MAGIC, 4), 0);
+  assertEqual(h.count, c.capacity());
+  assertEqual(h.dropped, static_cast<uint32_t>(3));
+
+  assertEqual(c.read(buf, 5, sizeof(h)), static_cast<size_t>(5));
+  memcpy(&r, buf, 5);
+  assertEqual(c.read(buf, 5, sizeof(h) + 5), static_cast<size_t>(5));
+  memcpy(reinterpret_cast<uint8_t*>(&r) + 5, buf, 3);
+  assertEqual(r.counts, static_cast<int32_t>(-3));  // Oldest kept record
+  assertEqual(r.time & CAPTURE_SCALE_BIT, CAPTURE_SCALE_BIT);
+
+  // Nothing after the end
+  assertEqual(c.read(buf, 5, c.size()), static_cast<size_t>(0));
+
+  // A download keeps the capture until it has ended
+  c.beginRead();
+  assertFalse(c.start(10));
+  assertEqual(c.count(), c.capacity());
+  c.endRead();
+  assertTrue(c.start(10));
+  c.stop();
+}
+
+test(scale_replay) {
+  const char* file = "/replay.kds";
+  DatasetHeader h = {{'K', 'G', 'D', 'S'}, DATASET_VERSION,
+                     sizeof(DatasetRecord), 2000, 3};
+  DatasetRecord r[3] = {
+      {0, 10.0, 20.0, 4.0}, {2000, 9.5, 20.0, 4.0}, {4000, 9.0, 19.5, 4.0}};
+
+  LittleFS.begin();
+  File f = LittleFS.open(file, "w");
+  f.write(reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+  f.write(reinterpret_cast<const uint8_t*>(&r[0]), sizeof(r));
+  f.close();
+
+  // Speed 0 steps one record for each read of the first scale
+  ScaleDriverReplay d(file, 0);
+  d.setup(false);
+  assertTrue(d.isConnected(UnitIndex::U1));
+  assertNear(d.read(UnitIndex::U1), 10.0, 0.001);
+  assertNear(d.read(UnitIndex::U2), 20.0, 0.001);
+  assertNear(d.read(UnitIndex::U1), 9.5, 0.001);
+  assertNear(d.read(UnitIndex::U1), 9.0, 0.001);
+  assertNear(d.read(UnitIndex::U2), 19.5, 0.001);
+
+  // Starts over at the end
+  assertNear(d.read(UnitIndex::U1), 10.0, 0.001);
+
+  // The count in the header is used unless the file is shorter
+  DatasetReader reader;
+
+  for (uint32_t count : {2, 5}) {
+    h.count = count;
+    f = LittleFS.open(file, "w");
+    f.write(reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+    f.write(reinterpret_cast<const uint8_t*>(&r[0]), sizeof(r));
+    f.close();
+
+    assertTrue(reader.open(file));
+    assertEqual(reader.count(), count < 3 ? count : static_cast<uint32_t>(3));
+    reader.close();
+  }
+
+  LittleFS.remove(file);
+}
+
+// EOF
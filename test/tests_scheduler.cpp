@@ -0,0 +1,109 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+#include <scheduler.hpp>
+
+namespace {
+int runsA = 0;
+int runsB = 0;
+void taskA() { runsA++; }
+void taskB() { runsB++; }
+}  // namespace
+
+test(scheduler_order) {
+  Scheduler s;
+  runsA = runsB = 0;
+
+  assertEqual(s.add("a", taskA, 1000, 100, 500, 0), 0);
+  assertEqual(s.add("b", taskB, 2000, 100, 200, 0), 1);
+  assertEqual(s.size(), 2);
+  assertEqual(s.getNext(), static_cast<uint32_t>(200));
+
+  assertFalse(s.loop(100));
+  assertTrue(s.loop(200));
+  assertEqual(runsB, 1);
+  assertEqual(s.getNext(), static_cast<uint32_t>(500));
+
+  // Both are due, only one task is run for each loop
+  assertTrue(s.loop(2200));
+  assertTrue(s.loop(2200));
+  assertFalse(s.loop(2200));
+  assertEqual(runsA, 1);
+  assertEqual(runsB, 2);
+
+  // Task a was 1700 ms late, the missed periods are skipped
+  const SchedulerTask* t = s.getTask(0);
+  assertEqual(t->runs, static_cast<uint32_t>(1));
+  assertEqual(t->late, static_cast<uint32_t>(1));
+  assertEqual(t->skipped, static_cast<uint32_t>(1));
+  assertEqual(t->maxLate, static_cast<uint32_t>(1700));
+  assertEqual(t->next, static_cast<uint32_t>(2500));
+}
+
+test(scheduler_stagger) {
+  Scheduler s;
+
+  s.add("a", taskA, 10000, 1000, -1, 0);
+  s.add("b", taskB, 10000, 1000, -1, 0);
+  s.add("c", taskB, 2000, 1000, 0, 0);
+  s.add("d", taskA, 10000, 1000, -1, 0);
+
+  // Negative delay waits one period and spreads the first runs
+  assertEqual(s.getTask(0)->next, static_cast<uint32_t>(10000));
+  assertEqual(s.getTask(1)->next,
+              static_cast<uint32_t>(10000 + SCHEDULER_SPREAD));
+  assertEqual(s.getTask(2)->next, static_cast<uint32_t>(0));
+  assertEqual(s.getTask(3)->next,
+              static_cast<uint32_t>(10000 + 3 * SCHEDULER_SPREAD));
+  assertEqual(s.add("e", nullptr, 1000, 0), -1);
+}
+
+test(scheduler_trigger) {
+  Scheduler s;
+  runsA = 0;
+
+  s.add("a", taskA, 60000, 100, 60000, 0);
+  assertFalse(s.loop(1000));
+  s.trigger(0, 1000);
+  assertTrue(s.loop(1000));
+  assertEqual(runsA, 1);
+  assertEqual(s.getTask(0)->next, static_cast<uint32_t>(61000));
+  assertEqual(s.getTask(0)->late, static_cast<uint32_t>(0));
+
+  s.clearStatistics();
+  assertEqual(s.getTask(0)->runs, static_cast<uint32_t>(0));
+}
+
+test(scheduler_wrap) {
+  Scheduler s;
+  runsA = 0;
+
+  // Deadlines are compared across the millis() overflow
+  s.add("a", taskA, 1000, 100, 500, 0xFFFFFE00);
+  assertFalse(s.loop(0xFFFFFF00));
+  assertTrue(s.loop(0x00000100));
+  assertEqual(s.getTask(0)->next, static_cast<uint32_t>(0x000003DC));
+}
+
+// EOF